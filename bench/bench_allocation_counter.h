@@ -0,0 +1,9 @@
+/* Replaces the global operator new and delete of the binaries it is linked
+   into, counting every heap allocation. */
+#ifndef WORKLOAD_INSTRUMENTATION_BENCH_ALLOCATION_COUNTER_H
+#define WORKLOAD_INSTRUMENTATION_BENCH_ALLOCATION_COUNTER_H
+
+/* Allocations made so far by all threads. */
+unsigned long long bench_allocation_count();
+
+#endif /* WORKLOAD_INSTRUMENTATION_BENCH_ALLOCATION_COUNTER_H */
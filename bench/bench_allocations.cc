@@ -0,0 +1,162 @@
+/* Counts heap allocations on the statement path and on performance_schema
+   reads. Both are expected to be allocation free once a workload has been
+   seen, so any allocation makes the run fail. */
+#include <cstdio>
+#include <cstring>
+
+#include "bench_allocation_counter.h"
+#include "bench_services.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_digest.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sampling.h"
+#include "workload_instrumentation_statement_cache.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_tags.h"
+#include "workload_instrumentation_thd_stats.h"
+
+#define BENCH_STATEMENTS 100000
+
+static const char *queries[] = {
+    "SELECT * FROM users WHERE id = 1 /* WORKLOAD_NAME=api_users */",
+    "SELECT * FROM users WHERE id = 2 /* WORKLOAD_NAME=api_users,"
+    "TEAM='identity',ENDPOINT='users%2Fshow',SHARD_KEY='42' */",
+    "UPDATE orders SET state = 'shipped' WHERE id = 7 "
+    "/* WORKLOAD_NAME=order_pipeline_with_a_name_longer_than_fifty_chars */",
+    "/* WORKLOAD_NAME=reporting */ SELECT COUNT(*) FROM events",
+    "SELECT 1",
+};
+
+/* Same steps as the query event callback of the component. */
+static void run_statement(const char *query) {
+  if (!sample_statement_start()) {
+    sample_statement_end();
+    return;
+  }
+
+  thread_stats ts;
+  ts.rows_examined = 10;
+  ts.rows_sent = 1;
+  ts.rows_affected = 0;
+  ts.end_ns = monotonic_clock_ns();
+  ts.duration_ns = 250000;
+  ts.lock_time_ns = 1000;
+  ts.cpu_time_ns = 200000;
+
+  workload_record_hint *hint;
+  workload_tag_hint *tags;
+  std::string_view workload =
+      workload_statement_cache_find(query, strlen(query), &hint, &tags);
+  unsigned int weight = sample_statement_end();
+  const workload_statement_digest *digest =
+      workload_digest_cache_find(query, strlen(query));
+  record_stats(workload, &ts, weight, digest, hint);
+  record_tag_stats(tags, &ts, weight);
+  sample_statement_recorded(workload, &ts, digest, tags);
+}
+
+static bool report(const char *name, unsigned long long count,
+                   unsigned long long ops) {
+  printf("%-40s %10llu ops %8.3f allocs/op\n", name, ops,
+         ops == 0 ? 0.0 : (double)count / ops);
+  return count != 0;
+}
+
+static bool bench_statements(const char *name) {
+  /* First sight of a workload creates its record and the thread cache. */
+  for (auto *query : queries) run_statement(query);
+
+  auto before = bench_allocation_count();
+  for (int i = 0; i < BENCH_STATEMENTS; i++) {
+    run_statement(queries[i % (sizeof(queries) / sizeof(queries[0]))]);
+  }
+  return report(name, bench_allocation_count() - before, BENCH_STATEMENTS);
+}
+
+static bool bench_scan(const char *name) {
+  auto *table = bench_table(name);
+  if (table == nullptr) {
+    fprintf(stderr, "Table %s is not registered\n", name);
+    return true;
+  }
+  auto &proxy = table->m_proxy_engine_table;
+  unsigned int columns = bench_table_columns(table);
+
+  PSI_pos *pos;
+  auto *handle = proxy.open_table(&pos);
+  proxy.rnd_init(handle, true);
+
+  unsigned long long rows = 0;
+  auto before = bench_allocation_count();
+  while (proxy.rnd_next(handle) == 0) {
+    for (unsigned int i = 0; i < columns; i++) {
+      bench_field field;
+      proxy.read_column_value(handle, (PSI_field *)&field, i);
+    }
+    rows++;
+  }
+  auto count = bench_allocation_count() - before;
+  proxy.close_table(handle);
+
+  char label[80];
+  snprintf(label, sizeof(label), "%s row", name);
+  return report(label, count, rows);
+}
+
+static bool bench_lookup(const char *name, const char *workload) {
+  auto *table = bench_table(name);
+  auto &proxy = table->m_proxy_engine_table;
+  unsigned int columns = bench_table_columns(table);
+
+  PSI_pos *pos;
+  auto *handle = proxy.open_table(&pos);
+
+  bench_field key;
+  key.length = snprintf(key.str, sizeof(key.str), "%s", workload);
+
+  unsigned long long rows = 0;
+  auto before = bench_allocation_count();
+  PSI_index_handle *index;
+  proxy.index_init(handle, 0, false, &index);
+  proxy.index_read(index, (PSI_key_reader *)&key, 0, 0);
+  proxy.reset_position(handle);
+  while (proxy.index_next(handle) == 0) {
+    for (unsigned int i = 0; i < columns; i++) {
+      bench_field field;
+      proxy.read_column_value(handle, (PSI_field *)&field, i);
+    }
+    rows++;
+  }
+  auto count = bench_allocation_count() - before;
+  proxy.close_table(handle);
+
+  if (rows != 1) {
+    fprintf(stderr, "Lookup of %s returned %llu rows\n", workload, rows);
+    return true;
+  }
+
+  char label[80];
+  snprintf(label, sizeof(label), "%s lookup", name);
+  return report(label, count, rows);
+}
+
+int main() {
+  if (bench_init()) return 1;
+
+  bool failed = bench_statements("statement");
+  sample_rate_value = 10;
+  failed |= bench_statements("statement, 1 in 10 sampled");
+  sample_rate_value = 1;
+  failed |= bench_scan("workload_instrumentation");
+  failed |= bench_scan("workload_instrumentation_histogram");
+  failed |= bench_scan("workload_instrumentation_window");
+  failed |= bench_scan("workload_instrumentation_top_digests");
+  failed |= bench_lookup("workload_instrumentation", "reporting");
+  bench_deinit();
+
+  if (bench_init("TEAM,ENDPOINT,SHARD_KEY")) return 1;
+  failed |= bench_statements("statement, 3 tags");
+  failed |= bench_scan("workload_instrumentation_tags");
+  bench_deinit();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/* Runs statements of more workloads than workload_instrumentation.max_workloads
+   while reading the performance_schema tables, so that workloads keep being
+   evicted and their records reused, while writers keep resolving workloads
+   through their statement cache. Checks that rows stay consistent and that
+   no statement is lost: evicted counters go to __EVICTED__. Statement end
+   times are simulated, one statement every 100us. Meant to be run under
+   ThreadSanitizer too (-DWORKLOAD_BENCH_SANITIZER=thread). */
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bench_services.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_statement_cache.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_thd_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#define STRESS_WRITERS 8
+#define STRESS_READERS 2
+#define STRESS_STATEMENTS 50000
+#define STRESS_STATEMENT_NS (100 * NANOS_PER_MICRO)
+/* Statements in a row of the same workload, and workloads cycled through. */
+#define STRESS_WORKLOAD_STATEMENTS 1000
+#define STRESS_WORKLOADS 20
+#define STRESS_MAX_WORKLOADS 5
+
+enum column {
+  WORKLOAD = 0,
+  COUNT_QUERIES = 1,
+  SUM_ROWS_EXAMINED = 2,
+  SUM_ROWS_SENT = 3,
+  SUM_LOCK_TIME_US = 9,
+  COLUMNS = 11
+};
+
+static std::atomic<bool> writers_done{false};
+static std::atomic<unsigned long long> errors{0};
+static unsigned long long start_ns;
+
+static void writer(int id) {
+  char query[64];
+  for (int i = 0; i < STRESS_STATEMENTS; i++) {
+    thread_stats ts;
+    ts.rows_examined = 2;
+    ts.rows_sent = 1;
+    ts.rows_affected = 0;
+    ts.end_ns = start_ns + (i + id) * STRESS_STATEMENT_NS;
+    ts.duration_ns = 1000;
+    ts.lock_time_ns = 2000;
+    ts.cpu_time_ns = 0;
+
+    // Resolved through the statement cache, whose record hints must not
+    // outlive evictions.
+    int length = snprintf(query, sizeof(query),
+                          "/* WORKLOAD_NAME=evict_%d */ SELECT 1",
+                          (i / STRESS_WORKLOAD_STATEMENTS) % STRESS_WORKLOADS);
+    workload_record_hint *hint;
+    workload_tag_hint *tags;
+    std::string_view workload =
+        workload_statement_cache_find(query, length, &hint, &tags);
+    record_stats(workload, &ts, 1, nullptr, hint);
+  }
+  workload_thread_cache_release();
+}
+
+/* Scans the table, checking rows and returning the total of COUNT_QUERIES. */
+static unsigned long long scan(unsigned long long *evicted) {
+  auto &proxy = bench_table("workload_instrumentation")->m_proxy_engine_table;
+  PSI_pos *pos;
+  auto *handle = proxy.open_table(&pos);
+  proxy.rnd_init(handle, true);
+
+  unsigned long long total = 0;
+  while (proxy.rnd_next(handle) == 0) {
+    bench_field workload;
+    proxy.read_column_value(handle, (PSI_field *)&workload, WORKLOAD);
+    unsigned long long row[COLUMNS];
+    for (int i = COUNT_QUERIES; i < COLUMNS; i++) {
+      bench_field field;
+      proxy.read_column_value(handle, (PSI_field *)&field, i);
+      row[i] = field.value;
+    }
+
+    unsigned long long n = row[COUNT_QUERIES];
+    if (row[SUM_ROWS_EXAMINED] != 2 * n || row[SUM_ROWS_SENT] != n ||
+        row[SUM_LOCK_TIME_US] != 2 * n)
+      errors.fetch_add(1);
+    if (evicted != nullptr && strcmp(workload.str, "__EVICTED__") == 0)
+      *evicted = n;
+    total += n;
+  }
+  proxy.close_table(handle);
+  return total;
+}
+
+/* Returns the total of COUNT_QUERIES of the histogram table. */
+static unsigned long long scan_histogram() {
+  auto &proxy =
+      bench_table("workload_instrumentation_histogram")->m_proxy_engine_table;
+  PSI_pos *pos;
+  auto *handle = proxy.open_table(&pos);
+  proxy.rnd_init(handle, true);
+
+  unsigned long long total = 0;
+  while (proxy.rnd_next(handle) == 0) {
+    bench_field field;
+    proxy.read_column_value(handle, (PSI_field *)&field, 2);
+    total += field.value;
+  }
+  proxy.close_table(handle);
+  return total;
+}
+
+static void reader() {
+  unsigned long long scans = 0;
+  while (!writers_done.load()) {
+    scan(nullptr);
+    scan_histogram();
+    scans++;
+  }
+  printf("reader: %llu scans\n", scans);
+}
+
+int main() {
+  if (bench_init()) return 1;
+  flush_statements_value = 1;
+  max_workloads_value = STRESS_MAX_WORKLOADS;
+  evict_idle_seconds_value = 1;
+  start_ns = monotonic_clock_ns();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < STRESS_READERS; i++) threads.emplace_back(reader);
+  std::vector<std::thread> writers;
+  for (int i = 0; i < STRESS_WRITERS; i++) writers.emplace_back(writer, i);
+  for (auto &thread : writers) thread.join();
+  writers_done.store(true);
+  for (auto &thread : threads) thread.join();
+
+  unsigned long long evicted = 0;
+  unsigned long long total = scan(&evicted);
+  unsigned long long histogram_total = scan_histogram();
+  unsigned long long expected =
+      (unsigned long long)STRESS_WRITERS * STRESS_STATEMENTS;
+  bool failed = errors.load() != 0 || total != expected ||
+                histogram_total != expected || evicted == 0;
+  printf("inconsistent rows: %llu, statements: %llu, in histogram: %llu, "
+         "evicted: %llu\n",
+         errors.load(), total, histogram_total, evicted);
+
+  bench_deinit();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+/* Measures the cost of each step of the statement path, and of
+   performance_schema reads, in ns/op and allocations/op. Steps run with 1 to
+   --threads threads, for queries of several sizes and several numbers of
+   distinct workloads, so that builds can be compared numerically:
+
+     bench_hot_path [--threads N] [--statements N]
+
+   --statements is the number of operations per thread of each run. ns/op is
+   the wall time of a run divided by the operations of one thread: it stays
+   flat as threads are added as long as they do not contend. Nothing is
+   checked, bench_allocations fails on allocations. */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bench_allocation_counter.h"
+#include "bench_services.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_digest.h"
+#include "workload_instrumentation_parser.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_statement_cache.h"
+#include "workload_instrumentation_tags.h"
+#include "workload_instrumentation_thd_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+/* Query sizes, in bytes. The smallest has its workload comment first, as
+   hand written queries do, the others last, as sqlcommenter writes it. */
+static const size_t query_sizes[] = {64, 1024, 8192};
+/* Distinct workloads the statements of a run are spread over. */
+static const unsigned int workload_counts[] = {1, 64, 4096};
+
+/* Digits of the workload number in query texts and workload names. */
+#define BENCH_WORKLOAD_DIGITS 5
+
+enum class bench_step { PARSE, CACHE, DIGEST, RECORD, STATEMENT, VARIABLE };
+
+static const char *step_names[] = {"parse",  "statement cache", "digest",
+                                   "record", "statement",       "variable"};
+
+/* Query text of a thread, whose workload number is rewritten in place. */
+struct bench_query {
+  std::string text;
+  size_t digits_offset;
+
+  void set_workload(unsigned int workload) {
+    for (int i = BENCH_WORKLOAD_DIGITS - 1; i >= 0; i--) {
+      text[digits_offset + i] = '0' + workload % 10;
+      workload /= 10;
+    }
+  }
+};
+
+static bench_query make_query(size_t size) {
+  std::string comment = "/* WORKLOAD_NAME=bench_";
+  size_t digits = comment.size();
+  comment.append(BENCH_WORKLOAD_DIGITS, '0');
+  comment += " */";
+
+  bench_query query;
+  if (size <= 64) {
+    query.text = "SELECT " + comment + " * FROM users WHERE id = 1";
+    query.digits_offset = strlen("SELECT ") + digits;
+    return query;
+  }
+
+  query.text = "SELECT id, name FROM users WHERE id IN (1";
+  for (int i = 2; query.text.size() + comment.size() + 2 < size; i++)
+    query.text += ", " + std::to_string(i);
+  query.text += ") ";
+  query.digits_offset = query.text.size() + digits;
+  query.text += comment;
+  return query;
+}
+
+/* Workload names of the record step, which gets them already parsed. */
+static std::vector<std::string> workload_names;
+
+static unsigned long long next_random(unsigned long long *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+static void run_step(bench_step step, bench_query *query,
+                     unsigned int workload) {
+  query->set_workload(workload);
+  const char *text = query->text.data();
+  size_t length = query->text.size();
+
+  // Only the steps that record the statement read the clock.
+  thread_stats ts;
+  ts.rows_examined = 10;
+  ts.rows_sent = 1;
+  ts.rows_affected = 0;
+  ts.end_ns = 0;
+  ts.duration_ns = 250000;
+  ts.lock_time_ns = 1000;
+  ts.cpu_time_ns = 200000;
+
+  switch (step) {
+    case bench_step::PARSE: {
+      auto name = findWorkloadName(text, length, WORKLOAD_MAX_SCAN_LENGTH);
+      if (name.empty()) abort();
+      break;
+    }
+    case bench_step::CACHE: {
+      workload_record_hint *hint;
+      workload_tag_hint *tags;
+      if (workload_statement_cache_find(text, length, &hint, &tags).empty())
+        abort();
+      break;
+    }
+    case bench_step::DIGEST: {
+      workload_statement_digest digest;
+      compute_statement_digest(text, length, &digest);
+      break;
+    }
+    case bench_step::RECORD:
+      ts.end_ns = monotonic_clock_ns();
+      record_stats(workload_names[workload], &ts, 1);
+      break;
+    case bench_step::STATEMENT: {
+      // Same steps as the query event callback of the component.
+      ts.end_ns = monotonic_clock_ns();
+      workload_record_hint *hint;
+      workload_tag_hint *tags;
+      auto name = workload_statement_cache_find(text, length, &hint, &tags);
+      record_stats(name, &ts, 1, workload_digest_cache_find(text, length),
+                   hint);
+      record_tag_stats(tags, &ts, 1);
+      break;
+    }
+    case bench_step::VARIABLE: {
+      // A statement of a connection setting its workload with a user
+      // variable, with comments not overriding it.
+      ts.end_ns = monotonic_clock_ns();
+      workload_record_hint *hint;
+      auto name = workload_variable_cache_find(workload_names[workload], &hint);
+      record_stats(name, &ts, 1, nullptr, hint);
+      break;
+    }
+  }
+}
+
+struct bench_result {
+  double ns_per_op;
+  double allocations_per_op;
+};
+
+/* Runs statements operations of a step on each of threads threads. */
+static bench_result run(bench_step step, size_t query_size,
+                        unsigned int workloads, unsigned int threads,
+                        unsigned int statements) {
+  std::atomic<bool> go{false};
+  std::atomic<unsigned int> done{0};
+
+  std::vector<std::thread> runners;
+  for (unsigned int t = 0; t < threads; t++) {
+    runners.emplace_back([&, t] {
+      bench_query query = make_query(query_size);
+      unsigned long long random = 0x9e3779b97f4a7c15ULL * (t + 1);
+      while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+      for (unsigned int i = 0; i < statements; i++)
+        run_step(step, &query, next_random(&random) % workloads);
+
+      done.fetch_add(1, std::memory_order_release);
+      workload_thread_cache_release();
+    });
+  }
+
+  // Threads and their queries are set up before the measurement starts.
+  unsigned long long allocations = bench_allocation_count();
+  unsigned long long start_ns = monotonic_clock_ns();
+  go.store(true, std::memory_order_release);
+  while (done.load(std::memory_order_acquire) < threads)
+    std::this_thread::yield();
+  unsigned long long elapsed_ns = monotonic_clock_ns() - start_ns;
+  allocations = bench_allocation_count() - allocations;
+  for (auto &runner : runners) runner.join();
+
+  return {(double)elapsed_ns / statements,
+          (double)allocations / ((double)statements * threads)};
+}
+
+/* Reads every column of every row of the table, about statements rows in
+   all. Opening the table allocates its handle, once per scan. */
+static bench_result scan(unsigned int workloads, unsigned int statements) {
+  auto &proxy = bench_table("workload_instrumentation")->m_proxy_engine_table;
+  unsigned int columns =
+      bench_table_columns(bench_table("workload_instrumentation"));
+  unsigned int scans = std::max(1U, statements / workloads);
+
+  unsigned long long rows = 0;
+  unsigned long long allocations = bench_allocation_count();
+  unsigned long long start_ns = monotonic_clock_ns();
+  for (unsigned int i = 0; i < scans; i++) {
+    PSI_pos *pos;
+    auto *handle = proxy.open_table(&pos);
+    proxy.rnd_init(handle, true);
+    while (proxy.rnd_next(handle) == 0) {
+      for (unsigned int c = 0; c < columns; c++) {
+        bench_field field;
+        proxy.read_column_value(handle, (PSI_field *)&field, c);
+      }
+      rows++;
+    }
+    proxy.close_table(handle);
+  }
+  unsigned long long elapsed_ns = monotonic_clock_ns() - start_ns;
+  allocations = bench_allocation_count() - allocations;
+
+  return {(double)elapsed_ns / rows, (double)allocations / rows};
+}
+
+static void report(const char *step, size_t query_size, unsigned int workloads,
+                   unsigned int threads, const bench_result &result) {
+  printf("%-16s %7zu %9u %7u %10.1f %10.3f\n", step, query_size, workloads,
+         threads, result.ns_per_op, result.allocations_per_op);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  unsigned int max_threads =
+      std::max(1U, std::min(8U, std::thread::hardware_concurrency()));
+  unsigned int statements = 200000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      max_threads = std::max(1, atoi(argv[i + 1]));
+    } else if (strcmp(argv[i], "--statements") == 0) {
+      statements = std::max(1, atoi(argv[i + 1]));
+    } else {
+      fprintf(stderr, "Usage: %s [--threads N] [--statements N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Powers of two up to --threads, and --threads itself.
+  std::vector<unsigned int> thread_counts;
+  for (unsigned int threads = 1; threads < max_threads; threads *= 2)
+    thread_counts.push_back(threads);
+  thread_counts.push_back(max_threads);
+
+  printf("%-16s %7s %9s %7s %10s %10s\n", "step", "bytes", "workloads",
+         "threads", "ns/op", "allocs/op");
+  for (unsigned int workloads : workload_counts) {
+    if (bench_init()) return 1;
+
+    workload_names.clear();
+    bench_query names = make_query(64);
+    for (unsigned int w = 0; w < workloads; w++) {
+      names.set_workload(w);
+      workload_names.push_back(std::string(
+          findWorkloadName(names.text.data(), names.text.size())));
+    }
+
+    // First sight of a workload creates its record and the thread caches.
+    for (unsigned int w = 0; w < workloads; w++)
+      run_step(bench_step::RECORD, &names, w);
+    run(bench_step::STATEMENT, 64, workloads, max_threads, workloads);
+
+    for (size_t query_size : query_sizes) {
+      for (auto step : {bench_step::PARSE, bench_step::CACHE,
+                        bench_step::DIGEST, bench_step::RECORD,
+                        bench_step::STATEMENT, bench_step::VARIABLE}) {
+        for (unsigned int threads : thread_counts) {
+          report(step_names[(int)step], query_size, workloads, threads,
+                 run(step, query_size, workloads, threads, statements));
+        }
+      }
+    }
+    report("scan row", 0, workloads, 1, scan(workloads, statements));
+
+    workload_thread_cache_release();
+    bench_deinit();
+  }
+
+  return 0;
+}
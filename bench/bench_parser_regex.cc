@@ -0,0 +1,125 @@
+/* Checks findWorkloadName() and findWorkloadNameAndTags() against the
+   std::regex implementation they replaced, case by case, on hand written
+   queries and on random combinations of the tokens that matter to the
+   parser. The random inputs use a fixed seed so failures are reproducible.
+   Also checks that the prefix reported through decided_length gives the
+   same workload. */
+#include <cstdio>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workload_instrumentation_parser.h"
+
+#define RANDOM_CASES 20000
+#define RANDOM_MAX_TOKENS 12
+#define RANDOM_SEED 1234
+
+/* The original implementation, kept verbatim as the reference. */
+static std::string regexWorkloadName(const std::string &input) {
+  std::regex commentRegex(R"(/\*.*?\*/)");
+  std::regex workloadRegex(R"(WORKLOAD_NAME=([A-Za-z0-9-_:.\/\\\\]+))");
+  std::smatch match;
+  std::sregex_iterator it(input.begin(), input.end(), commentRegex);
+  std::sregex_iterator end;
+
+  while (it != end) {
+    std::string comment = it->str();
+    if (std::regex_search(comment, match, workloadRegex)) {
+      return match[1].str();
+    }
+    ++it;
+  }
+
+  return "";
+}
+
+static std::string escape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '\n')
+      out += "\\n";
+    else if (c == '\r')
+      out += "\\r";
+    else
+      out += c;
+  }
+  return out;
+}
+
+static unsigned long long mismatches = 0;
+
+static void check(const std::string &query) {
+  std::string expected = regexWorkloadName(query);
+
+  size_t decided_length = 0;
+  std::string_view name =
+      findWorkloadName(query.data(), query.size(), 0, &decided_length);
+
+  static const std::string_view keys[] = {"TEAM", "ENDPOINT"};
+  std::string_view values[2];
+  std::string_view tagged_name =
+      findWorkloadNameAndTags(query.data(), query.size(), keys, 2, values);
+
+  std::string decided;
+  if (!name.empty())
+    decided = regexWorkloadName(query.substr(0, decided_length));
+
+  if (name != expected || tagged_name != expected ||
+      (!name.empty() && decided != expected)) {
+    if (mismatches++ < 20)
+      printf("mismatch for \"%s\": regex \"%s\", findWorkloadName \"%s\", "
+             "findWorkloadNameAndTags \"%s\", decided prefix \"%s\"\n",
+             escape(query).c_str(), escape(expected).c_str(),
+             escape(std::string(name)).c_str(),
+             escape(std::string(tagged_name)).c_str(),
+             escape(decided).c_str());
+  }
+}
+
+int main() {
+  std::vector<std::string> cases = {
+      "/* WORKLOAD_NAME=simple */",
+      "/*WORKLOAD_NAME=no_spaces*/",
+      "/* WORKLOAD_NAME=with:all.the-chars_/\\9 */",
+      "/* WORKLOAD_NAME= */ /* WORKLOAD_NAME=second_comment */",
+      "/* WORKLOAD_NAME=! WORKLOAD_NAME=second_key */",
+      "/* other comment */ /* WORKLOAD_NAME=after_other */",
+      "/* WORKLOAD_NAME=multi\n line */ /* WORKLOAD_NAME=after_newline */",
+      "/* WORKLOAD_NAME=cr\r */",
+      "/* WORKLOAD_NAME=unclosed",
+      "WORKLOAD_NAME=outside_comment",
+      "/*/ WORKLOAD_NAME=slash_star_slash */",
+      "/**/ WORKLOAD_NAME=after_empty /* x */",
+      "/* /* WORKLOAD_NAME=nested */ */",
+      "/*+ WORKLOAD_NAME=hint_style */",
+      "/*! WORKLOAD_NAME=versioned */",
+      "/* a \n /* WORKLOAD_NAME=reopened */",
+      "/* WORKLOAD_NAME=stops*here */",
+      "/* WORKLOAD_NAME=ends_at_close*/",
+      "/* workload_name=lowercase */",
+      "x/y/z /* WORKLOAD_NAME=after_slashes */",
+      "/* TEAM=search,WORKLOAD_NAME=tagged */ SELECT 1",
+      "SELECT 1 /* WORKLOAD_NAME=at_the_end */",
+  };
+  for (const std::string &query : cases) check(query);
+
+  static const char *tokens[] = {
+      "/*", "*/", "*", "/", "\n", "\r", "WORKLOAD_NAME=", "WORKLOAD_NAME",
+      "=", "fz", "Q9", "-", "_", ":", ".", "\\", " ", "#", "TEAM=", "'"};
+  std::mt19937 rnd(RANDOM_SEED);
+  std::uniform_int_distribution<size_t> token(
+      0, sizeof(tokens) / sizeof(tokens[0]) - 1);
+  std::uniform_int_distribution<int> token_count(1, RANDOM_MAX_TOKENS);
+  for (int i = 0; i < RANDOM_CASES; i++) {
+    std::string query;
+    for (int n = token_count(rnd); n > 0; n--) query += tokens[token(rnd)];
+    check(query);
+  }
+
+  printf("cases: %zu, mismatches: %llu\n", cases.size() + RANDOM_CASES,
+         mismatches);
+  return mismatches != 0 ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+#include "bench_services.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <mysql/components/services/component_sys_var_service.h>
+#include <mysql/components/services/log_builtins.h>
+#include <mysql/components/services/mysql_mutex.h>
+#include <mysql/components/services/mysql_rwlock.h>
+#include <mysql/components/services/psi_memory.h>
+
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sysvars.h"
+
+#define BENCH_MAX_TABLES 16
+
+void LogComponentErr(int, int, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+void mysql_rwlock_register(const char *, PSI_rwlock_info *, int) {}
+int mysql_rwlock_init(PSI_rwlock_key, mysql_rwlock_t *lock) {
+  return pthread_rwlock_init(&lock->m_rwlock, nullptr);
+}
+int mysql_rwlock_destroy(mysql_rwlock_t *lock) {
+  return pthread_rwlock_destroy(&lock->m_rwlock);
+}
+int mysql_rwlock_rdlock(mysql_rwlock_t *lock) {
+  return pthread_rwlock_rdlock(&lock->m_rwlock);
+}
+int mysql_rwlock_wrlock(mysql_rwlock_t *lock) {
+  return pthread_rwlock_wrlock(&lock->m_rwlock);
+}
+int mysql_rwlock_unlock(mysql_rwlock_t *lock) {
+  return pthread_rwlock_unlock(&lock->m_rwlock);
+}
+
+void mysql_mutex_register(const char *, PSI_mutex_info *, int) {}
+int mysql_mutex_init(PSI_mutex_key, mysql_mutex_t *mutex, const void *) {
+  return pthread_mutex_init(&mutex->m_mutex, nullptr);
+}
+int mysql_mutex_destroy(mysql_mutex_t *mutex) {
+  return pthread_mutex_destroy(&mutex->m_mutex);
+}
+int mysql_mutex_lock(mysql_mutex_t *mutex) {
+  return pthread_mutex_lock(&mutex->m_mutex);
+}
+int mysql_mutex_unlock(mysql_mutex_t *mutex) {
+  return pthread_mutex_unlock(&mutex->m_mutex);
+}
+
+/* The benchmarks set variables without a session. */
+
+unsigned long long get_thd_query_id(THD *) { return 0; }
+
+/* Memory is allocated but not accounted. */
+
+static void register_memory(const char *, PSI_memory_info *, int) {}
+static PSI_memory_key memory_alloc(PSI_memory_key key, size_t, PSI_thread **) {
+  return key;
+}
+static void memory_free(PSI_memory_key, size_t, PSI_thread *) {}
+
+static mysql_service_psi_memory_v2_t memory_service = {
+    register_memory, memory_alloc, memory_free};
+mysql_service_psi_memory_v2_t *mysql_service_psi_memory_v2 = &memory_service;
+
+/* performance_schema tables */
+
+static PFS_engine_table_share_proxy *tables[BENCH_MAX_TABLES];
+
+static int add_tables(PFS_engine_table_share_proxy **list,
+                      unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    auto slot = std::find(tables, tables + BENCH_MAX_TABLES, nullptr);
+    if (slot == tables + BENCH_MAX_TABLES) return 1;
+    *slot = list[i];
+  }
+  return 0;
+}
+
+static int delete_tables(PFS_engine_table_share_proxy **list,
+                         unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    std::replace(tables, tables + BENCH_MAX_TABLES, list[i],
+                 (PFS_engine_table_share_proxy *)nullptr);
+  }
+  return 0;
+}
+
+PFS_engine_table_share_proxy *bench_table(const char *name) {
+  for (auto *table : tables) {
+    if (table != nullptr && strcmp(table->m_table_name, name) == 0) {
+      return table;
+    }
+  }
+  return nullptr;
+}
+
+unsigned int bench_table_columns(const PFS_engine_table_share_proxy *table) {
+  unsigned int columns = 0;
+  int depth = 0;
+  bool at_item_start = true;
+  for (const char *c = table->m_table_definition; *c != '\0'; c++) {
+    if (at_item_start && *c != ' ') {
+      if (strncmp(c, "PRIMARY KEY", 11) == 0 || strncmp(c, "KEY", 3) == 0 ||
+          strncmp(c, "UNIQUE KEY", 10) == 0) {
+        break;
+      }
+      columns++;
+      at_item_start = false;
+    }
+    if (*c == '(') depth++;
+    if (*c == ')') depth--;
+    if (*c == ',' && depth == 0) at_item_start = true;
+  }
+  return columns;
+}
+
+static void set_unsigned(PSI_field *f, PSI_ulonglong value) {
+  auto field = (bench_field *)f;
+  field->value = value.val;
+  field->is_null = value.is_null;
+}
+
+static void set_varchar_len(PSI_field *f, const char *str, unsigned int len) {
+  auto field = (bench_field *)f;
+  field->length = std::min<unsigned int>(len, sizeof(field->str) - 1);
+  memcpy(field->str, str, field->length);
+  field->str[field->length] = '\0';
+  field->is_null = false;
+}
+
+static void set_varchar(PSI_field *f, const char *str) {
+  set_varchar_len(f, str, strlen(str));
+}
+
+static void read_key_string(PSI_key_reader *reader, PSI_plugin_key_string *key,
+                            int find_flag) {
+  auto field = (bench_field *)reader;
+  key->m_is_null = false;
+  key->m_find_flags = find_flag;
+  key->m_value_buffer_length =
+      std::min(field->length, key->m_value_buffer_capacity);
+  memcpy(key->m_value_buffer, field->str, key->m_value_buffer_length);
+}
+
+/* Only key lookups are compared, any other read matches every row. */
+static bool match_key_string(bool record_null, const char *record_string,
+                             unsigned int record_string_length,
+                             PSI_plugin_key_string *key) {
+  if (key->m_find_flags != 0) return true;
+  return !record_null && record_string_length == key->m_value_buffer_length &&
+         memcmp(record_string, key->m_value_buffer, record_string_length) == 0;
+}
+
+static mysql_service_pfs_plugin_table_v1_t table_service = {add_tables,
+                                                            delete_tables};
+static mysql_service_pfs_plugin_column_bigint_v1_t bigint_service = {
+    nullptr, set_unsigned, nullptr, nullptr,
+    nullptr, nullptr,      nullptr, nullptr};
+static mysql_service_pfs_plugin_column_string_v2_t string_service = {
+    nullptr,     nullptr,         set_varchar_len, set_varchar,
+    nullptr,     read_key_string, match_key_string};
+
+mysql_service_pfs_plugin_table_v1_t *mysql_service_pfs_plugin_table_v1 =
+    &table_service;
+mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint = &bigint_service;
+mysql_service_pfs_plugin_column_string_v2_t *pfs_string = &string_service;
+
+/* System variables keep their defaults. */
+
+static bool register_variable(const char *, const char *, int flags,
+                              const char *, mysql_sys_var_check_func,
+                              mysql_sys_var_update_func, void *check_arg,
+                              void *variable_value) {
+  if ((flags & PLUGIN_VAR_TYPEMASK) == PLUGIN_VAR_STR)
+    *(char **)variable_value = *(char **)check_arg;
+  else
+    *(unsigned int *)variable_value = *(unsigned int *)check_arg;
+  return false;
+}
+
+static bool unregister_variable(const char *, const char *) { return false; }
+
+static mysql_service_component_sys_variable_register_t register_service = {
+    register_variable, nullptr};
+static mysql_service_component_sys_variable_unregister_t unregister_service =
+    {unregister_variable};
+
+mysql_service_component_sys_variable_register_t
+    *mysql_service_component_sys_variable_register = &register_service;
+mysql_service_component_sys_variable_unregister_t
+    *mysql_service_component_sys_variable_unregister = &unregister_service;
+
+int bench_init(const char *tags) {
+  if (register_sysvars()) return 1;
+  tags_value = const_cast<char *>(tags);
+  if (workload_instrumentation_pfs_init()) {
+    unregister_sysvars();
+    return 1;
+  }
+  return 0;
+}
+
+void bench_deinit() {
+  workload_instrumentation_pfs_deinit();
+  unregister_sysvars();
+}
@@ -0,0 +1,29 @@
+/* Stub implementations of the MySQL services the component requires, so the
+   hot path can be built and measured without a server. */
+#ifndef WORKLOAD_INSTRUMENTATION_BENCH_SERVICES_H
+#define WORKLOAD_INSTRUMENTATION_BENCH_SERVICES_H
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+/* PSI_field handed to read_column_value, it captures whatever the table
+   writes into it. Also used as the PSI_key_reader of index reads, holding the
+   key value in str. */
+struct bench_field {
+  char str[256];
+  unsigned int length;
+  unsigned long long value;
+  bool is_null;
+};
+
+/* Registers the system variables and the performance_schema tables, with
+   workload_instrumentation.tags set to tags. */
+int bench_init(const char *tags = "");
+void bench_deinit();
+
+/* Returns a table registered through pfs_plugin_table_v1, or nullptr. */
+PFS_engine_table_share_proxy *bench_table(const char *name);
+
+/* Number of columns in the table definition, index clauses excluded. */
+unsigned int bench_table_columns(const PFS_engine_table_share_proxy *table);
+
+#endif /* WORKLOAD_INSTRUMENTATION_BENCH_SERVICES_H */
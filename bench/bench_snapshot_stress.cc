@@ -0,0 +1,122 @@
+/* Runs statements and performance_schema reads concurrently and checks that
+   every row read is consistent: each statement adds the same amounts to all
+   counters, so they must stay proportional to COUNT_QUERIES. Meant to be run
+   under ThreadSanitizer too (-DWORKLOAD_BENCH_SANITIZER=thread). */
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_services.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_thd_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#define STRESS_WRITERS 8
+#define STRESS_READERS 2
+#define STRESS_STATEMENTS 200000
+#define STRESS_WORKLOADS 50
+
+enum column {
+  WORKLOAD = 0,
+  COUNT_QUERIES = 1,
+  SUM_ROWS_EXAMINED = 2,
+  SUM_ROWS_SENT = 3,
+  SUM_ROWS_AFFECTED = 4,
+  SUM_DURATION_US = 5,
+  SUM_LOCK_TIME_US = 9,
+  SUM_CPU_TIME_US = 10,
+  SUM_ERRORS = 18,
+  SUM_TIMEOUTS = 20,
+  COLUMNS = 21
+};
+
+static std::atomic<bool> writers_done{false};
+static std::atomic<unsigned long long> errors{0};
+
+static void writer(int id) {
+  char workload[32];
+  for (int i = 0; i < STRESS_STATEMENTS; i++) {
+    thread_stats ts;
+    ts.rows_examined = 2;
+    ts.rows_sent = 1;
+    ts.rows_affected = 3;
+    ts.end_ns = monotonic_clock_ns();
+    ts.duration_ns = 1000;
+    ts.lock_time_ns = 2000;
+    ts.cpu_time_ns = 3000;
+    // Resource counters are on other cache lines, under the same seqlock.
+    ts.resources[WORKLOAD_RESOURCE_ERRORS] = 1;
+    ts.resources[WORKLOAD_RESOURCE_TIMEOUTS] = 4;
+
+    // Every writer shares the workloads, new ones keep appearing meanwhile.
+    snprintf(workload, sizeof(workload), "stress_%d",
+             (i + id) % STRESS_WORKLOADS);
+    record_stats(workload, &ts, 1);
+  }
+  workload_thread_cache_release();
+}
+
+static bool check_row(const unsigned long long *row) {
+  unsigned long long n = row[COUNT_QUERIES];
+  return row[SUM_ROWS_EXAMINED] == 2 * n && row[SUM_ROWS_SENT] == n &&
+         row[SUM_ROWS_AFFECTED] == 3 * n && row[SUM_DURATION_US] == n &&
+         row[SUM_LOCK_TIME_US] == 2 * n && row[SUM_CPU_TIME_US] == 3 * n &&
+         row[SUM_ERRORS] == n && row[SUM_TIMEOUTS] == 4 * n;
+}
+
+/* Scans the table, checking rows and returning the total of COUNT_QUERIES. */
+static unsigned long long scan() {
+  auto &proxy = bench_table("workload_instrumentation")->m_proxy_engine_table;
+  PSI_pos *pos;
+  auto *handle = proxy.open_table(&pos);
+  proxy.rnd_init(handle, true);
+
+  unsigned long long total = 0;
+  while (proxy.rnd_next(handle) == 0) {
+    unsigned long long row[COLUMNS];
+    for (int i = COUNT_QUERIES; i < COLUMNS; i++) {
+      bench_field field;
+      proxy.read_column_value(handle, (PSI_field *)&field, i);
+      row[i] = field.value;
+    }
+    if (!check_row(row)) errors.fetch_add(1);
+    total += row[COUNT_QUERIES];
+  }
+  proxy.close_table(handle);
+  return total;
+}
+
+static void reader() {
+  unsigned long long scans = 0;
+  while (!writers_done.load()) {
+    scan();
+    scans++;
+  }
+  printf("reader: %llu scans\n", scans);
+}
+
+int main() {
+  if (bench_init()) return 1;
+  // Flush on every statement, so readers race with as many updates as possible.
+  flush_statements_value = 1;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < STRESS_READERS; i++) threads.emplace_back(reader);
+  std::vector<std::thread> writers;
+  for (int i = 0; i < STRESS_WRITERS; i++) writers.emplace_back(writer, i);
+  for (auto &thread : writers) thread.join();
+  writers_done.store(true);
+  for (auto &thread : threads) thread.join();
+
+  unsigned long long total = scan();
+  bool failed = errors.load() != 0 ||
+                total != (unsigned long long)STRESS_WRITERS * STRESS_STATEMENTS;
+  printf("inconsistent rows: %llu, statements: %llu\n", errors.load(), total);
+
+  bench_deinit();
+  return failed ? 1 : 0;
+}
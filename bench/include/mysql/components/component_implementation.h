@@ -0,0 +1,29 @@
+/* Minimal stand-in for the component framework macros used by the sources
+   linked into the benchmarks. Services are plain structs of function pointers
+   and placeholders are plain pointers filled in by bench_services.cc. */
+#ifndef BENCH_COMPONENT_IMPLEMENTATION_H
+#define BENCH_COMPONENT_IMPLEMENTATION_H
+
+#include <cassert>
+#include <cstddef>
+
+#define SERVICE_TYPE(name) mysql_service_##name##_t
+#define SERVICE_TYPE_NO_CONST(name) mysql_service_##name##_t
+
+#define BEGIN_SERVICE_DEFINITION(name) struct mysql_service_##name##_t {
+#define END_SERVICE_DEFINITION(name) \
+  }                                  \
+  ;
+
+#define DECLARE_METHOD(retval, name, args) retval(*name) args
+#define DECLARE_BOOL_METHOD(name, args) bool(*name) args
+
+#define REQUIRES_SERVICE_PLACEHOLDER(name) \
+  SERVICE_TYPE(name) * mysql_service_##name
+#define REQUIRES_SERVICE_PLACEHOLDER_AS(service, name) \
+  SERVICE_TYPE(service) * name
+
+class THD;
+typedef THD *MYSQL_THD;
+
+#endif /* BENCH_COMPONENT_IMPLEMENTATION_H */
@@ -0,0 +1,10 @@
+#ifndef BENCH_MYSQL_RWLOCK_BITS_H
+#define BENCH_MYSQL_RWLOCK_BITS_H
+
+#include <pthread.h>
+
+struct mysql_rwlock_t {
+  pthread_rwlock_t m_rwlock;
+};
+
+#endif /* BENCH_MYSQL_RWLOCK_BITS_H */
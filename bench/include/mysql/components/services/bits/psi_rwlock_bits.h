@@ -0,0 +1,14 @@
+#ifndef BENCH_PSI_RWLOCK_BITS_H
+#define BENCH_PSI_RWLOCK_BITS_H
+
+typedef unsigned int PSI_rwlock_key;
+
+struct PSI_rwlock_info {
+  PSI_rwlock_key *m_key;
+  const char *m_name;
+  unsigned int m_flags;
+  int m_volatility;
+  const char *m_documentation;
+};
+
+#endif /* BENCH_PSI_RWLOCK_BITS_H */
@@ -0,0 +1,62 @@
+/* Only the pieces of the system variable services the component uses. */
+#ifndef BENCH_COMPONENT_SYS_VAR_SERVICE_H
+#define BENCH_COMPONENT_SYS_VAR_SERVICE_H
+
+#include <mysql/components/component_implementation.h>
+
+struct SYS_VAR;
+struct st_mysql_value;
+
+#define PLUGIN_VAR_BOOL 0x0001
+#define PLUGIN_VAR_INT 0x0002
+#define PLUGIN_VAR_LONG 0x0003
+#define PLUGIN_VAR_LONGLONG 0x0004
+#define PLUGIN_VAR_STR 0x0005
+#define PLUGIN_VAR_TYPEMASK 0x007f
+#define PLUGIN_VAR_UNSIGNED 0x0080
+#define PLUGIN_VAR_READONLY 0x0200
+#define PLUGIN_VAR_RQCMDARG 0x0000
+#define PLUGIN_VAR_MEMALLOC 0x8000
+
+typedef unsigned int uint;
+typedef unsigned long ulong;
+typedef unsigned long long ulonglong;
+
+#define INTEGRAL_CHECK_ARG(type) \
+  struct {                       \
+    type def_val;                \
+    type min_val;                \
+    type max_val;                \
+    type blk_sz;                 \
+  }
+#define BOOL_CHECK_ARG(type) \
+  struct {                   \
+    bool def_val;            \
+  }
+#define STR_CHECK_ARG(type) \
+  struct {                  \
+    char *def_val;          \
+  }
+
+typedef int (*mysql_sys_var_check_func)(MYSQL_THD thd, SYS_VAR *var,
+                                        void *save, st_mysql_value *value);
+typedef void (*mysql_sys_var_update_func)(MYSQL_THD thd, SYS_VAR *var,
+                                          void *var_ptr, const void *save);
+
+BEGIN_SERVICE_DEFINITION(component_sys_variable_register)
+DECLARE_BOOL_METHOD(register_variable,
+                    (const char *component_name, const char *name, int flags,
+                     const char *comment, mysql_sys_var_check_func check,
+                     mysql_sys_var_update_func update, void *check_arg,
+                     void *variable_value));
+DECLARE_BOOL_METHOD(get_variable, (const char *component_name,
+                                   const char *name, void **val,
+                                   size_t *out_length_of_val));
+END_SERVICE_DEFINITION(component_sys_variable_register)
+
+BEGIN_SERVICE_DEFINITION(component_sys_variable_unregister)
+DECLARE_BOOL_METHOD(unregister_variable,
+                    (const char *component_name, const char *name));
+END_SERVICE_DEFINITION(component_sys_variable_unregister)
+
+#endif /* BENCH_COMPONENT_SYS_VAR_SERVICE_H */
@@ -0,0 +1,12 @@
+/* The server routes LogComponentErr through the log_builtins service, the
+   benchmarks print to stderr instead. */
+#ifndef BENCH_LOG_BUILTINS_H
+#define BENCH_LOG_BUILTINS_H
+
+#include <mysql/components/component_implementation.h>
+
+enum loglevel { SYSTEM_LEVEL, ERROR_LEVEL, WARNING_LEVEL, INFORMATION_LEVEL };
+
+void LogComponentErr(int level, int errcode, const char *format, ...);
+
+#endif /* BENCH_LOG_BUILTINS_H */
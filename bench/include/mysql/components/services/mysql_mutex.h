@@ -0,0 +1,32 @@
+/* The server exposes these through the mysql_mutex service, here they are
+   thin wrappers around pthread mutexes. */
+#ifndef BENCH_MYSQL_MUTEX_H
+#define BENCH_MYSQL_MUTEX_H
+
+#include <pthread.h>
+
+#include <mysql/components/component_implementation.h>
+
+typedef unsigned int PSI_mutex_key;
+
+struct PSI_mutex_info {
+  PSI_mutex_key *m_key;
+  const char *m_name;
+  unsigned int m_flags;
+  int m_volatility;
+  const char *m_documentation;
+};
+
+struct mysql_mutex_t {
+  pthread_mutex_t m_mutex;
+};
+
+void mysql_mutex_register(const char *category, PSI_mutex_info *info,
+                          int count);
+int mysql_mutex_init(PSI_mutex_key key, mysql_mutex_t *mutex,
+                     const void *attr);
+int mysql_mutex_destroy(mysql_mutex_t *mutex);
+int mysql_mutex_lock(mysql_mutex_t *mutex);
+int mysql_mutex_unlock(mysql_mutex_t *mutex);
+
+#endif /* BENCH_MYSQL_MUTEX_H */
@@ -0,0 +1,18 @@
+/* The server exposes these through the mysql_rwlock service, here they are
+   thin wrappers around pthread rwlocks. */
+#ifndef BENCH_MYSQL_RWLOCK_H
+#define BENCH_MYSQL_RWLOCK_H
+
+#include <mysql/components/component_implementation.h>
+#include <mysql/components/services/bits/mysql_rwlock_bits.h>
+#include <mysql/components/services/bits/psi_rwlock_bits.h>
+
+void mysql_rwlock_register(const char *category, PSI_rwlock_info *info,
+                           int count);
+int mysql_rwlock_init(PSI_rwlock_key key, mysql_rwlock_t *lock);
+int mysql_rwlock_destroy(mysql_rwlock_t *lock);
+int mysql_rwlock_rdlock(mysql_rwlock_t *lock);
+int mysql_rwlock_wrlock(mysql_rwlock_t *lock);
+int mysql_rwlock_unlock(mysql_rwlock_t *lock);
+
+#endif /* BENCH_MYSQL_RWLOCK_H */
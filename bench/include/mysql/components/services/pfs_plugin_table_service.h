@@ -0,0 +1,158 @@
+/* Layout compatible subset of the performance_schema plugin table services.
+   Method order matches the server headers so the component initializes the
+   proxies the same way in both builds. */
+#ifndef BENCH_PFS_PLUGIN_TABLE_SERVICE_H
+#define BENCH_PFS_PLUGIN_TABLE_SERVICE_H
+
+#include <mysql/components/component_implementation.h>
+
+#define PFS_HA_ERR_WRONG_COMMAND 131
+#define PFS_HA_ERR_RECORD_DELETED 134
+#define PFS_HA_ERR_END_OF_FILE 137
+#define PFS_HA_ERR_FOUND_DUPP_KEY 121
+#define PFS_HA_ERR_RECORD_FILE_FULL 135
+
+struct PSI_field;
+struct PSI_table_handle;
+struct PSI_pos;
+struct PSI_index_handle;
+struct PSI_key_reader;
+
+enum Access_control { READONLY = 0, TRUNCATABLE, UPDATABLE, EDITABLE };
+
+struct PSI_ulonglong {
+  unsigned long long val;
+  bool is_null;
+};
+
+struct PSI_longlong {
+  long long val;
+  bool is_null;
+};
+
+struct PSI_double {
+  double val;
+  bool is_null;
+};
+
+struct PSI_plugin_key {
+  const char *m_name;
+  int m_find_flags;
+  bool m_is_null;
+};
+
+struct PSI_plugin_key_string {
+  const char *m_name;
+  int m_find_flags;
+  bool m_is_null;
+  char *m_value_buffer;
+  unsigned int m_value_buffer_length;
+  unsigned int m_value_buffer_capacity;
+};
+
+struct PSI_plugin_key_ubigint {
+  const char *m_name;
+  int m_find_flags;
+  bool m_is_null;
+  unsigned long long m_value;
+};
+
+typedef int (*rnd_next_t)(PSI_table_handle *handle);
+typedef int (*rnd_init_t)(PSI_table_handle *handle, bool scan);
+typedef int (*rnd_pos_t)(PSI_table_handle *handle);
+typedef int (*index_init_t)(PSI_table_handle *handle, unsigned int idx,
+                            bool sorted, PSI_index_handle **index);
+typedef int (*index_read_t)(PSI_index_handle *index, PSI_key_reader *reader,
+                            unsigned int idx, int find_flag);
+typedef int (*index_next_t)(PSI_table_handle *handle);
+typedef void (*reset_position_t)(PSI_table_handle *handle);
+typedef int (*read_column_value_t)(PSI_table_handle *handle, PSI_field *field,
+                                   unsigned int index);
+typedef int (*write_column_value_t)(PSI_table_handle *handle,
+                                    PSI_field *field, unsigned int index);
+typedef int (*write_row_values_t)(PSI_table_handle *handle);
+typedef int (*update_column_value_t)(PSI_table_handle *handle,
+                                     PSI_field *field, unsigned int index);
+typedef int (*update_row_values_t)(PSI_table_handle *handle);
+typedef int (*delete_row_values_t)(PSI_table_handle *handle);
+typedef PSI_table_handle *(*open_table_t)(PSI_pos **pos);
+typedef void (*close_table_t)(PSI_table_handle *handle);
+typedef int (*delete_all_rows_t)(void);
+typedef unsigned long long (*get_row_count_t)(void);
+
+struct PFS_engine_table_proxy {
+  rnd_next_t rnd_next;
+  rnd_init_t rnd_init;
+  rnd_pos_t rnd_pos;
+  index_init_t index_init;
+  index_read_t index_read;
+  index_next_t index_next;
+  read_column_value_t read_column_value;
+  reset_position_t reset_position;
+  write_column_value_t write_column_value;
+  write_row_values_t write_row_values;
+  update_column_value_t update_column_value;
+  update_row_values_t update_row_values;
+  delete_row_values_t delete_row_values;
+  open_table_t open_table;
+  close_table_t close_table;
+};
+
+struct PFS_engine_table_share_proxy {
+  const char *m_table_name;
+  unsigned int m_table_name_length;
+  const char *m_table_definition;
+  unsigned int m_ref_length;
+  Access_control m_acl;
+  delete_all_rows_t delete_all_rows;
+  get_row_count_t get_row_count;
+  PFS_engine_table_proxy m_proxy_engine_table;
+};
+
+BEGIN_SERVICE_DEFINITION(pfs_plugin_table_v1)
+DECLARE_METHOD(int, add_tables,
+               (PFS_engine_table_share_proxy * *st_share_list,
+                unsigned int share_list_count));
+DECLARE_METHOD(int, delete_tables,
+               (PFS_engine_table_share_proxy * *st_share_list,
+                unsigned int share_list_count));
+END_SERVICE_DEFINITION(pfs_plugin_table_v1)
+
+BEGIN_SERVICE_DEFINITION(pfs_plugin_column_bigint_v1)
+DECLARE_METHOD(void, set, (PSI_field * f, PSI_longlong value));
+DECLARE_METHOD(void, set_unsigned, (PSI_field * f, PSI_ulonglong value));
+DECLARE_METHOD(void, get, (PSI_field * f, PSI_longlong *value));
+DECLARE_METHOD(void, get_unsigned, (PSI_field * f, PSI_ulonglong *value));
+DECLARE_METHOD(void, read_key,
+               (PSI_key_reader * reader, PSI_plugin_key *key, int find_flag));
+DECLARE_METHOD(void, read_key_unsigned,
+               (PSI_key_reader * reader, PSI_plugin_key_ubigint *key,
+                int find_flag));
+DECLARE_METHOD(bool, match_key,
+               (bool record_null, long long record_value,
+                PSI_plugin_key *key));
+DECLARE_METHOD(bool, match_key_unsigned,
+               (bool record_null, unsigned long long record_value,
+                PSI_plugin_key_ubigint *key));
+END_SERVICE_DEFINITION(pfs_plugin_column_bigint_v1)
+
+BEGIN_SERVICE_DEFINITION(pfs_plugin_column_string_v2)
+DECLARE_METHOD(void, set_char_utf8mb4,
+               (PSI_field * f, const char *str, unsigned int len));
+DECLARE_METHOD(void, get_char_utf8mb4,
+               (PSI_field * f, char *str, unsigned int *len));
+DECLARE_METHOD(void, set_varchar_utf8mb4_len,
+               (PSI_field * f, const char *str, unsigned int len));
+DECLARE_METHOD(void, set_varchar_utf8mb4, (PSI_field * f, const char *str));
+DECLARE_METHOD(void, get_varchar_utf8mb4,
+               (PSI_field * f, char *str, unsigned int *len));
+DECLARE_METHOD(void, read_key_string,
+               (PSI_key_reader * reader, PSI_plugin_key_string *key,
+                int find_flag));
+DECLARE_METHOD(bool, match_key_string,
+               (bool record_null, const char *record_string,
+                unsigned int record_string_length,
+                PSI_plugin_key_string *key));
+END_SERVICE_DEFINITION(pfs_plugin_column_string_v2)
+
+#endif /* BENCH_PFS_PLUGIN_TABLE_SERVICE_H */
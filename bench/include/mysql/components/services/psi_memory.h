@@ -0,0 +1,42 @@
+/* The server exposes these through the psi_memory_v2 service, here the
+   service only hands out keys and accounts nothing. */
+#ifndef BENCH_PSI_MEMORY_H
+#define BENCH_PSI_MEMORY_H
+
+#include <cstddef>
+
+#include <mysql/components/component_implementation.h>
+
+#define PSI_FLAG_ONLY_GLOBAL_STAT (1 << 6)
+
+typedef unsigned int PSI_memory_key;
+struct PSI_thread;
+
+struct PSI_memory_info {
+  PSI_memory_key *m_key;
+  const char *m_name;
+  unsigned int m_flags;
+  int m_volatility;
+  const char *m_documentation;
+};
+
+BEGIN_SERVICE_DEFINITION(psi_memory_v2)
+DECLARE_METHOD(void, register_memory,
+               (const char *category, PSI_memory_info *info, int count));
+DECLARE_METHOD(PSI_memory_key, memory_alloc,
+               (PSI_memory_key key, size_t size, PSI_thread **owner));
+DECLARE_METHOD(void, memory_free,
+               (PSI_memory_key key, size_t size, PSI_thread *owner));
+END_SERVICE_DEFINITION(psi_memory_v2)
+
+extern REQUIRES_SERVICE_PLACEHOLDER(psi_memory_v2);
+
+#define REQUIRES_PSI_MEMORY_SERVICE_PLACEHOLDER \
+  REQUIRES_SERVICE_PLACEHOLDER(psi_memory_v2)
+#define REQUIRES_PSI_MEMORY_SERVICE REQUIRES_SERVICE(psi_memory_v2)
+
+#define PSI_MEMORY_CALL(M) mysql_service_psi_memory_v2->M
+#define mysql_memory_register(category, info, count) \
+  PSI_MEMORY_CALL(register_memory)(category, info, count)
+
+#endif /* BENCH_PSI_MEMORY_H */
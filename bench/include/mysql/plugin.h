@@ -0,0 +1,13 @@
+/* Only the pieces of the plugin API the component uses. */
+#ifndef BENCH_PLUGIN_H
+#define BENCH_PLUGIN_H
+
+struct st_mysql_value {
+  int (*value_type)(struct st_mysql_value *);
+  const char *(*val_str)(struct st_mysql_value *, char *buffer, int *length);
+  int (*val_real)(struct st_mysql_value *, double *realbuf);
+  int (*val_int)(struct st_mysql_value *, long long *intbuf);
+  int (*is_unsigned)(struct st_mysql_value *);
+};
+
+#endif /* BENCH_PLUGIN_H */
@@ -0,0 +1,7 @@
+/* Stand-in for the server's generated error codes. */
+#ifndef BENCH_MYSQLD_ERROR_H
+#define BENCH_MYSQLD_ERROR_H
+
+#define ER_LOG_PRINTF_MSG 1
+
+#endif /* BENCH_MYSQLD_ERROR_H */
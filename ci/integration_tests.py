@@ -1,6 +1,25 @@
+import collections
+import os
+import random
+import re
+import threading
+import time
 import unittest
 import mysql.connector
 
+# Reference implementation of the workload name parsing, equivalent to the std::regex based one the component used to
+# have (in ECMAScript regexes `.` does not match line terminators).
+COMMENT_REGEX = re.compile(r"/\*[^\n\r]*?\*/")
+WORKLOAD_REGEX = re.compile(r"WORKLOAD_NAME=([A-Za-z0-9\-_:./\\]+)")
+
+
+def expected_workload(query):
+    for comment in COMMENT_REGEX.finditer(query):
+        match = WORKLOAD_REGEX.search(comment.group(0))
+        if match:
+            return match.group(1)
+    return "__UNSPECIFIED__"
+
 
 class IntegrationTest(unittest.TestCase):
 
@@ -46,7 +65,9 @@ class IntegrationTest(unittest.TestCase):
             cursor.close()
 
         cursor = self.cnx.cursor()
-        cursor.execute("SELECT * FROM performance_schema.workload_instrumentation WHERE WORKLOAD='api_endpoint_1'")
+        cursor.execute("SELECT WORKLOAD, COUNT_QUERIES, SUM_ROWS_EXAMINED, SUM_ROWS_SENT, SUM_ROWS_AFFECTED, "
+                       "SUM_DURATION_US FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='api_endpoint_1'")
 
         rows = 0
 
@@ -69,7 +90,9 @@ class IntegrationTest(unittest.TestCase):
         cursor.close()
 
         cursor = self.cnx.cursor()
-        cursor.execute("SELECT * FROM performance_schema.workload_instrumentation WHERE WORKLOAD='batch_job_1'")
+        cursor.execute("SELECT WORKLOAD, COUNT_QUERIES, SUM_ROWS_EXAMINED, SUM_ROWS_SENT, SUM_ROWS_AFFECTED, "
+                       "SUM_DURATION_US FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='batch_job_1'")
 
         rows = 0
 
@@ -103,8 +126,8 @@ class IntegrationTest(unittest.TestCase):
         cursor.execute("SELECT count(*) FROM performance_schema.workload_instrumentation")
         for row in cursor:
             for cnt in row:
-                # 5000 real workloads + __UNSPECIFIED__ and __OVERFLOW__
-                self.assertEqual(5002, cnt)
+                # 5000 real workloads + __UNSPECIFIED__, __OVERFLOW__ and __EVICTED__
+                self.assertEqual(5003, cnt)
 
         cursor.execute("SELECT COUNT_QUERIES FROM performance_schema.workload_instrumentation WHERE WORKLOAD='__OVERFLOW__'")
         for row in cursor:
@@ -124,9 +147,766 @@ class IntegrationTest(unittest.TestCase):
         cursor.execute("SELECT /* WORKLOAD_NAME=foo */ COUNT_QUERIES FROM performance_schema.workload_instrumentation WHERE WORKLOAD='__UNSPECIFIED__';")
         for row in cursor:
             for cnt in row:
-                # We ran 10 queries without specifying the workload so this should be 10 BUT it's actually 11 because
-                # component installation is also counting for one of them
-                self.assertEqual(11, cnt)
+                # We ran 10 queries without specifying the workload, the component installation and this read of
+                # its own table are not counted
+                self.assertEqual(10, cnt)
+
+    def workload_counts(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT /* WORKLOAD_NAME=parser_reader */ WORKLOAD, COUNT_QUERIES "
+                       "FROM performance_schema.workload_instrumentation")
+        counts = {workload: n_queries for workload, n_queries in cursor}
+        cursor.close()
+        return counts
+
+    def test_parser_matches_regex(self):
+        cases = [
+            "/* WORKLOAD_NAME=simple */",
+            "/*WORKLOAD_NAME=no_spaces*/",
+            "/* WORKLOAD_NAME=with:all.the-chars_/\\9 */",
+            "/* WORKLOAD_NAME= */ /* WORKLOAD_NAME=second_comment */",
+            "/* WORKLOAD_NAME=! WORKLOAD_NAME=second_key */",
+            "/* other comment */ /* WORKLOAD_NAME=after_other */",
+            "/* WORKLOAD_NAME=multi\n line */ /* WORKLOAD_NAME=after_newline */",
+            "/* WORKLOAD_NAME=cr\r */",
+            "/* WORKLOAD_NAME=unclosed",
+            "WORKLOAD_NAME=outside_comment",
+            "/*/ WORKLOAD_NAME=slash_star_slash */",
+            "/**/ WORKLOAD_NAME=after_empty /* x */",
+            "/* /* WORKLOAD_NAME=nested */ */",
+            "/*+ WORKLOAD_NAME=hint_style */",
+            "/*! WORKLOAD_NAME=versioned */",
+            "/* a \n /* WORKLOAD_NAME=reopened */",
+            "/* WORKLOAD_NAME=stops*here */",
+            "/* WORKLOAD_NAME=ends_at_close*/",
+            "/* workload_name=lowercase */",
+            "x/y/z /* WORKLOAD_NAME=after_slashes */",
+        ]
+        # Random combinations of the tokens that matter to the parser, with a fixed seed so failures are reproducible.
+        tokens = ["/*", "*/", "*", "/", "\n", "\r", "WORKLOAD_NAME=", "WORKLOAD_NAME", "=", "fz", "Q9", "-", "_", ":",
+                  ".", "\\", " ", "#"]
+        rnd = random.Random(1234)
+        while len(cases) < 300:
+            case = "".join(rnd.choice(tokens) for _ in range(rnd.randint(1, 12)))
+            if len(expected_workload(case)) <= 50:
+                cases.append(case)
+
+        expected = collections.Counter()
+        before = self.workload_counts()
+        for case in cases:
+            query = f"SELECT '{case} ' AS c"
+            expected[expected_workload(query)] += 1
+            cursor = self.cnx.cursor()
+            cursor.execute(query)
+            for _ in cursor:
+                pass
+            cursor.close()
+        after = self.workload_counts()
+
+        for workload, n_queries in expected.items():
+            self.assertEqual(n_queries, after.get(workload, 0) - before.get(workload, 0), workload)
+
+    def execute_queries(self, cnx, queries):
+        for query in queries:
+            cursor = cnx.cursor()
+            cursor.execute(query)
+            for _ in cursor:
+                pass
+            cursor.close()
+
+    def run_queries(self, queries):
+        cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+        self.execute_queries(cnx, queries)
+        cnx.close()
+
+    def test_concurrent_counters(self):
+        n_threads = 8
+        n_queries = 200
+        # All threads share one workload, half of them also create new workloads as they go.
+        threads = []
+        for t in range(n_threads):
+            queries = []
+            for i in range(n_queries):
+                queries.append("SELECT /* WORKLOAD_NAME=concurrent_shared */ * FROM test_table WHERE id=4")
+                if t % 2 == 0:
+                    queries.append(f"SELECT /* WORKLOAD_NAME=concurrent_{t}_{i % 10} */ * FROM test_table WHERE id=4")
+            threads.append(threading.Thread(target=self.run_queries, args=(queries,)))
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        counts = self.workload_counts()
+        self.assertEqual(n_threads * n_queries, counts["concurrent_shared"])
+        for t in range(0, n_threads, 2):
+            for i in range(10):
+                self.assertEqual(n_queries // 10, counts[f"concurrent_{t}_{i}"])
+
+    def test_counts_flushed_on_disconnect(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.flush_statements=1000")
+        cursor.execute("SET GLOBAL workload_instrumentation.flush_interval_ms=3600000")
+        cursor.close()
+
+        # Counters stay in the per thread cache of the connection until it disconnects.
+        self.run_queries(["SELECT /* WORKLOAD_NAME=disconnect_test */ * FROM test_table WHERE id=4"] * 25)
+        self.assertEqual(25, self.workload_counts()["disconnect_test"])
+
+        # Idle connections get their counters flushed when the table is read.
+        cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+        for _ in range(10):
+            cursor = cnx.cursor()
+            cursor.execute("SELECT /* WORKLOAD_NAME=idle_test */ * FROM test_table WHERE id=4")
+            for _ in cursor:
+                pass
+            cursor.close()
+        self.assertEqual(10, self.workload_counts()["idle_test"])
+        cnx.close()
+
+    def test_reinstall_discards_pending_counts(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.flush_statements=1000")
+        cursor.execute("SET GLOBAL workload_instrumentation.flush_interval_ms=3600000")
+        for _ in range(5):
+            cursor.execute("SELECT /* WORKLOAD_NAME=reinstall_test */ * FROM test_table WHERE id=4")
+            for _ in cursor:
+                pass
+        cursor.close()
+
+        # Counters still pending in this connection's cache belong to the uninstalled component and must not leak into
+        # the new instance. test_persist checks that they reach the last snapshot instead of being lost.
+        self.manage_component(False)
+        self.manage_component(True)
+
+        cursor = self.cnx.cursor()
+        for _ in range(3):
+            cursor.execute("SELECT /* WORKLOAD_NAME=reinstall_test */ * FROM test_table WHERE id=4")
+            for _ in cursor:
+                pass
+        cursor.close()
+        self.assertEqual(3, self.workload_counts()["reinstall_test"])
+
+    def test_latency_histogram(self):
+        queries = ["SELECT /* WORKLOAD_NAME=histogram_test */ * FROM test_table WHERE id=4"] * 20
+        queries.append("SELECT /* WORKLOAD_NAME=histogram_test */ SLEEP(0.2)")
+        self.run_queries(queries)
+
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT BUCKET_UPPER_US, COUNT_QUERIES FROM performance_schema.workload_instrumentation_histogram "
+                       "WHERE WORKLOAD='histogram_test' ORDER BY BUCKET_UPPER_US")
+        buckets = cursor.fetchall()
+        # Every statement lands in exactly one bucket, only non empty buckets are returned.
+        self.assertEqual(21, sum(count for _, count in buckets))
+        self.assertTrue(all(count > 0 for _, count in buckets))
+        # The SLEEP lands in the last non empty bucket, which is at most 25% wider than 200ms.
+        self.assertGreaterEqual(buckets[-1][0], 200000)
+        self.assertLess(buckets[-1][0], 300000)
+
+        cursor.execute("SELECT P50_DURATION_US, P95_DURATION_US, P99_DURATION_US "
+                       "FROM performance_schema.workload_instrumentation WHERE WORKLOAD='histogram_test'")
+        p50, p95, p99 = cursor.fetchone()
+        cursor.close()
+        self.assertLessEqual(p50, p95)
+        self.assertLessEqual(p95, p99)
+        # 1 out of 21 statements is slow: above the 95th percentile only.
+        self.assertLess(p95, 200000)
+        self.assertGreaterEqual(p99, 200000)
+
+    def test_cpu_and_lock_time(self):
+        self.run_queries(["SELECT /* WORKLOAD_NAME=sleep_test */ SLEEP(0.3)",
+                          "SELECT /* WORKLOAD_NAME=cpu_test */ BENCHMARK(5000000, MD5('cpu_test'))"])
+
+        # Hold a write lock on the table while another connection tries to read it.
+        cursor = self.cnx.cursor()
+        cursor.execute("LOCK TABLES test_table WRITE")
+        reader = threading.Thread(target=self.run_queries,
+                                  args=(["SELECT /* WORKLOAD_NAME=lock_test */ * FROM test_table WHERE id=4"],))
+        reader.start()
+        reader.join(0.5)
+        cursor.execute("UNLOCK TABLES")
+        cursor.close()
+        reader.join()
+
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT WORKLOAD, SUM_DURATION_US, SUM_LOCK_TIME_US, SUM_CPU_TIME_US "
+                       "FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD IN ('sleep_test', 'cpu_test', 'lock_test')")
+        times = {workload: (duration, lock, cpu) for workload, duration, lock, cpu in cursor}
+        cursor.close()
+
+        # Sleeping takes time but almost no CPU.
+        duration, lock, cpu = times["sleep_test"]
+        self.assertGreaterEqual(duration, 300000)
+        self.assertLess(cpu, duration / 10)
+        # BENCHMARK() keeps the thread busy for most of the query.
+        duration, lock, cpu = times["cpu_test"]
+        self.assertGreater(cpu, duration / 2)
+        self.assertLessEqual(cpu, duration)
+        # The reader waited for the table lock for most of its duration.
+        duration, lock, cpu = times["lock_test"]
+        self.assertGreaterEqual(lock, 400000)
+        self.assertLessEqual(lock, duration)
+        self.assertLess(cpu, duration / 10)
+
+    def test_max_workloads(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.evict_idle_seconds=0")
+        # batch_job_1 already takes one of the two workloads.
+        cursor.execute("SET GLOBAL workload_instrumentation.max_workloads=2")
+        cursor.close()
+
+        self.run_queries(["SELECT /* WORKLOAD_NAME=capacity_a */ * FROM test_table WHERE id=4",
+                          "SELECT /* WORKLOAD_NAME=capacity_b */ * FROM test_table WHERE id=4"])
+        counts = self.workload_counts()
+        self.assertEqual(1, counts["capacity_a"])
+        self.assertNotIn("capacity_b", counts)
+        self.assertEqual(1, counts["__OVERFLOW__"])
+
+        # Raising the limit makes room for new workloads right away.
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.max_workloads=10")
+        cursor.close()
+        self.run_queries(["SELECT /* WORKLOAD_NAME=capacity_b */ * FROM test_table WHERE id=4"])
+        counts = self.workload_counts()
+        self.assertEqual(1, counts["capacity_b"])
+        # The previous workload_counts() query overflowed too, it is only counted once it ends.
+        self.assertEqual(2, counts["__OVERFLOW__"])
+
+    def test_evict_idle_workloads(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.evict_idle_seconds=1")
+        cursor.execute("SET GLOBAL workload_instrumentation.max_workloads=5")
+        cursor.close()
+
+        # Together with batch_job_1, this fills the table.
+        self.run_queries([f"SELECT /* WORKLOAD_NAME=evict_old_{i % 4} */ * FROM test_table WHERE id=4"
+                          for i in range(8)])
+        time.sleep(2.1)
+
+        # Idle workloads are evicted to make room for new ones, their counters are kept in __EVICTED__.
+        self.run_queries(["SELECT /* WORKLOAD_NAME=evict_new */ * FROM test_table WHERE id=4"] * 3)
+        counts = self.workload_counts()
+        self.assertEqual(3, counts["evict_new"])
+        self.assertEqual(15 + 8, counts["__EVICTED__"])
+        self.assertEqual(0, counts["__OVERFLOW__"])
+        self.assertNotIn("batch_job_1", counts)
+        self.assertFalse(any(workload.startswith("evict_old_") for workload in counts))
+
+        # An evicted workload starts from zero when it comes back.
+        self.run_queries(["SELECT /* WORKLOAD_NAME=evict_old_0 */ * FROM test_table WHERE id=4"])
+        counts = self.workload_counts()
+        self.assertEqual(1, counts["evict_old_0"])
+        self.assertEqual(15 + 8, counts["__EVICTED__"])
+
+    def test_truncate(self):
+        self.run_queries(["SELECT /* WORKLOAD_NAME=truncate_test */ * FROM test_table WHERE id=4"] * 5)
+        self.assertEqual(5, self.workload_counts()["truncate_test"])
+
+        cursor = self.cnx.cursor()
+        cursor.execute("TRUNCATE TABLE performance_schema.workload_instrumentation")
+        cursor.close()
+
+        # Only the special workloads are left, with the TRUNCATE itself counted after the reset.
+        counts = self.workload_counts()
+        self.assertEqual({"__UNSPECIFIED__": 1, "__OVERFLOW__": 0, "__EVICTED__": 0}, counts)
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT COUNT(*) FROM performance_schema.workload_instrumentation_histogram "
+                       "WHERE WORKLOAD='truncate_test'")
+        self.assertEqual(0, cursor.fetchone()[0])
+        cursor.close()
+
+        self.run_queries(["SELECT /* WORKLOAD_NAME=truncate_test */ * FROM test_table WHERE id=4"] * 2)
+        self.assertEqual(2, self.workload_counts()["truncate_test"])
+
+    def test_window(self):
+        self.run_queries(["SELECT /* WORKLOAD_NAME=window_test */ * FROM test_table WHERE id=4"] * 4)
+
+        # Windows only hold complete minutes: the queries are in none of them yet.
+        cursor = self.cnx.cursor()
+        query = ("SELECT WINDOW_SECONDS, COUNT_QUERIES, SUM_ROWS_SENT FROM performance_schema.workload_instrumentation_window "
+                 "WHERE WORKLOAD='window_test' ORDER BY WINDOW_SECONDS")
+        cursor.execute(query)
+        self.assertEqual([(60, 0, 0), (300, 0, 0), (900, 0, 0)], cursor.fetchall())
+
+        # A minute later, the minute the queries ran in is complete, and in the 5 and 15 minute windows. The last
+        # minute may be the next one already.
+        time.sleep(61)
+        cursor.execute(query)
+        windows = cursor.fetchall()
+        cursor.close()
+        self.assertIn(windows[0], [(60, 4, 4), (60, 0, 0)])
+        self.assertEqual([(300, 4, 4), (900, 4, 4)], windows[1:])
+
+    def test_sampling(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.sample_rate=10")
+        cursor.close()
+
+        # Recorded statements count for the ones skipped before them, and those skipped last are counted at
+        # disconnect, so all of the connection's statements are accounted for.
+        self.run_queries(["SELECT /* WORKLOAD_NAME=sampling_test */ * FROM test_table WHERE id=4"] * 500)
+
+        cursor = self.cnx.cursor()
+        cursor.execute("SET GLOBAL workload_instrumentation.sample_rate=1")
+        cursor.close()
+        self.run_queries(["SELECT /* WORKLOAD_NAME=exact_test */ * FROM test_table WHERE id=4"] * 5)
+
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT WORKLOAD, COUNT_QUERIES, SUM_ROWS_SENT, ESTIMATED FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD IN ('sampling_test', 'exact_test') ORDER BY WORKLOAD")
+        self.assertEqual([("exact_test", 5, 5, "NO"), ("sampling_test", 500, 500, "YES")], cursor.fetchall())
+        # Statements counted at disconnect go to the digest of the last recorded one too.
+        cursor.execute("SELECT SUM(COUNT_QUERIES) FROM performance_schema.workload_instrumentation_top_digests "
+                       "WHERE WORKLOAD='sampling_test'")
+        self.assertEqual(500, cursor.fetchone()[0])
+        cursor.close()
+
+    def test_top_digests(self):
+        self.run_queries([f"SELECT /* WORKLOAD_NAME=digest_test */ * FROM test_table WHERE id={i}" for i in range(1, 6)] +
+                         ["SELECT /* WORKLOAD_NAME=digest_test */ * FROM test_table WHERE content IN ('cc', 'dd')",
+                          "SELECT /* WORKLOAD_NAME=digest_test */ * FROM test_table WHERE content IN ('dd')"])
+
+        # Literals, and lists of them, are normalized away.
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT DIGEST_TEXT, COUNT_QUERIES, COUNT_ERROR, SUM_ROWS_SENT "
+                       "FROM performance_schema.workload_instrumentation_top_digests WHERE WORKLOAD='digest_test' "
+                       "ORDER BY COUNT_QUERIES DESC")
+        self.assertEqual([("select * from test_table where id=?", 5, 0, 5),
+                          ("select * from test_table where content in (?)", 2, 0, 14 + 4)], cursor.fetchall())
+
+        cursor.execute("SET GLOBAL workload_instrumentation.track_digests=0")
+        cursor.close()
+        self.run_queries(["SELECT /* WORKLOAD_NAME=no_digest_test */ * FROM test_table WHERE id=4"])
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT COUNT(*) FROM performance_schema.workload_instrumentation_top_digests "
+                       "WHERE WORKLOAD='no_digest_test'")
+        self.assertEqual(0, cursor.fetchone()[0])
+        cursor.close()
+
+    def test_tags(self):
+        # Tags are read only, they are set up when the component is installed.
+        cursor = self.cnx.cursor()
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.tags='TEAM,ENDPOINT,SHARD_KEY'")
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.tag_max_values=2")
+        cursor.close()
+        try:
+            self.manage_component(False)
+            self.manage_component(True)
+
+            self.run_queries(
+                ["SELECT /* WORKLOAD_NAME=tags_test,TEAM=search,ENDPOINT='search%2Fquery' */ * FROM test_table "
+                 "WHERE id=4"] * 3 +
+                ["SELECT /* TEAM=search */ /* ENDPOINT=autocomplete SHARD_KEY=7 */ * FROM test_table WHERE id=4"] * 2 +
+                ["SELECT /* TEAM=ads */ * FROM test_table WHERE id=4",
+                 # Past tag_max_values, the team is counted as overflow.
+                 "SELECT /* TEAM=billing */ * FROM test_table WHERE id=4"])
+
+            cursor = self.cnx.cursor()
+            cursor.execute("SELECT TAG_1, TAG_2, TAG_3, COUNT_QUERIES, SUM_ROWS_SENT "
+                           "FROM performance_schema.workload_instrumentation_tags WHERE TAG_1 != '' "
+                           "ORDER BY TAG_1, TAG_2")
+            self.assertEqual([("__OVERFLOW__", "", "", 1, 1),
+                              ("__OVERFLOW__", "__OVERFLOW__", "__OVERFLOW__", 0, 0),
+                              ("ads", "", "", 1, 1),
+                              ("search", "autocomplete", "7", 2, 2),
+                              ("search", "search%2Fquery", "", 3, 3)], cursor.fetchall())
+            cursor.close()
+            self.assertEqual(3, self.workload_counts()["tags_test"])
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.tags")
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.tag_max_values")
+            cursor.close()
+
+    def test_export(self):
+        export_file = "/tmp/workload_instrumentation.prom"
+        cursor = self.cnx.cursor()
+        cursor.execute(f"SET PERSIST_ONLY workload_instrumentation.export_file='{export_file}'")
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.export_interval_ms=100")
+        cursor.close()
+        try:
+            self.manage_component(False)
+            self.manage_component(True)
+
+            # The connection flushes its counters when it closes, the export does not flush them.
+            self.run_queries(["SELECT /* WORKLOAD_NAME=export_test */ * FROM test_table WHERE id=4"] * 3)
+            time.sleep(0.5)
+
+            with open(export_file) as f:
+                lines = f.read().splitlines()
+            self.assertIn("# TYPE mysql_workload_query_duration_seconds summary", lines)
+            self.assertIn('mysql_workload_query_duration_seconds_count{workload="export_test"} 3', lines)
+            self.assertIn('mysql_workload_rows_sent_total{workload="export_test"} 3', lines)
+
+            self.manage_component(False)
+            self.assertFalse(os.path.exists(export_file))
+            self.manage_component(True)
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.export_file")
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.export_interval_ms")
+            cursor.close()
+
+    def test_persist(self):
+        persist_file = "/tmp/workload_instrumentation.snapshot"
+        if os.path.exists(persist_file):
+            os.remove(persist_file)
+        cursor = self.cnx.cursor()
+        cursor.execute(f"SET PERSIST_ONLY workload_instrumentation.persist_file='{persist_file}'")
+        cursor.close()
+        try:
+            self.manage_component(False)
+            self.manage_component(True)
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.flush_statements=1000")
+            cursor.execute("SET GLOBAL workload_instrumentation.flush_interval_ms=3600000")
+            cursor.close()
+
+            # The counters stay pending in the cache of a connection that is still open at uninstall, nothing reads
+            # the tables meanwhile: only the flush at uninstall gets them into the last snapshot.
+            query = "SELECT /* WORKLOAD_NAME=persist_test */ * FROM test_table WHERE id=4"
+            pending = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+            try:
+                self.execute_queries(pending, [query] * 4)
+
+                # The snapshot written at uninstall is restored at install, and counting goes on from it.
+                self.manage_component(False)
+                self.assertTrue(os.path.exists(persist_file))
+                self.manage_component(True)
+                self.assertEqual(4, self.workload_counts()["persist_test"])
+                self.execute_queries(pending, [query] * 2)
+            finally:
+                pending.close()
+            self.assertEqual(6, self.workload_counts()["persist_test"])
+
+            # An invalid snapshot is ignored.
+            self.manage_component(False)
+            with open(persist_file, "r+b") as f:
+                f.seek(100)
+                byte = f.read(1)
+                f.seek(100)
+                f.write(bytes([byte[0] ^ 1]))
+            self.manage_component(True)
+            self.assertNotIn("persist_test", self.workload_counts())
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.persist_file")
+            cursor.close()
+            if os.path.exists(persist_file):
+                os.remove(persist_file)
+
+    def test_ignore(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.ignore_commands='install_component,show_variables'")
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.ignore_users='ignored_user@localhost'")
+        cursor.execute("CREATE USER IF NOT EXISTS ignored_user@localhost")
+        cursor.execute("GRANT SELECT ON testdb.* TO ignored_user@localhost")
+        cursor.close()
+        try:
+            self.manage_component(False)
+            self.manage_component(True)
+
+            self.run_queries(["SHOW /* WORKLOAD_NAME=ignore_test */ VARIABLES LIKE 'version'",
+                              "SELECT /* WORKLOAD_NAME=ignore_test */ * FROM test_table WHERE id=4"])
+            cnx = mysql.connector.connect(user='ignored_user', unix_socket='/tmp/data/mysql.sock', database='testdb')
+            cursor = cnx.cursor()
+            cursor.execute("SELECT /* WORKLOAD_NAME=ignore_test */ * FROM test_table WHERE id=4")
+            cursor.fetchall()
+            cursor.close()
+            cnx.close()
+
+            counts = self.workload_counts()
+            self.assertEqual(1, counts["ignore_test"])
+            self.assertNotIn("parser_reader", counts)
+
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.ignore_own_tables=0")
+            cursor.close()
+            self.workload_counts()
+            self.assertEqual(1, self.workload_counts()["parser_reader"])
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.ignore_own_tables=1")
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.ignore_commands")
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.ignore_users")
+            cursor.execute("DROP USER IF EXISTS ignored_user@localhost")
+            cursor.close()
+
+    def test_ignore_similar_names(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("CREATE TABLE IF NOT EXISTS workload_instrumentation_log (id INT PRIMARY KEY)")
+        cursor.close()
+        try:
+            # Only reads of the component's own tables are ignored, not tables or workloads with similar names.
+            self.run_queries(["SELECT /* WORKLOAD_NAME=similar_table */ * FROM workload_instrumentation_log",
+                              "SELECT /* WORKLOAD_NAME=similar_table */ * FROM testdb.`workload_instrumentation_log`",
+                              "SELECT /* WORKLOAD_NAME=workload_instrumentation_ui */ * FROM test_table WHERE id=4",
+                              "SELECT /* WORKLOAD_NAME=own_table */ * FROM `performance_schema`.`WORKLOAD_INSTRUMENTATION`"])
+            counts = self.workload_counts()
+            self.assertEqual(2, counts["similar_table"])
+            self.assertEqual(1, counts["workload_instrumentation_ui"])
+            self.assertNotIn("own_table", counts)
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("DROP TABLE IF EXISTS workload_instrumentation_log")
+            cursor.close()
+
+    def test_prepared_statements(self):
+        cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+        cursor = cnx.cursor(prepared=True)
+        for i in range(6):
+            cursor.execute("SELECT /* WORKLOAD_NAME=prepared_test */ * FROM test_table WHERE id=%s", (i,))
+            cursor.fetchall()
+            # Workloads the connection remembers are found again after a reset.
+            if i == 2:
+                self.assertEqual(3, self.workload_counts()["prepared_test"])
+                reset = self.cnx.cursor()
+                reset.execute("TRUNCATE TABLE performance_schema.workload_instrumentation")
+                reset.close()
+        cursor.close()
+        cnx.close()
+
+        self.assertEqual(3, self.workload_counts()["prepared_test"])
+
+    def test_user_variable(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("SET PERSIST_ONLY workload_instrumentation.user_variable='workload_name'")
+        cursor.close()
+        try:
+            self.manage_component(False)
+            self.manage_component(True)
+
+            # The SET itself ends with the variable set, so it is counted too.
+            self.run_queries([
+                "SET @workload_name='variable_test'",
+                "SELECT * FROM test_table WHERE id=4",
+                "SELECT * FROM test_table WHERE id=5",
+                "SELECT /* WORKLOAD_NAME=variable_comment */ * FROM test_table WHERE id=4",
+                "SET @workload_name=NULL",
+                "SELECT * FROM test_table WHERE id=6",
+            ])
+            counts = self.workload_counts()
+            self.assertEqual(3, counts["variable_test"])
+            self.assertEqual(1, counts["variable_comment"])
+
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.comment_overrides_variable=0")
+            cursor.close()
+            self.run_queries([
+                "SET @workload_name='variable_test'",
+                "SELECT /* WORKLOAD_NAME=variable_comment */ * FROM test_table WHERE id=4",
+            ])
+            counts = self.workload_counts()
+            self.assertEqual(5, counts["variable_test"])
+            self.assertEqual(1, counts["variable_comment"])
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.comment_overrides_variable=1")
+            cursor.execute("RESET PERSIST IF EXISTS workload_instrumentation.user_variable")
+            cursor.close()
+
+    def test_budgets(self):
+        cursor = self.cnx.cursor()
+        with self.assertRaises(mysql.connector.Error):
+            cursor.execute("SET GLOBAL workload_instrumentation.budgets='budget_test:no_such_limit=1'")
+        cursor.execute("SET GLOBAL workload_instrumentation.budgets='budget_test:rows_examined_per_second=1'")
+        cursor.close()
+        try:
+            # The first scan spends 14 seconds of the budget, the next statement is rejected right away.
+            cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+            cursor = cnx.cursor()
+            cursor.execute("SELECT /* WORKLOAD_NAME=budget_test */ * FROM test_table")
+            cursor.fetchall()
+            with self.assertRaises(mysql.connector.Error):
+                cursor.execute("SELECT /* WORKLOAD_NAME=budget_test */ * FROM test_table WHERE id=4")
+                cursor.fetchall()
+            # Other workloads are not affected.
+            cursor.execute("SELECT /* WORKLOAD_NAME=budget_other */ * FROM test_table")
+            cursor.fetchall()
+            cursor.close()
+            cnx.close()
+
+            cursor = self.cnx.cursor(dictionary=True)
+            cursor.execute("SELECT * FROM performance_schema.workload_instrumentation "
+                           "WHERE WORKLOAD IN ('budget_test', 'budget_other') ORDER BY WORKLOAD")
+            other, limited = cursor.fetchall()
+            cursor.close()
+            self.assertEqual(1, limited["COUNT_QUERIES"])
+            self.assertEqual(1, limited["COUNT_REJECTED"])
+            self.assertEqual(0, limited["COUNT_THROTTLED"])
+            self.assertEqual(1, other["COUNT_QUERIES"])
+            self.assertEqual(0, other["COUNT_REJECTED"])
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.budgets=''")
+            cursor.close()
+
+    def test_budgets_replaced(self):
+        def budget_bytes():
+            cursor = self.cnx.cursor()
+            cursor.execute("SELECT CURRENT_NUMBER_OF_BYTES_USED FROM performance_schema.memory_summary_global_by_event_name "
+                           "WHERE EVENT_NAME='memory/workload_instrumentation/budgets'")
+            value = cursor.fetchone()[0]
+            cursor.close()
+            return value
+
+        cursor = self.cnx.cursor()
+        try:
+            cursor.execute("SET GLOBAL workload_instrumentation.budgets='budget_test:concurrency=1'")
+            baseline = budget_bytes()
+            # Replaced values are freed, so is a value only persisted.
+            for i in range(1, 51):
+                cursor.execute(f"SET GLOBAL workload_instrumentation.budgets='budget_test:concurrency={i}'")
+            cursor.execute("SET PERSIST_ONLY workload_instrumentation.budgets='budget_test:concurrency=2'")
+            cursor.execute("SET GLOBAL workload_instrumentation.budgets='budget_test:concurrency=1'")
+            self.assertEqual(baseline, budget_bytes())
+        finally:
+            cursor.execute("RESET PERSIST workload_instrumentation.budgets")
+            cursor.execute("SET GLOBAL workload_instrumentation.budgets=''")
+            cursor.close()
+
+    def test_nested_statements(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("CREATE PROCEDURE nested_test_procedure() BEGIN "
+                       "SELECT /* WORKLOAD_NAME=nested_inner */ COUNT(*) INTO @count FROM test_table "
+                       "WHERE content='cc'; "
+                       "UPDATE test_table SET content='ee' WHERE id=4; END")
+        cursor.close()
+        try:
+            self.run_queries(["CALL /* WORKLOAD_NAME=nested_test */ nested_test_procedure()"] * 2)
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("DROP PROCEDURE nested_test_procedure")
+            cursor.close()
+
+        cursor = self.cnx.cursor(dictionary=True)
+        cursor.execute("SELECT * FROM performance_schema.workload_instrumentation WHERE WORKLOAD='nested_test'")
+        row = cursor.fetchone()
+        cursor.close()
+        # Statements of the procedure count in the workload of the CALL, their comments are not parsed.
+        self.assertNotIn("nested_inner", self.workload_counts())
+        self.assertEqual(2, row["COUNT_QUERIES"])
+        self.assertEqual(4, row["COUNT_NESTED_QUERIES"])
+        self.assertGreaterEqual(row["SUM_NESTED_ROWS_EXAMINED"], 2 * 14)
+        self.assertEqual(1, row["SUM_NESTED_ROWS_AFFECTED"])
+        self.assertLessEqual(row["SUM_NESTED_DURATION_US"], row["SUM_DURATION_US"])
+
+    def test_self_stats(self):
+        cursor = self.cnx.cursor()
+        cursor.execute("TRUNCATE TABLE performance_schema.workload_instrumentation_self_stats")
+        cursor.execute("SET GLOBAL workload_instrumentation.self_stats_sample_rate=1")
+        cursor.close()
+        try:
+            self.run_queries(["SELECT /* WORKLOAD_NAME=self_stats_test */ * FROM test_table WHERE id=4"] * 10)
+            cursor = self.cnx.cursor(dictionary=True)
+            cursor.execute("SELECT * FROM performance_schema.workload_instrumentation_self_stats")
+            rows = cursor.fetchall()
+            cursor.close()
+        finally:
+            cursor = self.cnx.cursor()
+            cursor.execute("SET GLOBAL workload_instrumentation.self_stats_sample_rate=0")
+            cursor.close()
+
+        # Every statement is measured, each of them with a start and an end event.
+        self.assertEqual(1, len(rows))
+        row = rows[0]
+        self.assertGreaterEqual(row["COUNT_CALLBACKS"], 2 * 10)
+        self.assertGreater(row["SUM_CALLBACK_NS"], 0)
+        self.assertGreater(row["SUM_PARSE_NS"], 0)
+        self.assertGreater(row["SUM_LOOKUP_NS"], 0)
+        self.assertGreater(row["SUM_UPDATE_NS"], 0)
+        self.assertLessEqual(row["SUM_PARSE_NS"] + row["SUM_LOOKUP_NS"] + row["SUM_UPDATE_NS"],
+                             row["SUM_CALLBACK_NS"])
+        self.assertGreaterEqual(row["SUM_QUERY_BYTES_SCANNED"], 10 * len("SELECT /* WORKLOAD_NAME=self_stats_test */"))
+
+        # Records of workloads are accounted to the component's memory instruments.
+        cursor = self.cnx.cursor()
+        cursor.execute("SELECT CURRENT_NUMBER_OF_BYTES_USED FROM performance_schema.memory_summary_global_by_event_name "
+                       "WHERE EVENT_NAME='memory/workload_instrumentation/records'")
+        self.assertGreater(cursor.fetchone()[0], 0)
+        cursor.close()
+
+    def test_resources(self):
+        queries = [
+            "SELECT /* WORKLOAD_NAME=resource_test */ * FROM test_table",
+            "SELECT /* WORKLOAD_NAME=resource_test */ CAST('x' AS SIGNED)",
+            "SELECT /* WORKLOAD_NAME=resource_test */ * FROM no_such_table",
+        ]
+        cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+        for query in queries:
+            cursor = cnx.cursor()
+            try:
+                cursor.execute(query)
+                cursor.fetchall()
+            except mysql.connector.Error:
+                pass
+            cursor.close()
+        cnx.close()
+
+        cursor = self.cnx.cursor(dictionary=True)
+        cursor.execute("SELECT * FROM performance_schema.workload_instrumentation WHERE WORKLOAD='resource_test'")
+        row = cursor.fetchone()
+        cursor.close()
+        self.assertEqual(3, row["COUNT_QUERIES"])
+        self.assertEqual(1, row["SUM_SELECT_SCAN"])
+        self.assertEqual(1, row["SUM_ERRORS"])
+        self.assertEqual(2, row["SUM_WARNINGS"])
+        self.assertGreater(row["SUM_BYTES_SENT"], 0)
+        # The command packets: header, command byte and query text, maybe followed by empty query attributes.
+        received = sum(len(query) + 5 for query in queries)
+        self.assertGreaterEqual(row["SUM_BYTES_RECEIVED"], received)
+        self.assertLessEqual(row["SUM_BYTES_RECEIVED"], received + 2 * len(queries))
+        self.assertEqual(0, row["SUM_TIMEOUTS"])
+
+        # Executions of prepared statements read their binary packet before they start, which is not counted.
+        query = "SELECT /* WORKLOAD_NAME=resource_prepared_test */ * FROM test_table WHERE id=%s"
+        cnx = mysql.connector.connect(user='root', unix_socket='/tmp/data/mysql.sock', database='testdb')
+        cursor = cnx.cursor(prepared=True)
+        for i in range(3):
+            cursor.execute(query, (i,))
+            cursor.fetchall()
+        cursor.close()
+        cnx.close()
+
+        cursor = self.cnx.cursor(dictionary=True)
+        cursor.execute("SELECT * FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='resource_prepared_test'")
+        row = cursor.fetchone()
+        cursor.close()
+        self.assertGreater(row["SUM_BYTES_SENT"], 0)
+        self.assertLess(row["SUM_BYTES_RECEIVED"], len(query))
+
+    def test_lookup_by_workload(self):
+        self.run_queries([f"SELECT /* WORKLOAD_NAME=index_test_{i % 3} */ * FROM test_table WHERE id=4"
+                          for i in range(9)])
+
+        cursor = self.cnx.cursor()
+        cursor.execute("EXPLAIN SELECT COUNT_QUERIES FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='index_test_1'")
+        columns = [column[0] for column in cursor.description]
+        self.assertEqual("PRIMARY", cursor.fetchone()[columns.index("key")])
+
+        cursor.execute("SELECT WORKLOAD, COUNT_QUERIES FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='index_test_1'")
+        self.assertEqual([("index_test_1", 3)], cursor.fetchall())
+
+        cursor.execute("SELECT WORKLOAD, COUNT_QUERIES FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD IN ('index_test_0', 'index_test_2', 'no_such_workload') ORDER BY WORKLOAD")
+        self.assertEqual([("index_test_0", 3), ("index_test_2", 3)], cursor.fetchall())
+
+        cursor.execute("SELECT COUNT(*) FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD='no_such_workload'")
+        self.assertEqual(0, cursor.fetchone()[0])
+
+        # Non key reads still go through all the records.
+        cursor.execute("SELECT COUNT(*) FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD LIKE 'index\\_test\\_%'")
+        self.assertEqual(3, cursor.fetchone()[0])
+        cursor.execute("SELECT COUNT(*) FROM performance_schema.workload_instrumentation "
+                       "WHERE WORKLOAD > 'index_test_0' AND WORKLOAD < 'index_test_9'")
+        self.assertEqual(2, cursor.fetchone()[0])
+        cursor.close()
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -2,27 +2,78 @@
 #define NO_SIGNATURE_CHANGE 0
 #define SIGNATURE_CHANGE 1
 
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <string>
 
 #include <mysqld_error.h> /* Errors */
 
 #include <mysql/components/component_implementation.h>
+#include <mysql/components/services/component_sys_var_service.h>
 #include <mysql/components/services/log_builtins.h> /* LogComponentErr */
 #include <mysql/components/services/mysql_current_thread_reader.h>
+#include <mysql/components/services/mysql_mutex.h>
 #include <mysql/components/services/mysql_rwlock.h>
 #include <mysql/components/services/pfs_plugin_table_service.h>
+#include <mysql/components/services/psi_memory.h>
 
+#include "mysql/components/util/event_tracking/event_tracking_connection_consumer_helper.h"
 #include "mysql/components/util/event_tracking/event_tracking_query_consumer_helper.h"
 #include "workload_instrumentation.h"
+#include "workload_instrumentation_budget.h"
+#include "workload_instrumentation_export.h"
+#include "workload_instrumentation_filter.h"
+#include "workload_instrumentation_parser.h"
+#include "workload_instrumentation_persist.h"
 #include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sampling.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_statement_cache.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_tags.h"
 #include "workload_instrumentation_thd_stats.h"
+#include "workload_instrumentation_thread_cache.h"
 
 REQUIRES_SERVICE_PLACEHOLDER(mysql_current_thread_reader);
 REQUIRES_SERVICE_PLACEHOLDER(pfs_plugin_table_v1);
 REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_bigint_v1, pfs_bigint);
 REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_string_v2, pfs_string);
+REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_register);
+REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_unregister);
+
+/* See workload_instrumentation.user_variable, empty when disabled. */
+static std::string user_variable_name;
+
+/*
+  Initialization steps, in order. Deinitialization undoes them in reverse
+  order, and so does a failed initialization for the steps that succeeded,
+  so that no thread or table is left behind when the library is unloaded.
+*/
+struct component_step {
+  int (*init)();
+  int (*deinit)();
+};
+
+static const component_step component_steps[] = {
+    {register_sysvars, unregister_sysvars},
+    {workload_filter_init, workload_filter_deinit},
+    {workload_instrumentation_pfs_init, workload_instrumentation_pfs_deinit},
+    {workload_persist_init, workload_persist_deinit},
+    {workload_budget_init, workload_budget_deinit},
+    {workload_export_init, workload_export_deinit},
+};
+
+static constexpr size_t component_step_count =
+    sizeof(component_steps) / sizeof(component_steps[0]);
+
+/* Undoes the first count steps, returns 1 if any of them failed. */
+static mysql_service_status_t deinit_steps(size_t count) {
+  mysql_service_status_t result = 0;
+  while (count > 0) {
+    if (component_steps[--count].deinit() != 0) result = 1;
+  }
+  return result;
+}
 
 static mysql_service_status_t workload_instrumentation_service_init() {
   log_bi = mysql_service_log_builtins;
@@ -32,11 +83,18 @@ static mysql_service_status_t workload_instrumentation_service_init() {
   LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
                   "initializing component...");
 
-  result = workload_instrumentation_pfs_init();
+  size_t initialized = 0;
+  while (result == 0 && initialized < component_step_count) {
+    result = component_steps[initialized].init();
+    if (result == 0) initialized++;
+  }
   if (result == 0) {
+    user_variable_name =
+        user_variable_value != nullptr ? user_variable_value : "";
     LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
                     "Component initialized");
   } else {
+    deinit_steps(initialized);
     LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
                     "Component failed to initialize properly");
   }
@@ -45,9 +103,7 @@ static mysql_service_status_t workload_instrumentation_service_init() {
 }
 
 static mysql_service_status_t workload_instrumentation_service_deinit() {
-  mysql_service_status_t result = 0;
-
-  result = workload_instrumentation_pfs_deinit();
+  mysql_service_status_t result = deinit_steps(component_step_count);
   if (result == 0) {
     LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
                     "Component deinitialized");
@@ -59,67 +115,231 @@ static mysql_service_status_t workload_instrumentation_service_deinit() {
   return result;
 }
 
-std::string findWorkloadName(const std::string &input) {
-  std::regex commentRegex(R"(/\*.*?\*/)");
-  std::regex workloadRegex(R"(WORKLOAD_NAME=([A-Za-z0-9-_:.\/\\\\]+))");
-  std::smatch match;
-  std::sregex_iterator it(input.begin(), input.end(), commentRegex);
-  std::sregex_iterator end;
-
-  while (it != end) {
-    std::string comment = it->str();
-    if (std::regex_search(comment, match, workloadRegex)) {
-      return match[1].str();
-    }
-    ++it;
+/*
+  The workload of a statement, from its comment or from the user variable of
+  its connection. *hint and *tags are set as by
+  workload_statement_cache_find(), *tags to nullptr when tags are disabled.
+*/
+static std::string_view statement_workload(THD *thread, const char *query,
+                                           size_t length,
+                                           workload_record_hint **hint,
+                                           workload_tag_hint **tags) {
+  unsigned long long parse_ns = workload_self_stats_now();
+  // The variable is only looked up, its workload is resolved once per value.
+  std::string_view variable;
+  if (!user_variable_name.empty())
+    get_thd_user_variable(thread, user_variable_name, &variable);
+
+  *hint = nullptr;
+  *tags = nullptr;
+  const std::string_view *keys;
+  bool comment_names =
+      variable.empty() || comment_overrides_variable_value != 0;
+  std::string_view workload;
+  // Tags come from the comments even when the variable names the workload.
+  if (comment_names || workload_tag_keys(&keys) != 0) {
+    workload = workload_statement_cache_find(query, length, hint, tags);
+    if (!comment_names) workload = {};
+  }
+  if (workload.empty() && !variable.empty())
+    workload = workload_variable_cache_find(variable, hint);
+  workload_self_stats_add(WORKLOAD_SELF_PARSE, parse_ns);
+  return workload;
+}
+
+/*
+  The top-level statement running on the thread, for the statements of the
+  stored programs it runs: they count in its workload, which is resolved from
+  its text once, when the first of them ends. The text stays allocated until
+  the statement ends.
+*/
+struct top_level_statement {
+  /* Whether it is recorded: neither ignored, skipped nor rejected. */
+  bool recorded = false;
+  const char *query = nullptr;
+  size_t length = 0;
+  bool resolved = false;
+  char workload[WORKLOAD_NAME_MAX_LENGTH];
+  unsigned int workload_length = 0;
+  workload_record_hint hint;
+};
+
+static thread_local top_level_statement top_level;
+
+/* Records the statements of stored programs, see top_level_statement. */
+static void nested_statement_event(THD *thread,
+                                   const mysql_event_tracking_query_data *data) {
+  if (data->event_subclass == EVENT_TRACKING_QUERY_NESTED_START) {
+    capture_nested_statement_start(thread);
+    return;
   }
 
-  return "";
+  thread_stats ts;
+  if (!get_nested_statement_stats(thread, &ts)) return;
+
+  if (!top_level.resolved) {
+    workload_record_hint *hint;
+    workload_tag_hint *tags;
+    std::string_view workload = statement_workload(
+        thread, top_level.query, top_level.length, &hint, &tags);
+    // Both point into the statement cache, which the next statement reuses.
+    workload = workload.substr(0, WORKLOAD_NAME_MAX_LENGTH);
+    memcpy(top_level.workload, workload.data(), workload.size());
+    top_level.workload_length = workload.size();
+    top_level.hint = hint != nullptr ? *hint : workload_record_hint();
+    top_level.resolved = true;
+  }
+  record_nested_stats({top_level.workload, top_level.workload_length}, &ts,
+                      sample_statement_weight(), &top_level.hint);
+}
+
+/* Whether statements of the thread are excluded, see filter. */
+static bool thread_ignored(THD *thread) {
+  if (ignore_system_threads_value != 0 && is_system_thread(thread))
+    return true;
+  if (!filter_accounts()) return false;
+
+  std::string_view user, host;
+  get_thd_account(thread, &user, &host);
+  return account_ignored(user, host);
 }
 
 mysql_event_tracking_query_subclass_t Event_tracking_implementation::
-    Event_tracking_query_implementation::filtered_sub_events =
-        EVENT_TRACKING_QUERY_START | EVENT_TRACKING_QUERY_NESTED_START |
-        EVENT_TRACKING_QUERY_NESTED_STATUS_END;
+    Event_tracking_query_implementation::filtered_sub_events = 0;
 bool Event_tracking_implementation::Event_tracking_query_implementation::
     callback(const mysql_event_tracking_query_data *data [[maybe_unused]]) {
   auto result = false;
+  workload_self_stats_callback_timer timer(data->event_subclass ==
+                                           EVENT_TRACKING_QUERY_START);
 
-  if (data->event_subclass != EVENT_TRACKING_QUERY_STATUS_END) {
+  bool nested = data->event_subclass == EVENT_TRACKING_QUERY_NESTED_START ||
+                data->event_subclass == EVENT_TRACKING_QUERY_NESTED_STATUS_END;
+  if (data->event_subclass != EVENT_TRACKING_QUERY_START &&
+      data->event_subclass != EVENT_TRACKING_QUERY_STATUS_END && !nested) {
     LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
                     "Got incorrect event type, ignoring it.");
+    return result;
   }
 
+  // Nested statements are only recorded along with their top-level one.
+  if (nested && !top_level.recorded) return result;
+  if (!nested) top_level.recorded = false;
+
+  // Ignored statements are not sampled, so they do not count for others.
+  if (statement_ignored(
+          std::string_view(data->sql_command.str, data->sql_command.length),
+          std::string_view(data->query.str, data->query.length)))
+    return result;
+
   THD *current_thd = nullptr;
   mysql_service_status_t thd_res =
       mysql_service_mysql_current_thread_reader->get(&current_thd);
   if (thd_res != 0 || current_thd == nullptr)
     throw std::invalid_argument("Cannot extract current THD");
 
-  auto *ts = get_thd_row_stats(current_thd);
+  if (nested) {
+    nested_statement_event(current_thd, data);
+    return result;
+  }
+  if (thread_ignored(current_thd)) return result;
+
+  // Budgets apply to every statement, sampled or not.
+  if (data->event_subclass == EVENT_TRACKING_QUERY_START &&
+      workload_budgets_enabled()) {
+    workload_record_hint *hint;
+    workload_tag_hint *tags;
+    std::string_view workload = statement_workload(
+        current_thd, data->query.str, data->query.length, &hint, &tags);
+    // Returning true aborts the statement.
+    if (!workload_budget_admit(workload, hint)) return true;
+  } else if (data->event_subclass == EVENT_TRACKING_QUERY_STATUS_END &&
+             workload_budget_pending()) {
+    if (!workload_budget_statement_end(get_thd_rows_examined(current_thd)))
+      return result;
+  }
 
-  std::string workload = findWorkloadName(std::string(data->query.str));
-  record_stats(workload, ts);
+  // Skipped statements are not even parsed.
+  unsigned int weight = 1;
+  if (data->event_subclass == EVENT_TRACKING_QUERY_START) {
+    if (!sample_statement_start()) return result;
+  } else {
+    weight = sample_statement_end();
+    if (weight == 0) return result;
+  }
+
+  if (data->event_subclass == EVENT_TRACKING_QUERY_START) {
+    capture_statement_start(current_thd, data->query.length);
+    top_level.recorded = true;
+    top_level.query = data->query.str;
+    top_level.length = data->query.length;
+    top_level.resolved = false;
+    return result;
+  }
+
+  thread_stats ts;
+  get_thd_row_stats(current_thd, &ts);
+
+  workload_record_hint *hint;
+  workload_tag_hint *tags;
+  std::string_view workload = statement_workload(
+      current_thd, data->query.str, data->query.length, &hint, &tags);
+  const workload_statement_digest *digest = nullptr;
+  if (track_digests_value != 0) {
+    unsigned long long parse_ns = workload_self_stats_now();
+    digest = workload_digest_cache_find(data->query.str, data->query.length);
+    workload_self_stats_add(WORKLOAD_SELF_PARSE, parse_ns);
+  }
+  record_stats(workload, &ts, weight, digest, hint);
+  record_tag_stats(tags, &ts, weight);
+  sample_statement_recorded(workload, &ts, digest, tags);
 
   return result;
 }
 
+mysql_event_tracking_connection_subclass_t Event_tracking_implementation::
+    Event_tracking_connection_implementation::filtered_sub_events =
+        EVENT_TRACKING_CONNECTION_CONNECT |
+        EVENT_TRACKING_CONNECTION_CHANGE_USER |
+        EVENT_TRACKING_CONNECTION_PRE_AUTHENTICATE;
+bool Event_tracking_implementation::Event_tracking_connection_implementation::
+    callback(const mysql_event_tracking_connection_data *data [[maybe_unused]]) {
+  // Disconnect: flush the counters accumulated by this thread.
+  if (workload_budget_pending()) workload_budget_statement_end(0);
+  THD *current_thd = nullptr;
+  if (mysql_service_mysql_current_thread_reader->get(&current_thd) == 0 &&
+      current_thd != nullptr)
+    workload_budget_session_end(current_thd);
+  top_level.recorded = false;
+  sample_release();
+  workload_thread_cache_release();
+
+  return false;
+}
+
 IMPLEMENTS_SERVICE_EVENT_TRACKING_QUERY(workload_instrumentation);
+IMPLEMENTS_SERVICE_EVENT_TRACKING_CONNECTION(workload_instrumentation);
 
 BEGIN_COMPONENT_PROVIDES(workload_instrumentation_service)
 PROVIDES_SERVICE_EVENT_TRACKING_QUERY(workload_instrumentation),
+    PROVIDES_SERVICE_EVENT_TRACKING_CONNECTION(workload_instrumentation),
     END_COMPONENT_PROVIDES();
 
+REQUIRES_MYSQL_MUTEX_SERVICE_PLACEHOLDER;
 REQUIRES_MYSQL_RWLOCK_SERVICE_PLACEHOLDER;
+REQUIRES_PSI_MEMORY_SERVICE_PLACEHOLDER;
 
 BEGIN_COMPONENT_REQUIRES(workload_instrumentation_service)
   REQUIRES_SERVICE(log_builtins),
   REQUIRES_SERVICE(log_builtins_string),
   REQUIRES_SERVICE(mysql_current_thread_reader),
+  REQUIRES_MYSQL_MUTEX_SERVICE,
   REQUIRES_MYSQL_RWLOCK_SERVICE,
+  REQUIRES_PSI_MEMORY_SERVICE,
   REQUIRES_SERVICE(pfs_plugin_table_v1),
   REQUIRES_SERVICE_AS(pfs_plugin_column_bigint_v1, pfs_bigint),
   REQUIRES_SERVICE_AS(pfs_plugin_column_string_v2, pfs_string),
+  REQUIRES_SERVICE(component_sys_variable_register),
+  REQUIRES_SERVICE(component_sys_variable_unregister),
   END_COMPONENT_REQUIRES();
 
 /* A list of metadata to describe the Component. */
@@ -0,0 +1,466 @@
+#include "workload_instrumentation_budget.h"
+#include "workload_instrumentation_memory.h"
+#include "workload_instrumentation_parser.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysql/plugin.h>                           /* st_mysql_value */
+#include <mysqld_error.h>                           /* Errors */
+
+struct workload_budget_table;
+
+struct workload_budget {
+  char workload[WORKLOAD_NAME_MAX_LENGTH];
+  unsigned int workload_length = 0;
+  /* Limits, 0 when not set. */
+  unsigned int concurrency = 0;
+  unsigned long long rows_examined_per_second = 0;
+  unsigned long long duration_ms_per_second = 0;
+
+  /* Statements holding a concurrency slot. */
+  std::atomic<unsigned int> running{0};
+  /* Monotonic time the tokens of each rate are spent until. */
+  std::atomic<unsigned long long> rows_examined_until_ns{0};
+  std::atomic<unsigned long long> duration_until_ns{0};
+  /* Statements admitted or waiting under the budget. */
+  std::atomic<unsigned long> holders{0};
+  workload_budget_table *table = nullptr;
+};
+
+/*
+  The budgets of a value of workload_instrumentation.budgets. Tables are
+  reference counted: the variable holds a reference to its value, and each
+  budget with statements admitted or waiting under it holds one to its
+  table, so a replaced table is freed once its last statement ends.
+  Statements of workloads without a budget only read the table.
+*/
+struct workload_budget_table
+    : workload_memory_accounted<WORKLOAD_MEMORY_BUDGETS> {
+  /* The value, which the variable points to once it is published. */
+  std::string text;
+  workload_budget budgets[WORKLOAD_MAX_BUDGETS];
+  unsigned int count = 0;
+  std::atomic<unsigned long> references{1};
+  /* Session and statement that parsed it, until it is published. */
+  MYSQL_THD checked_by = nullptr;
+  unsigned long long checked_query_id = 0;
+
+  workload_budget *find(std::string_view workload) {
+    for (unsigned int i = 0; i < count; i++) {
+      if (workload == std::string_view(budgets[i].workload,
+                                       budgets[i].workload_length))
+        return &budgets[i];
+    }
+    return nullptr;
+  }
+};
+
+/*
+  Tables parsed by workload_budgets_check() and not published yet, e.g. for
+  SET PERSIST_ONLY or a SET that failed on another variable. They are freed
+  when their session parses a value in a later statement, publishes a value
+  parsed after them, or disconnects.
+*/
+static std::mutex budget_tables_mutex;
+static std::vector<workload_budget_table *> checked_tables;
+static std::atomic<size_t> checked_table_count{0};
+/*
+  Replaced tables, until their last statement ends. Those left are freed by
+  deinit: statements of a past instance do not touch their budget anymore.
+  Guarded by budget_tables_mutex.
+*/
+static std::vector<workload_budget_table *> retired_tables;
+/* The value of the variable, only changed by init, deinit and updates. */
+static workload_budget_table *published_table = nullptr;
+/* The published table, nullptr when no workload has a budget. */
+static std::atomic<workload_budget_table *> current_budgets{nullptr};
+/* Changes on init and deinit, so threads drop budgets of past instances. */
+static std::atomic<unsigned long> budget_instance{0};
+/* Statements sleeping in workload_budget_admit(), waited for by deinit. */
+static std::atomic<unsigned int> sleeping_statements{0};
+
+/* Budget state of the current statement of the thread. */
+struct budget_statement {
+  /* Held by the statement while it is set. */
+  workload_budget *budget = nullptr;
+  unsigned long instance = 0;
+  unsigned long long start_ns = 0;
+  bool holds_slot = false;
+  bool rejected = false;
+};
+
+static thread_local budget_statement current_statement;
+
+static bool parse_number(std::string_view text, unsigned long long max,
+                         unsigned long long *value) {
+  if (text.empty() || text.size() > 19) return false;
+  *value = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') return false;
+    *value = *value * 10 + (c - '0');
+  }
+  return *value > 0 && *value <= max;
+}
+
+static std::string_view trim(std::string_view text) {
+  while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+  while (!text.empty() && text.back() == ' ') text.remove_suffix(1);
+  return text;
+}
+
+/* Parses the budgets of text into table. Returns false if it is invalid. */
+static bool parse_budgets(std::string_view text, workload_budget_table *table) {
+  while (!text.empty()) {
+    size_t end = std::min(text.find(';'), text.size());
+    std::string_view item = trim(text.substr(0, end));
+    text.remove_prefix(std::min(end + 1, text.size()));
+    if (item.empty()) continue;
+
+    size_t colon = item.find(':');
+    if (colon == std::string_view::npos) return false;
+    std::string_view workload = trim(item.substr(0, colon));
+    if (workload.empty() || workload.size() > WORKLOAD_NAME_MAX_LENGTH ||
+        workloadNamePrefix(workload) != workload ||
+        table->find(workload) != nullptr ||
+        table->count == WORKLOAD_MAX_BUDGETS)
+      return false;
+
+    workload_budget &budget = table->budgets[table->count++];
+    memcpy(budget.workload, workload.data(), workload.size());
+    budget.workload_length = workload.size();
+
+    std::string_view limits = item.substr(colon + 1);
+    while (!limits.empty()) {
+      size_t comma = std::min(limits.find(','), limits.size());
+      std::string_view limit = limits.substr(0, comma);
+      limits.remove_prefix(std::min(comma + 1, limits.size()));
+
+      size_t equals = limit.find('=');
+      if (equals == std::string_view::npos) return false;
+      std::string_view key = trim(limit.substr(0, equals));
+      std::string_view number = trim(limit.substr(equals + 1));
+      unsigned long long value;
+      if (key == "concurrency" && parse_number(number, 1000000, &value)) {
+        budget.concurrency = value;
+      } else if (key == "rows_examined_per_second" &&
+                 parse_number(number, 1000000000000ULL, &value)) {
+        budget.rows_examined_per_second = value;
+      } else if (key == "duration_ms_per_second" &&
+                 parse_number(number, 1000000000ULL, &value)) {
+        budget.duration_ms_per_second = value;
+      } else {
+        return false;
+      }
+    }
+    if (budget.concurrency == 0 && budget.rows_examined_per_second == 0 &&
+        budget.duration_ms_per_second == 0)
+      return false;
+  }
+  return true;
+}
+
+/* Parses a value into a new table, nullptr if invalid. */
+static workload_budget_table *new_budget_table(std::string_view text) {
+  auto table = std::make_unique<workload_budget_table>();
+  table->text = text;
+  if (!parse_budgets(table->text, table.get())) return nullptr;
+  for (unsigned int i = 0; i < table->count; i++)
+    table->budgets[i].table = table.get();
+  return table.release();
+}
+
+static void release_budget_table(workload_budget_table *table) {
+  if (table->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+  std::lock_guard<std::mutex> lock(budget_tables_mutex);
+  retired_tables.erase(
+      std::find(retired_tables.begin(), retired_tables.end(), table));
+  delete table;
+}
+
+/*
+  Statements hold the budget of their workload, found in the published table
+  with their thread cache locked: once workload_thread_cache_flush_all()
+  returns after a table was replaced, no thread can hold one of its budgets
+  anymore unless it already did. The first holder of a budget references its
+  table.
+*/
+static void hold_budget(workload_budget *budget) {
+  if (budget->holders.fetch_add(1, std::memory_order_relaxed) == 0)
+    budget->table->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void release_budget(workload_budget *budget) {
+  // The table, which holds the budget, may be freed once it is released.
+  workload_budget_table *table = budget->table;
+  if (budget->holders.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    release_budget_table(table);
+}
+
+/* Makes table the value of the variable, nullptr at deinit. */
+static void publish_budget_table(workload_budget_table *table) {
+  workload_budget_table *replaced = published_table;
+  published_table = table;
+  current_budgets.store(table != nullptr && table->count > 0 ? table : nullptr,
+                        std::memory_order_release);
+  if (replaced == nullptr) return;
+
+  {
+    std::lock_guard<std::mutex> lock(budget_tables_mutex);
+    retired_tables.push_back(replaced);
+  }
+  workload_thread_cache_flush_all();
+  release_budget_table(replaced);
+}
+
+/*
+  Frees the unpublished tables of a session, but table, and only those parsed
+  by other statements than query_id if it is not 0. Caller must hold
+  budget_tables_mutex.
+*/
+static void free_checked_tables(MYSQL_THD thd, unsigned long long query_id,
+                                const workload_budget_table *table) {
+  auto stale = [&](workload_budget_table *checked) {
+    if (checked == table || checked->checked_by != thd ||
+        (query_id != 0 && checked->checked_query_id == query_id))
+      return false;
+    delete checked;
+    return true;
+  };
+  checked_tables.erase(
+      std::remove_if(checked_tables.begin(), checked_tables.end(), stale),
+      checked_tables.end());
+  checked_table_count.store(checked_tables.size(), std::memory_order_relaxed);
+}
+
+int workload_budgets_check(MYSQL_THD thd, SYS_VAR *, void *save,
+                           st_mysql_value *value) {
+  char buffer[1024];
+  int length = sizeof(buffer);
+  const char *text = value->val_str(value, buffer, &length);
+
+  workload_budget_table *table = new_budget_table(
+      text != nullptr ? std::string_view(text, length) : std::string_view());
+  if (table == nullptr) return 1;
+  table->checked_by = thd;
+  table->checked_query_id = get_thd_query_id(thd);
+
+  // A statement may set the variable more than once, keep its other values.
+  std::lock_guard<std::mutex> lock(budget_tables_mutex);
+  free_checked_tables(thd, table->checked_query_id, nullptr);
+  checked_tables.push_back(table);
+  checked_table_count.store(checked_tables.size(), std::memory_order_relaxed);
+  *static_cast<workload_budget_table **>(save) = table;
+  return 0;
+}
+
+void workload_budgets_update(MYSQL_THD thd, SYS_VAR *, void *var_ptr,
+                             const void *save) {
+  workload_budget_table *table =
+      *static_cast<workload_budget_table *const *>(save);
+  {
+    std::lock_guard<std::mutex> lock(budget_tables_mutex);
+    checked_tables.erase(
+        std::find(checked_tables.begin(), checked_tables.end(), table));
+    // Values the statement parsed before this one are replaced already.
+    free_checked_tables(thd, table->checked_query_id, table);
+  }
+  *static_cast<char **>(var_ptr) = table->text.data();
+  publish_budget_table(table);
+}
+
+void workload_budget_session_end(MYSQL_THD thd) {
+  if (checked_table_count.load(std::memory_order_relaxed) == 0) return;
+
+  std::lock_guard<std::mutex> lock(budget_tables_mutex);
+  free_checked_tables(thd, 0, nullptr);
+}
+
+bool workload_budgets_enabled() {
+  return current_budgets.load(std::memory_order_relaxed) != nullptr;
+}
+
+/* Whether a rate has tokens left at now, or else how long until it has. */
+static bool rate_available(const std::atomic<unsigned long long> &until_ns,
+                           unsigned long long now_ns,
+                           unsigned long long *wait_ns) {
+  unsigned long long until = until_ns.load(std::memory_order_relaxed);
+  if (until <= now_ns + WORKLOAD_BUDGET_BURST_NS) return true;
+  *wait_ns = std::max(*wait_ns, until - now_ns - WORKLOAD_BUDGET_BURST_NS);
+  return false;
+}
+
+/* Spends cost units of a rate of per_second units per second. */
+static void charge_rate(std::atomic<unsigned long long> *until_ns,
+                        unsigned long long now_ns, unsigned long long cost,
+                        unsigned long long per_second) {
+  cost = std::min(cost, ~0ULL / NANOS_PER_SECOND);
+  unsigned long long cost_ns = cost * NANOS_PER_SECOND / per_second;
+  unsigned long long until = until_ns->load(std::memory_order_relaxed);
+  while (!until_ns->compare_exchange_weak(
+      until, std::max(until, now_ns) + cost_ns, std::memory_order_relaxed)) {
+  }
+}
+
+static bool take_slot(workload_budget *budget) {
+  unsigned int running = budget->running.load(std::memory_order_relaxed);
+  do {
+    if (running >= budget->concurrency) return false;
+  } while (!budget->running.compare_exchange_weak(running, running + 1,
+                                                  std::memory_order_relaxed));
+  return true;
+}
+
+bool workload_budget_admit(std::string_view workload,
+                           workload_record_hint *hint) {
+  // A statement whose end was not seen gives its slot back first.
+  if (current_statement.budget != nullptr) workload_budget_statement_end(0);
+  current_statement.rejected = false;
+
+  unsigned long long now_ns = monotonic_clock_ns();
+  unsigned long long deadline_ns =
+      now_ns + budget_max_delay_ms_value * 1000 * NANOS_PER_MICRO;
+  bool delayed = false;
+  workload_budget *budget = nullptr;
+  // Budgets are only used with the cache locked, see hold_budget().
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  unsigned long instance = budget_instance.load(std::memory_order_relaxed);
+  while (true) {
+    // Budgets replaced while the statement waits apply from then on.
+    workload_budget_table *table =
+        current_budgets.load(std::memory_order_acquire);
+    if (budget == nullptr || budget->table != table) {
+      if (budget != nullptr) release_budget(budget);
+      budget = table != nullptr ? table->find(workload) : nullptr;
+      if (budget == nullptr) break;
+      hold_budget(budget);
+    }
+
+    unsigned long long wait_ns = 0;
+    bool available =
+        (budget->rows_examined_per_second == 0 ||
+         rate_available(budget->rows_examined_until_ns, now_ns, &wait_ns)) &&
+        (budget->duration_ms_per_second == 0 ||
+         rate_available(budget->duration_until_ns, now_ns, &wait_ns));
+    if (available && (budget->concurrency == 0 || take_slot(budget))) break;
+
+    // A statement that would wait for tokens past the deadline is rejected
+    // right away, one waiting for a slot checks again every poll interval.
+    if (now_ns >= deadline_ns ||
+        (!available && now_ns + wait_ns > deadline_ns)) {
+      release_budget(budget);
+      workload_thread_cache_unlock(cache);
+      current_statement.rejected = true;
+      record_resource(workload, WORKLOAD_RESOURCE_REJECTED, now_ns, hint);
+      return false;
+    }
+    if (available) wait_ns = WORKLOAD_BUDGET_POLL_NS;
+    sleeping_statements.fetch_add(1, std::memory_order_relaxed);
+    workload_thread_cache_unlock(cache);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(
+        std::min(wait_ns, deadline_ns - now_ns)));
+    cache = workload_thread_cache_lock();
+    sleeping_statements.fetch_sub(1, std::memory_order_release);
+    delayed = true;
+    now_ns = monotonic_clock_ns();
+
+    // Deinit freed the budgets meanwhile, and waits for sleeping statements
+    // to give up on them.
+    if (instance != budget_instance.load(std::memory_order_relaxed)) {
+      workload_thread_cache_unlock(cache);
+      return true;
+    }
+  }
+
+  if (budget != nullptr) {
+    current_statement.budget = budget;
+    current_statement.instance = instance;
+    current_statement.start_ns = now_ns;
+    current_statement.holds_slot = budget->concurrency != 0;
+  }
+  workload_thread_cache_unlock(cache);
+  if (budget != nullptr && delayed)
+    record_resource(workload, WORKLOAD_RESOURCE_THROTTLED, now_ns, hint);
+  return true;
+}
+
+bool workload_budget_pending() {
+  return current_statement.budget != nullptr || current_statement.rejected;
+}
+
+bool workload_budget_statement_end(unsigned long long rows_examined) {
+  if (current_statement.rejected) {
+    current_statement.rejected = false;
+    return false;
+  }
+
+  budget_statement statement = current_statement;
+  current_statement = budget_statement();
+  if (statement.budget == nullptr) return true;
+
+  // Budgets of a past instance of the component were freed by its deinit.
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  if (statement.instance == budget_instance.load(std::memory_order_relaxed)) {
+    workload_budget *budget = statement.budget;
+    unsigned long long now_ns = monotonic_clock_ns();
+    if (budget->rows_examined_per_second != 0)
+      charge_rate(&budget->rows_examined_until_ns, now_ns, rows_examined,
+                  budget->rows_examined_per_second);
+    if (budget->duration_ms_per_second != 0)
+      charge_rate(&budget->duration_until_ns, now_ns,
+                  (now_ns - statement.start_ns) / NANOS_PER_MICRO,
+                  budget->duration_ms_per_second * 1000);
+    if (statement.holds_slot)
+      budget->running.fetch_sub(1, std::memory_order_relaxed);
+    release_budget(budget);
+  }
+  workload_thread_cache_unlock(cache);
+  return true;
+}
+
+int workload_budget_init() {
+  budget_instance.fetch_add(1, std::memory_order_relaxed);
+
+  // The value set at startup or persisted.
+  workload_budget_table *table =
+      new_budget_table(budgets_value != nullptr ? budgets_value : "");
+  if (table == nullptr) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Invalid workload_instrumentation.budgets, no budget is "
+                    "enforced.");
+    return 0;
+  }
+  publish_budget_table(table);
+  return 0;
+}
+
+int workload_budget_deinit() {
+  // Once the caches are flushed, running statements do not touch budgets
+  // anymore, and sleeping ones give up on them when they wake up.
+  budget_instance.fetch_add(1, std::memory_order_relaxed);
+  // The variable may point into a table.
+  budgets_value = nullptr;
+  publish_budget_table(nullptr);
+  while (sleeping_statements.load(std::memory_order_acquire) != 0)
+    std::this_thread::sleep_for(
+        std::chrono::nanoseconds(WORKLOAD_BUDGET_POLL_NS));
+
+  std::lock_guard<std::mutex> lock(budget_tables_mutex);
+  for (auto table : checked_tables) delete table;
+  checked_tables.clear();
+  checked_table_count.store(0, std::memory_order_relaxed);
+  for (auto table : retired_tables) delete table;
+  retired_tables.clear();
+  return 0;
+}
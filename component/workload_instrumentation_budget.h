@@ -0,0 +1,82 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_BUDGET_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_BUDGET_H
+
+#include <string_view>
+
+#include <mysql/components/services/component_sys_var_service.h>
+
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+
+/*
+  Per workload budgets, set with workload_instrumentation.budgets as
+  `<workload>:<limit>=<value>[,<limit>=<value>...][;<workload>:...]`, with
+  limits:
+  - concurrency: statements of the workload running at the same time;
+  - rows_examined_per_second;
+  - duration_ms_per_second: milliseconds of statement time per second, e.g.
+    2000 for the equivalent of two connections always busy.
+
+  Statements of a workload with a budget are checked when they start. Rate
+  limits are token buckets, kept as the time their tokens run out until
+  (GCRA): a statement starts if its workload is less than
+  WORKLOAD_BUDGET_BURST_NS ahead of its rates, and is charged the rows it
+  examined and its duration when it ends, so a workload idle for a while can
+  burst one second of its budget. Checks and charges are atomic operations on
+  the budget, done with the thread's own cache locked so that replaced
+  budgets can be freed (see workload_thread_cache_flush_all()). Statements of
+  workloads without a budget only read the budgets.
+
+  A statement over budget waits for it for up to budget_max_delay_ms, and is
+  counted as throttled if it then starts, or fails and is counted as rejected
+  otherwise. Budgets are replaced as a whole when the variable is set: slots
+  and tokens used under the previous value are not carried over, and waiting
+  statements switch to the new budgets of their workload. Uninstalling the
+  component waits for waiting statements to give up on their budget.
+*/
+
+/* Maximum number of workloads with a budget. */
+#define WORKLOAD_MAX_BUDGETS 64
+/* How far ahead of its rates a workload may run. */
+#define WORKLOAD_BUDGET_BURST_NS NANOS_PER_SECOND
+/* Interval between checks of a statement waiting for a concurrency slot. */
+#define WORKLOAD_BUDGET_POLL_NS (1000 * NANOS_PER_MICRO)
+
+int workload_budget_init();
+int workload_budget_deinit();
+
+/* Whether any workload has a budget. Statements are only parsed when they
+   start if so. */
+bool workload_budgets_enabled();
+
+/*
+  Admits a starting statement of a workload, waiting for its budget if
+  needed. Returns false if the statement is rejected. hint is passed to
+  record_resource() to count throttled and rejected statements.
+*/
+bool workload_budget_admit(std::string_view workload,
+                           workload_record_hint *hint);
+
+/* Whether the thread has a statement admitted or rejected by a budget that
+   did not end yet. */
+bool workload_budget_pending();
+
+/*
+  Charges the statement of the thread to its budget and releases its
+  concurrency slot. Returns false if the statement was rejected when it
+  started, in which case it is not counted. Also called when the connection
+  closes, in case the end of its statement was not seen.
+*/
+bool workload_budget_statement_end(unsigned long long rows_examined);
+
+/* Frees what the session parsed for the variable without publishing it. */
+void workload_budget_session_end(MYSQL_THD thd);
+
+/* Check and update functions of workload_instrumentation.budgets: values are
+   parsed when checked, and published when updated. */
+int workload_budgets_check(MYSQL_THD thd, SYS_VAR *var, void *save,
+                           st_mysql_value *value);
+void workload_budgets_update(MYSQL_THD thd, SYS_VAR *var, void *var_ptr,
+                             const void *save);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_BUDGET_H
@@ -0,0 +1,41 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_CLOCK_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_CLOCK_H
+
+#include <time.h>
+
+#define NANOS_PER_MICRO 1000ULL
+#define NANOS_PER_SECOND 1000000000ULL
+#define NANOS_PER_MINUTE (60 * NANOS_PER_SECOND)
+
+static inline unsigned long long timespec_ns(const timespec &ts) {
+  return ts.tv_sec * NANOS_PER_SECOND + ts.tv_nsec;
+}
+
+/*
+  Statement durations are measured with CLOCK_MONOTONIC, which is served from
+  the vDSO and does not jump when the wall clock is stepped. It is slewed by
+  NTP (adjtime) though, by at most 500ppm, which is negligible for durations.
+  Only CLOCK_MONOTONIC_RAW is not, but kernels before 5.3 serve it through a
+  system call.
+*/
+static inline unsigned long long monotonic_clock_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return timespec_ns(ts);
+}
+
+/* User plus system CPU time consumed so far by the calling thread. */
+static inline unsigned long long thread_cpu_clock_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return timespec_ns(ts);
+}
+
+/* Wall clock, in the same unit as THD::start_utime. */
+static inline unsigned long long realtime_clock_us() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return timespec_ns(ts) / NANOS_PER_MICRO;
+}
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_CLOCK_H
@@ -0,0 +1,503 @@
+#include "workload_instrumentation_digest.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+extern mysql_service_pfs_plugin_column_string_v2_t *pfs_string;
+extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
+
+namespace {
+
+inline bool is_word_char(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '$' || c >= 0x80;
+}
+
+inline bool is_space(unsigned char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+/* Builds the normalized text and its hash, one token at a time. */
+class digest_builder {
+ public:
+  explicit digest_builder(workload_statement_digest *digest)
+      : m_digest(digest) {
+    m_digest->hash = 14695981039346656037ULL;
+    m_digest->text_length = 0;
+  }
+
+  /* A literal, or a list of them separated by commas, becomes a `?`. */
+  void literal() {
+    if (m_last_literal && m_pending_comma) {
+      m_pending_comma = false;
+      m_pending_space = false;
+      return;
+    }
+    start_token('?');
+    put('?');
+    m_last_literal = true;
+  }
+
+  /* Whitespace and comments only separate tokens. */
+  void space() { m_pending_space = true; }
+
+  /* Commas after a literal wait for the next token, in case it is one. */
+  void comma() {
+    if (m_last_literal && !m_pending_comma) {
+      m_pending_comma = true;
+      return;
+    }
+    start_token(',');
+    put(',');
+  }
+
+  void word(const char *p, size_t length) {
+    start_token(p[0]);
+    for (size_t i = 0; i < length; i++) {
+      char c = p[i];
+      put(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+  }
+
+  void symbol(const char *p, size_t length) {
+    start_token(p[0]);
+    for (size_t i = 0; i < length; i++) put(p[i]);
+  }
+
+  void finish() {
+    if (m_pending_comma) put(',');
+    if (m_digest->hash == 0) m_digest->hash = 1;
+
+    // Do not cut the text in the middle of a multibyte character.
+    unsigned int length = m_digest->text_length;
+    if (length == WORKLOAD_DIGEST_TEXT_LENGTH) {
+      unsigned int start = length;
+      while (start > 0 && (m_digest->text[start - 1] & 0xC0) == 0x80) start--;
+      if (start > 0 && (m_digest->text[start - 1] & 0x80) != 0) {
+        unsigned char lead = m_digest->text[start - 1];
+        unsigned int bytes = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+        if (length - (start - 1) < bytes) m_digest->text_length = start - 1;
+      }
+    }
+  }
+
+ private:
+  void start_token(char first) {
+    if (m_pending_comma) {
+      put(',');
+      m_pending_comma = false;
+    }
+    /*
+      Only spaces between words are hashed, so `id=1` and `id = 1` have the
+      same digest. Other spaces are kept in the text, to make it readable.
+    */
+    bool word_before = is_word_char(m_last) || m_last == '?';
+    if (word_before && (is_word_char(first) || first == '?'))
+      put(' ');
+    else if (m_pending_space && m_last != 0)
+      put_text(' ');
+    m_pending_space = false;
+    m_last_literal = false;
+  }
+
+  void put(char c) {
+    m_digest->hash ^= static_cast<unsigned char>(c);
+    m_digest->hash *= 1099511628211ULL;
+    put_text(c);
+  }
+
+  void put_text(char c) {
+    if (m_digest->text_length < WORKLOAD_DIGEST_TEXT_LENGTH)
+      m_digest->text[m_digest->text_length++] = c;
+    m_last = c;
+  }
+
+  workload_statement_digest *m_digest;
+  char m_last = 0;
+  bool m_last_literal = false;
+  bool m_pending_comma = false;
+  bool m_pending_space = false;
+};
+
+/* Skips a quoted string, p points to the opening quote. */
+const char *skip_quoted(const char *p, const char *end) {
+  char quote = *p++;
+  while (p < end) {
+    if (*p == '\\') {
+      p += 2;
+    } else if (*p == quote) {
+      // A doubled quote is part of the string.
+      if (p + 1 < end && p[1] == quote) {
+        p += 2;
+      } else {
+        return p + 1;
+      }
+    } else {
+      p++;
+    }
+  }
+  return end;
+}
+
+const char *skip_line(const char *p, const char *end) {
+  auto lf = static_cast<const char *>(memchr(p, '\n', end - p));
+  return lf != nullptr ? lf + 1 : end;
+}
+
+}  // namespace
+
+void compute_statement_digest(const char *query, size_t length,
+                              workload_statement_digest *digest) {
+  digest_builder builder(digest);
+  if (length > WORKLOAD_DIGEST_MAX_SCAN_LENGTH)
+    length = WORKLOAD_DIGEST_MAX_SCAN_LENGTH;
+  const char *p = query;
+  const char *end = query == nullptr ? query : query + length;
+
+  while (p < end) {
+    unsigned char c = *p;
+
+    if (is_space(c)) {
+      p++;
+      builder.space();
+    } else if (c == '/' && p + 1 < end && p[1] == '*') {
+      size_t stop = std::string_view(p + 2, end - p - 2).find("*/");
+      p = stop != std::string_view::npos ? p + 2 + stop + 2 : end;
+      builder.space();
+    } else if (c == '#' ||
+               (c == '-' && p + 2 < end && p[1] == '-' && is_space(p[2]))) {
+      p = skip_line(p, end);
+      builder.space();
+    } else if (c == '\'' || c == '"') {
+      p = skip_quoted(p, end);
+      builder.literal();
+    } else if (c >= '0' && c <= '9') {
+      // Numbers, including 1.5e3 and 0x1F.
+      while (p < end && (is_word_char(*p) || *p == '.')) p++;
+      builder.literal();
+    } else if (is_word_char(c)) {
+      const char *start = p;
+      while (p < end && is_word_char(*p)) p++;
+      builder.word(start, p - start);
+    } else if (c == '`') {
+      const char *start = p;
+      p = skip_quoted(p, end);
+      builder.symbol(start, p - start);
+    } else if (c == ',') {
+      p++;
+      builder.comma();
+    } else {
+      builder.symbol(p, 1);
+      p++;
+    }
+  }
+
+  builder.finish();
+}
+
+/*
+  Adds to an entry if it still holds the digest. Only fails when the entry is
+  replaced concurrently, which cannot happen while holding the spin lock.
+*/
+static bool add_to_entry(workload_digest_entry *entry,
+                         const workload_digest_counters &delta) {
+  entry->updates_started.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  bool same = entry->digest.load(std::memory_order_relaxed) == delta.digest;
+  if (same) {
+    entry->count_queries.fetch_add(delta.count_queries,
+                                   std::memory_order_relaxed);
+    entry->count_error.fetch_add(delta.count_error, std::memory_order_relaxed);
+    entry->sum_rows_examined.fetch_add(delta.sum_rows_examined,
+                                       std::memory_order_relaxed);
+    entry->sum_rows_sent.fetch_add(delta.sum_rows_sent,
+                                   std::memory_order_relaxed);
+    entry->sum_duration_ns.fetch_add(delta.sum_duration_ns,
+                                     std::memory_order_relaxed);
+  }
+
+  entry->updates_done.fetch_add(1, std::memory_order_release);
+  return same;
+}
+
+/* Caller must hold the spin lock. */
+static void replace_entry(workload_digest_entry *entry,
+                          const workload_digest_counters &delta,
+                          unsigned long long error) {
+  entry->updates_started.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  entry->digest.store(delta.digest, std::memory_order_relaxed);
+  entry->count_queries.store(delta.count_queries, std::memory_order_relaxed);
+  entry->count_error.store(delta.count_error + error,
+                           std::memory_order_relaxed);
+  entry->sum_rows_examined.store(delta.sum_rows_examined,
+                                 std::memory_order_relaxed);
+  entry->sum_rows_sent.store(delta.sum_rows_sent, std::memory_order_relaxed);
+  entry->sum_duration_ns.store(delta.sum_duration_ns,
+                               std::memory_order_relaxed);
+  entry->text_length.store(delta.text_length, std::memory_order_relaxed);
+  for (unsigned int i = 0; i < entry->text.size(); i++) {
+    unsigned long long word = 0;
+    if (i * 8 < delta.text_length)
+      memcpy(&word, delta.text + i * 8,
+             std::min<unsigned int>(8, delta.text_length - i * 8));
+    entry->text[i].store(word, std::memory_order_relaxed);
+  }
+
+  entry->updates_done.fetch_add(1, std::memory_order_release);
+}
+
+void workload_top_digests::add(const workload_digest_counters &delta) {
+  for (auto &entry : entries) {
+    if (entry.digest.load(std::memory_order_relaxed) == delta.digest &&
+        add_to_entry(&entry, delta))
+      return;
+  }
+
+  for (unsigned int attempt = 1;
+       replacing.exchange(true, std::memory_order_acquire); attempt++) {
+    if (attempt % WORKLOAD_SNAPSHOT_SPINS == 0) std::this_thread::yield();
+  }
+
+  // Smallest estimated count, empty entries first.
+  workload_digest_entry *victim = nullptr;
+  unsigned long long victim_count = ~0ULL;
+  for (auto &entry : entries) {
+    unsigned long long digest = entry.digest.load(std::memory_order_relaxed);
+    if (digest == delta.digest) {
+      add_to_entry(&entry, delta);
+      victim = nullptr;
+      break;
+    }
+    unsigned long long count =
+        digest == 0 ? 0
+                    : entry.count_queries.load(std::memory_order_relaxed) +
+                          entry.count_error.load(std::memory_order_relaxed);
+    if (count < victim_count) {
+      victim = &entry;
+      victim_count = count;
+    }
+  }
+  if (victim != nullptr) replace_entry(victim, delta, victim_count);
+
+  replacing.store(false, std::memory_order_release);
+}
+
+bool workload_top_digests::load(unsigned int entry,
+                                workload_digest_counters *counters) const {
+  auto &src = entries[entry];
+  workload_digest_counters copy;
+  for (unsigned int attempt = 1;; attempt++) {
+    unsigned int done = src.updates_done.load(std::memory_order_acquire);
+
+    copy.digest = src.digest.load(std::memory_order_relaxed);
+    copy.count_queries = src.count_queries.load(std::memory_order_relaxed);
+    copy.count_error = src.count_error.load(std::memory_order_relaxed);
+    copy.sum_rows_examined =
+        src.sum_rows_examined.load(std::memory_order_relaxed);
+    copy.sum_rows_sent = src.sum_rows_sent.load(std::memory_order_relaxed);
+    copy.sum_duration_ns = src.sum_duration_ns.load(std::memory_order_relaxed);
+    copy.text_length = src.text_length.load(std::memory_order_relaxed);
+    for (unsigned int i = 0; i < src.text.size(); i++) {
+      unsigned long long word = src.text[i].load(std::memory_order_relaxed);
+      memcpy(copy.text + i * 8, &word, 8);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (src.updates_started.load(std::memory_order_relaxed) == done) break;
+    if (attempt % WORKLOAD_SNAPSHOT_SPINS == 0) std::this_thread::yield();
+  }
+
+  if (copy.digest == 0) return false;
+  *counters = copy;
+  return true;
+}
+
+void workload_top_digests::reset() {
+  replacing.store(false, std::memory_order_relaxed);
+  for (auto &entry : entries) {
+    entry.updates_started.store(0, std::memory_order_relaxed);
+    entry.updates_done.store(0, std::memory_order_relaxed);
+    entry.digest.store(0, std::memory_order_relaxed);
+    entry.count_queries.store(0, std::memory_order_relaxed);
+    entry.count_error.store(0, std::memory_order_relaxed);
+    entry.sum_rows_examined.store(0, std::memory_order_relaxed);
+    entry.sum_rows_sent.store(0, std::memory_order_relaxed);
+    entry.sum_duration_ns.store(0, std::memory_order_relaxed);
+    entry.text_length.store(0, std::memory_order_relaxed);
+    for (auto &word : entry.text) word.store(0, std::memory_order_relaxed);
+  }
+}
+
+/* Access to PS table */
+int workload_instrumentation_top_digests_delete_all_rows() { return 0; }
+
+PSI_table_handle *workload_instrumentation_top_digests_open_table(
+    PSI_pos **pos) {
+  // Make digests accumulated by all threads visible to this read.
+  workload_thread_cache_flush_all();
+
+  auto temp = new workload_instrumentation_top_digests_table_handle();
+  temp->m_open_ns = workload_self_stats_start();
+  temp->m_records = workload_record_slots();
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return (PSI_table_handle *)temp;
+}
+
+void workload_instrumentation_top_digests_close_table(
+    PSI_table_handle *handle) {
+  auto temp = (workload_instrumentation_top_digests_table_handle *)handle;
+  workload_self_stats_add(WORKLOAD_SELF_TABLE_SCAN, temp->m_open_ns);
+  delete temp;
+}
+
+/*
+  Copies the first tracked digest of the record in the current slot, from the
+  current entry on. Returns whether there was one.
+*/
+static bool workload_instrumentation_top_digests_copy_slot(
+    workload_instrumentation_top_digests_table_handle *th) {
+  if (workload_records_rdlock() != 0) return false;
+
+  bool copied = false;
+  auto record = workload_record_at(th->m_pos.get_index());
+  for (; record != nullptr && th->m_pos.get_entry() < WORKLOAD_TOP_DIGESTS;
+       th->m_pos.next_entry()) {
+    auto &row = th->m_current_row;
+    if (!record->top_digests.load(th->m_pos.get_entry(), &row.counters))
+      continue;
+
+    memcpy(row.workload, record->workload, record->workload_length + 1);
+    copied = true;
+    break;
+  }
+
+  workload_records_unlock();
+  return copied;
+}
+
+/* Only tracked digests are returned as rows. */
+int workload_instrumentation_top_digests_rnd_next(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_top_digests_table_handle *)handle;
+
+  for (th->m_pos.set_at(&th->m_next_pos);
+       th->m_pos.get_index() < th->m_records; th->m_pos.next_workload()) {
+    if (workload_instrumentation_top_digests_copy_slot(th)) {
+      th->m_next_pos.set_after(&th->m_pos);
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int workload_instrumentation_top_digests_rnd_init(PSI_table_handle *handle,
+                                                  bool) {
+  auto th = (workload_instrumentation_top_digests_table_handle *)handle;
+  th->m_records = workload_record_slots();
+  return 0;
+}
+
+int workload_instrumentation_top_digests_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_top_digests_table_handle *)handle;
+
+  if (th->m_pos.get_entry() < WORKLOAD_TOP_DIGESTS)
+    workload_instrumentation_top_digests_copy_slot(th);
+  return 0;
+}
+
+void workload_instrumentation_top_digests_reset_position(
+    PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_top_digests_table_handle *)handle;
+  th->m_pos.reset();
+  th->m_next_pos.reset();
+}
+
+int workload_instrumentation_top_digests_read_column_value(
+    PSI_table_handle *handle, PSI_field *field, unsigned int index) {
+  auto th = (workload_instrumentation_top_digests_table_handle *)handle;
+  auto &row = th->m_current_row;
+
+  switch (index) {
+    case 0: /* WORKLOAD */
+      pfs_string->set_varchar_utf8mb4(field, row.workload);
+      break;
+    case 1: { /* DIGEST */
+      char digest[17];
+      snprintf(digest, sizeof(digest), "%016llx", row.counters.digest);
+      pfs_string->set_varchar_utf8mb4_len(field, digest, 16);
+      break;
+    }
+    case 2: /* DIGEST_TEXT */
+      pfs_string->set_varchar_utf8mb4_len(field, row.counters.text,
+                                          row.counters.text_length);
+      break;
+    case 3: /* COUNT_QUERIES */
+      pfs_bigint->set_unsigned(field, {row.counters.count_queries, false});
+      break;
+    case 4: /* COUNT_ERROR */
+      pfs_bigint->set_unsigned(field, {row.counters.count_error, false});
+      break;
+    case 5: /* SUM_ROWS_EXAMINED */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_examined, false});
+      break;
+    case 6: /* SUM_ROWS_SENT */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_sent, false});
+      break;
+    case 7: /* SUM_DURATION_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_duration_ns / NANOS_PER_MICRO, false});
+      break;
+    default: /* We should never reach here */
+      assert(0);
+  }
+  return 0;
+}
+
+unsigned long long workload_instrumentation_top_digests_get_row_count(void) {
+  return workload_record_slots() * WORKLOAD_TOP_DIGESTS;
+}
+
+void init_workload_instrumentation_top_digests_share(
+    PFS_engine_table_share_proxy *share) {
+  share->m_table_name = "workload_instrumentation_top_digests";
+  share->m_table_name_length = 36;
+  share->m_table_definition =
+      "`WORKLOAD` varchar(50), `DIGEST` varchar(16), "
+      "`DIGEST_TEXT` varchar(64), `COUNT_QUERIES` BIGINT UNSIGNED, "
+      "`COUNT_ERROR` BIGINT UNSIGNED, `SUM_ROWS_EXAMINED` BIGINT UNSIGNED, "
+      "`SUM_ROWS_SENT` BIGINT UNSIGNED, `SUM_DURATION_US` BIGINT UNSIGNED";
+  share->m_ref_length = sizeof(workload_instrumentation_top_digests_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = workload_instrumentation_top_digests_get_row_count;
+  share->delete_all_rows =
+      workload_instrumentation_top_digests_delete_all_rows;
+
+  share->m_proxy_engine_table = {
+      workload_instrumentation_top_digests_rnd_next,
+      workload_instrumentation_top_digests_rnd_init,
+      workload_instrumentation_top_digests_rnd_pos,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_top_digests_read_column_value,
+      workload_instrumentation_top_digests_reset_position,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_top_digests_open_table,
+      workload_instrumentation_top_digests_close_table};
+}
@@ -0,0 +1,140 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_DIGEST_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_DIGEST_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+#include "workload_instrumentation_index.h"
+
+/*
+  Statement digests. Query events carry no digest, so statements are
+  normalized while hashing their text: comments are skipped, literals are
+  replaced by `?` (lists of literals by a single one), words are lowercased
+  and whitespace only separates words. Only the first
+  WORKLOAD_DIGEST_MAX_SCAN_LENGTH bytes of the query are hashed, and the first
+  WORKLOAD_DIGEST_TEXT_LENGTH bytes of the normalized text are kept to show.
+*/
+#define WORKLOAD_DIGEST_MAX_SCAN_LENGTH 1024
+#define WORKLOAD_DIGEST_TEXT_LENGTH 64
+
+struct workload_statement_digest {
+  /* 64 bit FNV-1a of the normalized text, never 0. */
+  unsigned long long hash;
+  unsigned int text_length;
+  char text[WORKLOAD_DIGEST_TEXT_LENGTH];
+};
+
+/* Normalizes and hashes a statement in a single pass, without allocating. */
+void compute_statement_digest(const char *query, size_t length,
+                              workload_statement_digest *digest);
+
+/*
+  Heavy hitters of a workload: the WORKLOAD_TOP_DIGESTS digests with most
+  statements, tracked with the space-saving algorithm. A new digest replaces
+  the one with the fewest statements, whose count is kept as the error of the
+  new one: the digest ran between count_queries and count_queries +
+  count_error times. Other sums only cover statements since it was tracked.
+
+  Statements are accumulated in the thread caches (see
+  workload_instrumentation_thread_cache.h) and added when they are flushed:
+  a tracked digest only takes a few atomic increments per flush. Replacing
+  a digest takes a per workload spin lock; a statement of the replaced digest
+  finishing at the same time may be counted in the new one. Memory per
+  workload is 1KiB with 8 digests.
+*/
+#define WORKLOAD_TOP_DIGESTS 8
+
+/* Plain copy of a tracked digest, also used to add statements. */
+struct workload_digest_counters {
+  unsigned long long digest = 0;
+  unsigned int text_length = 0;
+  char text[WORKLOAD_DIGEST_TEXT_LENGTH];
+  unsigned long long count_queries = 0;
+  unsigned long long count_error = 0;
+  unsigned long long sum_rows_examined = 0;
+  unsigned long long sum_rows_sent = 0;
+  unsigned long long sum_duration_ns = 0;
+};
+
+struct workload_digest_entry {
+  /* Same seqlock as workload_counter_shard. */
+  std::atomic<unsigned int> updates_started{0};
+  std::atomic<unsigned int> updates_done{0};
+  /* 0 while the entry is empty. */
+  std::atomic<unsigned long long> digest{0};
+  std::atomic<unsigned long long> count_queries{0};
+  std::atomic<unsigned long long> count_error{0};
+  std::atomic<unsigned long long> sum_rows_examined{0};
+  std::atomic<unsigned long long> sum_rows_sent{0};
+  std::atomic<unsigned long long> sum_duration_ns{0};
+  std::atomic<unsigned int> text_length{0};
+  /* Normalized text, 8 bytes per word so readers can copy it atomically. */
+  std::array<std::atomic<unsigned long long>, WORKLOAD_DIGEST_TEXT_LENGTH / 8>
+      text{};
+};
+
+struct workload_top_digests {
+  std::atomic<bool> replacing{false};
+  std::array<workload_digest_entry, WORKLOAD_TOP_DIGESTS> entries;
+
+  /* Adds statements of a digest, replacing the smallest one if needed. */
+  void add(const workload_digest_counters &delta);
+  /* Copies a consistent entry, returns false if it is empty. */
+  bool load(unsigned int entry, workload_digest_counters *counters) const;
+  /* Only allowed while no thread can update or read the digests. */
+  void reset();
+};
+
+/* P_S table performance_schema.workload_instrumentation_top_digests */
+class workload_instrumentation_top_digests_POS {
+ private:
+  unsigned int m_index = 0;
+  unsigned int m_entry = 0;
+
+ public:
+  ~workload_instrumentation_top_digests_POS() = default;
+  workload_instrumentation_top_digests_POS() = default;
+
+  void reset() {
+    m_index = 0;
+    m_entry = 0;
+  }
+  unsigned int get_index() { return m_index; }
+  unsigned int get_entry() { return m_entry; }
+  void set_at(workload_instrumentation_top_digests_POS *pos) {
+    m_index = pos->m_index;
+    m_entry = pos->m_entry;
+  }
+  void set_after(workload_instrumentation_top_digests_POS *pos) {
+    m_index = pos->m_index;
+    m_entry = pos->m_entry + 1;
+  }
+  void next_workload() {
+    m_index++;
+    m_entry = 0;
+  }
+  void next_entry() { m_entry++; }
+};
+
+struct workload_instrumentation_top_digests_row {
+  char workload[WORKLOAD_NAME_MAX_LENGTH + 1];
+  workload_digest_counters counters;
+};
+
+struct workload_instrumentation_top_digests_table_handle {
+  workload_instrumentation_top_digests_POS m_pos;
+  workload_instrumentation_top_digests_POS m_next_pos;
+  workload_instrumentation_top_digests_row m_current_row;
+  /* Record slots used when the scan started, later ones are not returned. */
+  size_t m_records;
+  /* Monotonic time the table was opened, for self stats. */
+  unsigned long long m_open_ns;
+};
+
+void init_workload_instrumentation_top_digests_share(
+    PFS_engine_table_share_proxy *share);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_DIGEST_H
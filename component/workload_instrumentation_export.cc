@@ -0,0 +1,293 @@
+#include "workload_instrumentation_export.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sysvars.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysqld_error.h> /* Errors */
+
+static std::thread export_thread;
+static std::mutex export_mutex;
+static std::condition_variable export_stop_cond;
+static bool export_stop = false;
+static std::string export_path;
+
+/* A counter of every workload, from a field of its row. */
+struct export_metric {
+  const char *name;
+  const char *help;
+  const char *type;
+  unsigned long long workload_counters::*field;
+  /* Counters in nanoseconds are exported in seconds. */
+  bool nanos;
+};
+
+static const export_metric export_metrics[] = {
+    {"mysql_workload_rows_examined_total", "Rows examined by the workload.",
+     "counter", &workload_counters::sum_rows_examined, false},
+    {"mysql_workload_rows_sent_total", "Rows sent to the workload.",
+     "counter", &workload_counters::sum_rows_sent, false},
+    {"mysql_workload_rows_affected_total", "Rows affected by the workload.",
+     "counter", &workload_counters::sum_rows_affected, false},
+    {"mysql_workload_lock_time_seconds_total",
+     "Time the workload spent acquiring locks.", "counter",
+     &workload_counters::sum_lock_time_ns, true},
+    {"mysql_workload_cpu_time_seconds_total",
+     "CPU time, user plus system, used by the workload.", "counter",
+     &workload_counters::sum_cpu_time_ns, true},
+};
+
+/* Counters of workload_counters::resources, in workload_resource order. */
+static const export_metric export_resource_metrics[] = {
+    {"mysql_workload_created_tmp_disk_tables_total",
+     "Internal temporary tables created on disk by the workload.", "counter",
+     nullptr, false},
+    {"mysql_workload_sort_merge_passes_total",
+     "Merge passes of the sorts of the workload.", "counter", nullptr, false},
+    {"mysql_workload_select_full_join_total",
+     "Joins without index run by the workload.", "counter", nullptr, false},
+    {"mysql_workload_select_scan_total",
+     "Joins of the workload starting with a full scan.", "counter", nullptr,
+     false},
+    {"mysql_workload_bytes_sent_total", "Bytes sent to the workload.",
+     "counter", nullptr, false},
+    {"mysql_workload_bytes_received_total",
+     "Bytes received from the workload.", "counter", nullptr, false},
+    {"mysql_workload_errors_total", "Queries of the workload that failed.",
+     "counter", nullptr, false},
+    {"mysql_workload_warnings_total",
+     "Errors, warnings and notes raised by the workload.", "counter", nullptr,
+     false},
+    {"mysql_workload_timeouts_total",
+     "Queries of the workload interrupted by max_execution_time.", "counter",
+     nullptr, false},
+    {"mysql_workload_throttled_total",
+     "Queries of the workload delayed by its budget.", "counter", nullptr,
+     false},
+    {"mysql_workload_rejected_total",
+     "Queries of the workload rejected by its budget.", "counter", nullptr,
+     false},
+    {"mysql_workload_nested_queries_total",
+     "Queries run by stored programs of the workload.", "counter", nullptr,
+     false},
+    {"mysql_workload_nested_rows_examined_total",
+     "Rows examined by queries run by stored programs of the workload.",
+     "counter", nullptr, false},
+    {"mysql_workload_nested_rows_sent_total",
+     "Rows sent by queries run by stored programs of the workload.", "counter",
+     nullptr, false},
+    {"mysql_workload_nested_rows_affected_total",
+     "Rows affected by queries run by stored programs of the workload.",
+     "counter", nullptr, false},
+    {"mysql_workload_nested_duration_seconds_total",
+     "Wallclock duration of queries run by stored programs of the workload.",
+     "counter", nullptr, true},
+};
+
+static_assert(std::size(export_resource_metrics) == WORKLOAD_RESOURCES);
+
+static void append(workload_export_text *text, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void append(workload_export_text *text, const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length > 0)
+    text->append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+/* Appends `{workload="<name>"` with the name escaped as a label value. */
+static void append_workload_label(workload_export_text *text,
+                                  const char *workload) {
+  text->append("{workload=\"");
+  for (const char *c = workload; *c != '\0'; c++) {
+    if (*c == '\\' || *c == '"') text->push_back('\\');
+    text->push_back(*c);
+  }
+  text->push_back('"');
+}
+
+static void append_seconds(workload_export_text *text, unsigned long long ns) {
+  unsigned long long us = ns / NANOS_PER_MICRO;
+  append(text, "%llu.%06llu\n", us / 1000000, us % 1000000);
+}
+
+static void append_header(workload_export_text *text, const char *name,
+                          const char *help, const char *type) {
+  append(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void workload_export_format(workload_export_text *text) {
+  static thread_local workload_memory_vector<workload_instrumentation_row,
+                                            WORKLOAD_MEMORY_EXPORT>
+      rows;
+  rows.clear();
+
+  size_t slots = workload_record_slots();
+  for (size_t slot = 0; slot < slots; slot++) {
+    if (workload_records_rdlock() != 0) break;
+    auto record = workload_record_at(slot);
+    if (record != nullptr) {
+      rows.emplace_back();
+      workload_instrumentation_copy_record(&rows.back(), record);
+    }
+    workload_records_unlock();
+  }
+
+  text->clear();
+  const char *duration = "mysql_workload_query_duration_seconds";
+  append_header(text, duration,
+                "Wallclock duration of the queries of the workload.",
+                "summary");
+  for (auto &row : rows) {
+    const std::pair<const char *, unsigned long long> quantiles[] = {
+        {"0.5", row.p50_us}, {"0.95", row.p95_us}, {"0.99", row.p99_us}};
+    for (auto &quantile : quantiles) {
+      text->append(duration);
+      append_workload_label(text, row.workload);
+      append(text, ",quantile=\"%s\"} ", quantile.first);
+      append_seconds(text, quantile.second * NANOS_PER_MICRO);
+    }
+    append(text, "%s_sum", duration);
+    append_workload_label(text, row.workload);
+    text->append("} ");
+    append_seconds(text, row.counters.sum_query_duration_ns);
+    append(text, "%s_count", duration);
+    append_workload_label(text, row.workload);
+    append(text, "} %llu\n", row.counters.count_queries);
+  }
+
+  for (auto &metric : export_metrics) {
+    append_header(text, metric.name, metric.help, metric.type);
+    for (auto &row : rows) {
+      text->append(metric.name);
+      append_workload_label(text, row.workload);
+      text->append("} ");
+      if (metric.nanos)
+        append_seconds(text, row.counters.*metric.field);
+      else
+        append(text, "%llu\n", row.counters.*metric.field);
+    }
+  }
+
+  for (int i = 0; i < WORKLOAD_RESOURCES; i++) {
+    auto &metric = export_resource_metrics[i];
+    append_header(text, metric.name, metric.help, metric.type);
+    for (auto &row : rows) {
+      text->append(metric.name);
+      append_workload_label(text, row.workload);
+      text->append("} ");
+      if (metric.nanos)
+        append_seconds(text, row.counters.resources[i]);
+      else
+        append(text, "%llu\n", row.counters.resources[i]);
+    }
+  }
+
+  const char *timestamp = "mysql_workload_export_timestamp_seconds";
+  append_header(text, timestamp, "Unix time the counters were exported at.",
+                "gauge");
+  append(text, "%s %lld\n", timestamp, (long long)time(nullptr));
+
+  // A label, as a gauge could not hold the 64 bits of the id exactly.
+  const char *info = "mysql_workload_counters_info";
+  append_header(text, info,
+                "Boot id of the counters, which changes when they restart "
+                "from zero.",
+                "gauge");
+  append(text, "%s{boot_id=\"%016llx\"} 1\n", info,
+         workload_counters_boot_id());
+}
+
+/* Writes the file next to its final path, then renames it over it. */
+static bool write_export_file(const workload_export_text &text) {
+  std::string temp_path = export_path + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr) return false;
+
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  if (fclose(file) != 0) written = false;
+  if (written && rename(temp_path.c_str(), export_path.c_str()) == 0)
+    return true;
+
+  int error = errno;
+  remove(temp_path.c_str());
+  errno = error;
+  return false;
+}
+
+static void export_loop() {
+  workload_export_text text;
+  bool failing = false;
+
+  std::unique_lock<std::mutex> lock(export_mutex);
+  while (!export_stop) {
+    lock.unlock();
+    workload_export_format(&text);
+    bool written = write_export_file(text);
+    // Only log when the export starts or stops failing.
+    if (!written && !failing) {
+      LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                      "Failed to write workload_instrumentation.export_file "
+                      "%s: %s",
+                      export_path.c_str(), strerror(errno));
+    } else if (written && failing) {
+      LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
+                      "Writing workload_instrumentation.export_file again");
+    }
+    failing = !written;
+    lock.lock();
+
+    export_stop_cond.wait_for(
+        lock, std::chrono::milliseconds(export_interval_ms_value),
+        [] { return export_stop; });
+  }
+}
+
+int workload_export_init() {
+  if (export_file_value == nullptr || export_file_value[0] == '\0') return 0;
+
+  export_path = export_file_value;
+  export_stop = false;
+  try {
+    export_thread = std::thread(export_loop);
+  } catch (const std::system_error &) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to start the export thread.");
+    return 1;
+  }
+
+  return 0;
+}
+
+int workload_export_deinit() {
+  if (!export_thread.joinable()) return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(export_mutex);
+    export_stop = true;
+  }
+  export_stop_cond.notify_one();
+  export_thread.join();
+
+  // Do not leave counters behind that are no longer updated.
+  remove(export_path.c_str());
+  return 0;
+}
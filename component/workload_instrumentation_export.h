@@ -0,0 +1,31 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_EXPORT_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_EXPORT_H
+
+#include "workload_instrumentation_memory.h"
+
+/*
+  Export of the workload counters without SQL. When
+  workload_instrumentation.export_file is set, a background thread writes the
+  counters of all workloads to it every export_interval_ms, in Prometheus text
+  format, so a local agent (e.g. the node_exporter textfile collector) can
+  read them. The file is written next to its final path and renamed over it,
+  so readers always see a complete snapshot. It is removed when the component
+  is deinitialized.
+
+  The thread copies one record at a time under the records read lock, as P_S
+  readers do, and formats them without holding any lock. It does not flush
+  the thread caches, so counters lag by up to flush_interval_ms.
+*/
+
+/* Starts the export thread if workload_instrumentation.export_file is set. */
+int workload_export_init();
+/* Stops the export thread and removes the file. */
+int workload_export_deinit();
+
+/* Text of the export file, whose size grows with the number of workloads. */
+using workload_export_text = workload_memory_string<WORKLOAD_MEMORY_EXPORT>;
+
+/* Formats the counters of all workloads, replacing the contents of text. */
+void workload_export_format(workload_export_text *text);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_EXPORT_H
@@ -0,0 +1,130 @@
+#include "workload_instrumentation_filter.h"
+#include "workload_instrumentation_sysvars.h"
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Parsed workload_instrumentation.ignore_commands, lowercase. */
+static std::vector<std::string> ignored_commands;
+
+struct ignored_account {
+  std::string user;
+  /* Empty matches any host. */
+  std::string host;
+};
+/* Parsed workload_instrumentation.ignore_users. */
+static std::vector<ignored_account> ignored_accounts;
+
+/* Calls on_item with each non empty, trimmed item of a comma separated list. */
+template <typename F>
+static void for_each_item(const char *list, F on_item) {
+  std::string_view items(list == nullptr ? "" : list);
+
+  while (!items.empty()) {
+    size_t comma = items.find(',');
+    std::string_view item = items.substr(0, comma);
+    items = comma == std::string_view::npos ? std::string_view()
+                                            : items.substr(comma + 1);
+
+    while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+    while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+    if (!item.empty()) on_item(item);
+  }
+}
+
+int workload_filter_init() {
+  ignored_commands.clear();
+  for_each_item(ignore_commands_value, [](std::string_view item) {
+    std::string command(item);
+    for (auto &c : command) c = std::tolower((unsigned char)c);
+    ignored_commands.push_back(std::move(command));
+  });
+
+  ignored_accounts.clear();
+  for_each_item(ignore_users_value, [](std::string_view item) {
+    size_t at = item.find('@');
+    ignored_accounts.push_back(
+        {std::string(item.substr(0, at)),
+         at == std::string_view::npos ? std::string()
+                                      : std::string(item.substr(at + 1))});
+  });
+
+  return 0;
+}
+
+int workload_filter_deinit() {
+  ignored_commands.clear();
+  ignored_accounts.clear();
+  return 0;
+}
+
+/* Whether text starts with word, in any case. word is lowercase. */
+static bool starts_with_word(const char *text, const char *end,
+                             std::string_view word) {
+  if (static_cast<size_t>(end - text) < word.size()) return false;
+  for (size_t i = 0; i < word.size(); i++) {
+    if (std::tolower((unsigned char)text[i]) != word[i]) return false;
+  }
+  return true;
+}
+
+static bool is_identifier_char(char c) {
+  return std::isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+/*
+  Whether the text references a table of the component, i.e.
+  performance_schema.workload_instrumentation[_...], in any case and
+  optionally backquoted. Each dot is found with memchr and the identifiers
+  around it compared, so user tables and workload names merely containing
+  workload_instrumentation do not match.
+*/
+static bool mentions_own_tables(std::string_view query) {
+  static constexpr std::string_view schema = "performance_schema";
+  static constexpr std::string_view table = "workload_instrumentation";
+
+  if (query.size() > WORKLOAD_FILTER_SCAN_LENGTH)
+    query = query.substr(0, WORKLOAD_FILTER_SCAN_LENGTH);
+  const char *begin = query.data();
+  const char *end = begin + query.size();
+
+  for (auto dot = static_cast<const char *>(memchr(begin, '.', query.size()));
+       dot != nullptr;
+       dot = static_cast<const char *>(memchr(dot + 1, '.', end - dot - 1))) {
+    const char *name = dot + 1;
+    if (name < end && *name == '`') name++;
+    if (!starts_with_word(name, end, table)) continue;
+
+    const char *schema_end = dot;
+    if (schema_end > begin && schema_end[-1] == '`') schema_end--;
+    if (static_cast<size_t>(schema_end - begin) < schema.size()) continue;
+    const char *schema_start = schema_end - schema.size();
+    if (starts_with_word(schema_start, schema_end, schema) &&
+        (schema_start == begin || !is_identifier_char(schema_start[-1])))
+      return true;
+  }
+
+  return false;
+}
+
+bool statement_ignored(std::string_view sql_command, std::string_view query) {
+  for (auto &command : ignored_commands) {
+    if (sql_command == command) return true;
+  }
+
+  return ignore_own_tables_value != 0 && sql_command == "select" &&
+         mentions_own_tables(query);
+}
+
+bool filter_accounts() { return !ignored_accounts.empty(); }
+
+bool account_ignored(std::string_view user, std::string_view host) {
+  for (auto &account : ignored_accounts) {
+    if (user == account.user && (account.host.empty() || host == account.host))
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,35 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_FILTER_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_FILTER_H
+
+#include <string_view>
+
+/*
+  Statements excluded from accounting. They are checked before sampling, so
+  excluded statements are neither parsed nor counted anywhere:
+  - statement types listed in workload_instrumentation.ignore_commands, by
+    default install_component: the statement installing the component;
+  - with ignore_own_tables, SELECTs referencing a table
+    performance_schema.workload_instrumentation* in their first
+    WORKLOAD_FILTER_SCAN_LENGTH bytes, i.e. reads of the component's tables;
+  - with ignore_system_threads, statements of server threads such as the
+    replica applier and the event scheduler;
+  - statements of the accounts listed in workload_instrumentation.ignore_users.
+
+  Lists are read only, they are parsed when the component is initialized.
+  The first two checks only look at the query event, the account and thread
+  checks are done on the THD by the callback.
+*/
+#define WORKLOAD_FILTER_SCAN_LENGTH 1024
+
+int workload_filter_init();
+int workload_filter_deinit();
+
+/* Whether a statement is excluded by its type or text. */
+bool statement_ignored(std::string_view sql_command, std::string_view query);
+
+/* Whether workload_instrumentation.ignore_users lists any account. */
+bool filter_accounts();
+/* Whether statements of the account are excluded. */
+bool account_ignored(std::string_view user, std::string_view host);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_FILTER_H
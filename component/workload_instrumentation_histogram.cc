@@ -0,0 +1,218 @@
+#include "workload_instrumentation_histogram.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+extern mysql_service_pfs_plugin_column_string_v2_t *pfs_string;
+extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
+
+unsigned int workload_latency_histogram::bucket_index(
+    unsigned long long duration_us) {
+  if (duration_us < WORKLOAD_HISTOGRAM_SUB_BUCKETS) return duration_us;
+
+  unsigned int power = std::bit_width(duration_us) - 1;
+  if (power >= WORKLOAD_HISTOGRAM_MAX_POWER)
+    return WORKLOAD_HISTOGRAM_BUCKETS - 1;
+
+  // The two bits after the leading one select the sub-bucket.
+  unsigned int sub_bucket = (duration_us >> (power - 2)) & 3;
+  return WORKLOAD_HISTOGRAM_SUB_BUCKETS +
+         (power - 2) * WORKLOAD_HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+unsigned long long workload_latency_histogram::bucket_upper_us(
+    unsigned int bucket) {
+  if (bucket < WORKLOAD_HISTOGRAM_SUB_BUCKETS) return bucket;
+  if (bucket == WORKLOAD_HISTOGRAM_BUCKETS - 1) return ~0ULL;
+
+  unsigned int power = 2 + (bucket - WORKLOAD_HISTOGRAM_SUB_BUCKETS) /
+                               WORKLOAD_HISTOGRAM_SUB_BUCKETS;
+  unsigned int sub_bucket =
+      (bucket - WORKLOAD_HISTOGRAM_SUB_BUCKETS) % WORKLOAD_HISTOGRAM_SUB_BUCKETS;
+  return ((WORKLOAD_HISTOGRAM_SUB_BUCKETS + sub_bucket + 1ULL) << (power - 2)) -
+         1;
+}
+
+unsigned long long histogram_percentile_us(const unsigned long long *counts,
+                                           double q) {
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < WORKLOAD_HISTOGRAM_BUCKETS; i++)
+    total += counts[i];
+  if (total == 0) return 0;
+
+  // Rank of the quantile, rounded up so that p100 is the last value.
+  auto rank = static_cast<unsigned long long>(q * total);
+  if (rank < q * total || rank == 0) rank++;
+
+  unsigned long long seen = 0;
+  for (unsigned int i = 0; i < WORKLOAD_HISTOGRAM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) return workload_latency_histogram::bucket_upper_us(i);
+  }
+
+  return workload_latency_histogram::bucket_upper_us(
+      WORKLOAD_HISTOGRAM_BUCKETS - 1);
+}
+
+/* Access to PS table */
+int workload_instrumentation_histogram_delete_all_rows() { return 0; }
+
+PSI_table_handle *workload_instrumentation_histogram_open_table(
+    PSI_pos **pos) {
+  // Make counters accumulated by all threads visible to this read.
+  workload_thread_cache_flush_all();
+
+  auto temp = new workload_instrumentation_histogram_table_handle();
+  temp->m_open_ns = workload_self_stats_start();
+  temp->m_records = workload_record_slots();
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return (PSI_table_handle *)temp;
+}
+
+void workload_instrumentation_histogram_close_table(PSI_table_handle *handle) {
+  auto temp = (workload_instrumentation_histogram_table_handle *)handle;
+  workload_self_stats_add(WORKLOAD_SELF_TABLE_SCAN, temp->m_open_ns);
+  delete temp;
+}
+
+static void workload_instrumentation_histogram_copy_row(
+    workload_instrumentation_histogram_row *dst,
+    const workload_instrumentation_record *src, unsigned int bucket,
+    unsigned long long count) {
+  memcpy(dst->workload, src->workload, src->workload_length + 1);
+  dst->bucket_upper_us = workload_latency_histogram::bucket_upper_us(bucket);
+  dst->count_queries = count;
+}
+
+/*
+  Copies the first non empty bucket of the record in the current slot, from
+  the current bucket on. Returns whether there was one.
+*/
+static bool workload_instrumentation_histogram_copy_slot(
+    workload_instrumentation_histogram_table_handle *th) {
+  if (workload_records_rdlock() != 0) return false;
+
+  bool copied = false;
+  auto record = workload_record_at(th->m_pos.get_index());
+  for (; record != nullptr &&
+         th->m_pos.get_bucket() < WORKLOAD_HISTOGRAM_BUCKETS;
+       th->m_pos.next_bucket()) {
+    auto count = record->histogram.buckets[th->m_pos.get_bucket()].load(
+        std::memory_order_relaxed);
+    if (count == 0) continue;
+
+    workload_instrumentation_histogram_copy_row(
+        &th->m_current_row, record, th->m_pos.get_bucket(), count);
+    copied = true;
+    break;
+  }
+
+  workload_records_unlock();
+  return copied;
+}
+
+/* Only non empty buckets are returned as rows. */
+int workload_instrumentation_histogram_rnd_next(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_histogram_table_handle *)handle;
+
+  for (th->m_pos.set_at(&th->m_next_pos);
+       th->m_pos.get_index() < th->m_records; th->m_pos.next_workload()) {
+    if (workload_instrumentation_histogram_copy_slot(th)) {
+      th->m_next_pos.set_after(&th->m_pos);
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int workload_instrumentation_histogram_rnd_init(PSI_table_handle *handle,
+                                                bool) {
+  auto th = (workload_instrumentation_histogram_table_handle *)handle;
+  th->m_records = workload_record_slots();
+  return 0;
+}
+
+int workload_instrumentation_histogram_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_histogram_table_handle *)handle;
+  if (workload_records_rdlock() != 0) return 0;
+
+  auto record = workload_record_at(th->m_pos.get_index());
+  if (record != nullptr &&
+      th->m_pos.get_bucket() < WORKLOAD_HISTOGRAM_BUCKETS) {
+    workload_instrumentation_histogram_copy_row(
+        &th->m_current_row, record, th->m_pos.get_bucket(),
+        record->histogram.buckets[th->m_pos.get_bucket()].load(
+            std::memory_order_relaxed));
+  }
+
+  workload_records_unlock();
+  return 0;
+}
+
+void workload_instrumentation_histogram_reset_position(
+    PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_histogram_table_handle *)handle;
+  th->m_pos.reset();
+  th->m_next_pos.reset();
+}
+
+int workload_instrumentation_histogram_read_column_value(
+    PSI_table_handle *handle, PSI_field *field, unsigned int index) {
+  auto th = (workload_instrumentation_histogram_table_handle *)handle;
+
+  switch (index) {
+    case 0: /* WORKLOAD */
+      pfs_string->set_varchar_utf8mb4(field, th->m_current_row.workload);
+      break;
+    case 1: /* BUCKET_UPPER_US */
+      pfs_bigint->set_unsigned(field,
+                               {th->m_current_row.bucket_upper_us, false});
+      break;
+    case 2: /* COUNT_QUERIES */
+      pfs_bigint->set_unsigned(field,
+                               {th->m_current_row.count_queries, false});
+      break;
+    default: /* We should never reach here */
+      assert(0);
+  }
+  return 0;
+}
+
+unsigned long long workload_instrumentation_histogram_get_row_count(void) {
+  return workload_record_slots() * WORKLOAD_HISTOGRAM_BUCKETS;
+}
+
+void init_workload_instrumentation_histogram_share(
+    PFS_engine_table_share_proxy *share) {
+  share->m_table_name = "workload_instrumentation_histogram";
+  share->m_table_name_length = 34;
+  share->m_table_definition =
+      "`WORKLOAD` varchar(50), `BUCKET_UPPER_US` BIGINT UNSIGNED, "
+      "`COUNT_QUERIES` BIGINT UNSIGNED";
+  share->m_ref_length = sizeof(workload_instrumentation_histogram_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = workload_instrumentation_histogram_get_row_count;
+  share->delete_all_rows = workload_instrumentation_histogram_delete_all_rows;
+
+  share->m_proxy_engine_table = {
+      workload_instrumentation_histogram_rnd_next,
+      workload_instrumentation_histogram_rnd_init,
+      workload_instrumentation_histogram_rnd_pos,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_histogram_read_column_value,
+      workload_instrumentation_histogram_reset_position,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_histogram_open_table,
+      workload_instrumentation_histogram_close_table};
+}
@@ -0,0 +1,109 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_HISTOGRAM_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_HISTOGRAM_H
+
+#include <atomic>
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+#include "workload_instrumentation_index.h"
+
+/*
+  Log-linear latency histogram: durations below 4us get one bucket each, then
+  every power of two is split in 4 equal sub-buckets, so the bucket a duration
+  falls in is at most 25% wider than the duration itself. Durations of 2^36us
+  (~19 hours) or more go to the last bucket.
+
+  Memory per workload: WORKLOAD_HISTOGRAM_BUCKETS 8 byte counters, 1120 bytes
+  (5.5MiB with the default 5000 workloads).
+*/
+#define WORKLOAD_HISTOGRAM_SUB_BUCKETS 4
+#define WORKLOAD_HISTOGRAM_MAX_POWER 36
+#define WORKLOAD_HISTOGRAM_BUCKETS                     \
+  (WORKLOAD_HISTOGRAM_SUB_BUCKETS +                    \
+   (WORKLOAD_HISTOGRAM_MAX_POWER - 2) * WORKLOAD_HISTOGRAM_SUB_BUCKETS)
+
+struct workload_latency_histogram {
+  std::atomic<unsigned long long> buckets[WORKLOAD_HISTOGRAM_BUCKETS] = {};
+
+  void add_to_bucket(unsigned int bucket, unsigned long long count) {
+    buckets[bucket].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void load(unsigned long long *counts) const {
+    for (unsigned int i = 0; i < WORKLOAD_HISTOGRAM_BUCKETS; i++)
+      counts[i] = buckets[i].load(std::memory_order_relaxed);
+  }
+
+  void add(const unsigned long long *counts) {
+    for (unsigned int i = 0; i < WORKLOAD_HISTOGRAM_BUCKETS; i++)
+      if (counts[i] != 0)
+        buckets[i].fetch_add(counts[i], std::memory_order_relaxed);
+  }
+
+  void reset() {
+    for (auto &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+  }
+
+  static unsigned int bucket_index(unsigned long long duration_us);
+  /* Largest duration, in microseconds, counted in a bucket. */
+  static unsigned long long bucket_upper_us(unsigned int bucket);
+};
+
+/*
+  Returns the upper bound of the bucket holding the q-th quantile (0 < q <= 1)
+  of a histogram snapshot, or 0 if the histogram is empty.
+*/
+unsigned long long histogram_percentile_us(const unsigned long long *counts,
+                                           double q);
+
+/* P_S table performance_schema.workload_instrumentation_histogram */
+class workload_instrumentation_histogram_POS {
+ private:
+  unsigned int m_index = 0;
+  unsigned int m_bucket = 0;
+
+ public:
+  ~workload_instrumentation_histogram_POS() = default;
+  workload_instrumentation_histogram_POS() = default;
+
+  void reset() {
+    m_index = 0;
+    m_bucket = 0;
+  }
+  unsigned int get_index() { return m_index; }
+  unsigned int get_bucket() { return m_bucket; }
+  void set_at(workload_instrumentation_histogram_POS *pos) {
+    m_index = pos->m_index;
+    m_bucket = pos->m_bucket;
+  }
+  void set_after(workload_instrumentation_histogram_POS *pos) {
+    m_index = pos->m_index;
+    m_bucket = pos->m_bucket + 1;
+  }
+  void next_workload() {
+    m_index++;
+    m_bucket = 0;
+  }
+  void next_bucket() { m_bucket++; }
+};
+
+struct workload_instrumentation_histogram_row {
+  char workload[WORKLOAD_NAME_MAX_LENGTH + 1];
+  unsigned long long bucket_upper_us;
+  unsigned long long count_queries;
+};
+
+struct workload_instrumentation_histogram_table_handle {
+  workload_instrumentation_histogram_POS m_pos;
+  workload_instrumentation_histogram_POS m_next_pos;
+  workload_instrumentation_histogram_row m_current_row;
+  /* Record slots used when the scan started, later ones are not returned. */
+  size_t m_records;
+  /* Monotonic time the table was opened, for self stats. */
+  unsigned long long m_open_ns;
+};
+
+void init_workload_instrumentation_histogram_share(
+    PFS_engine_table_share_proxy *share);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_HISTOGRAM_H
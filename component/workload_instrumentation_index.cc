@@ -0,0 +1,58 @@
+#include "workload_instrumentation_index.h"
+
+#include <cassert>
+#include <cstring>
+
+/* 64 bit FNV-1a, names are short so a byte at a time is good enough. */
+unsigned long long workload_name_hash(std::string_view name) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned char c : name) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void workload_instrumentation_index::init(size_t max_entries) {
+  size_t capacity = 1;
+  while (capacity < 2 * max_entries) capacity <<= 1;
+
+  m_entries.reset(new workload_index_entry[capacity]);
+  m_mask = capacity - 1;
+  m_max_entries = max_entries;
+}
+
+long workload_instrumentation_index::find(std::string_view name,
+                                          unsigned long long hash) const {
+  if (m_entries == nullptr) return -1;
+
+  for (size_t i = hash & m_mask, probes = 0; probes <= m_mask;
+       i = (i + 1) & m_mask, probes++) {
+    const workload_index_entry &entry = m_entries[i];
+    unsigned int slot = entry.slot.load(std::memory_order_acquire);
+
+    if (slot == 0) return -1;
+    if (entry.hash == hash && entry.length == name.size() &&
+        memcmp(entry.name, name.data(), name.size()) == 0)
+      return slot - 1;
+  }
+
+  return -1;
+}
+
+void workload_instrumentation_index::insert(std::string_view name,
+                                            unsigned long long hash,
+                                            unsigned int slot) {
+  assert(name.size() <= WORKLOAD_NAME_MAX_LENGTH);
+
+  for (size_t i = hash & m_mask;; i = (i + 1) & m_mask) {
+    workload_index_entry &entry = m_entries[i];
+    if (entry.slot.load(std::memory_order_relaxed) != 0) continue;
+
+    entry.hash = hash;
+    entry.length = name.size();
+    memcpy(entry.name, name.data(), name.size());
+    entry.slot.store(slot + 1, std::memory_order_release);
+    return;
+  }
+}
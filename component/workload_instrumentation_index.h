@@ -0,0 +1,62 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_INDEX_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_INDEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+#include "workload_instrumentation_memory.h"
+
+/*
+  Maximum length of a workload name, matching the width of the WORKLOAD column
+  of the P_S table. Longer names are truncated.
+*/
+#define WORKLOAD_NAME_MAX_LENGTH 50
+
+unsigned long long workload_name_hash(std::string_view name);
+
+/*
+  One index bucket, exactly one cache line: the name is stored inline next to
+  its hash so that resolving a workload does not chase pointers.
+*/
+struct alignas(64) workload_index_entry
+    : workload_memory_accounted<WORKLOAD_MEMORY_INDEX> {
+  /* Slot of the record in the records array plus one, 0 if empty. */
+  std::atomic<unsigned int> slot{0};
+  unsigned char length = 0;
+  char name[WORKLOAD_NAME_MAX_LENGTH];
+  unsigned long long hash = 0;
+};
+
+static_assert(sizeof(workload_index_entry) == 64);
+
+/*
+  Fixed capacity open addressing (linear probing) hash table mapping workload
+  names to record slots.
+
+  Lookups are lock free: entries are filled before their slot is published
+  with a release store and are never modified afterwards, so a reader either
+  sees an empty bucket or a complete entry. Inserts must be serialized by the
+  caller (LOCK_workload_duration in write mode). Entries cannot be removed,
+  the index is rebuilt instead.
+*/
+class workload_instrumentation_index {
+ public:
+  /* Sizes the table for max_entries names at a load factor of at most 50%. */
+  void init(size_t max_entries);
+  size_t max_entries() const { return m_max_entries; }
+
+  /* Returns the slot stored for name, or -1 if it is not in the index. */
+  long find(std::string_view name, unsigned long long hash) const;
+
+  void insert(std::string_view name, unsigned long long hash,
+              unsigned int slot);
+
+ private:
+  std::unique_ptr<workload_index_entry[]> m_entries;
+  size_t m_mask = 0;
+  size_t m_max_entries = 0;
+};
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_INDEX_H
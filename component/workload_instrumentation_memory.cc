@@ -0,0 +1,69 @@
+#include "workload_instrumentation_memory.h"
+
+#include <cstdlib>
+#include <iterator>
+
+#include <mysql/components/services/psi_memory.h>
+
+/* Size and alignment of the header before each allocation. */
+#define WORKLOAD_MEMORY_HEADER 64
+
+struct alignas(WORKLOAD_MEMORY_HEADER) workload_memory_header {
+  /* Key returned by the server, to free the allocation with. */
+  PSI_memory_key key;
+  size_t size;
+  PSI_thread *owner;
+};
+
+static_assert(sizeof(workload_memory_header) == WORKLOAD_MEMORY_HEADER);
+
+static PSI_memory_key memory_keys[WORKLOAD_MEMORY_KINDS];
+
+/* Allocated and freed by different threads, so only counted globally. */
+static PSI_memory_info all_workload_instrumentation_memory[] = {
+    {&memory_keys[WORKLOAD_MEMORY_RECORDS], "records",
+     PSI_FLAG_ONLY_GLOBAL_STAT, 0, "Records of the workloads tracked."},
+    {&memory_keys[WORKLOAD_MEMORY_INDEX], "index", PSI_FLAG_ONLY_GLOBAL_STAT,
+     0, "Hash index of the workload names."},
+    {&memory_keys[WORKLOAD_MEMORY_THREAD_CACHES], "thread_caches",
+     PSI_FLAG_ONLY_GLOBAL_STAT, 0,
+     "Counters accumulated by threads before they are flushed."},
+    {&memory_keys[WORKLOAD_MEMORY_TAGS], "tags", PSI_FLAG_ONLY_GLOBAL_STAT, 0,
+     "Tag values and combinations."},
+    {&memory_keys[WORKLOAD_MEMORY_BUDGETS], "budgets",
+     PSI_FLAG_ONLY_GLOBAL_STAT, 0, "Parsed workload budgets."},
+    {&memory_keys[WORKLOAD_MEMORY_EXPORT], "export", PSI_FLAG_ONLY_GLOBAL_STAT,
+     0, "Rows and text formatted for the export and persist files."}};
+
+static_assert(std::size(all_workload_instrumentation_memory) ==
+              WORKLOAD_MEMORY_KINDS);
+
+void workload_memory_register() {
+  mysql_memory_register("workload_instrumentation",
+                        all_workload_instrumentation_memory,
+                        (int)std::size(all_workload_instrumentation_memory));
+}
+
+void *workload_memory_alloc(workload_memory_kind kind, size_t size) {
+  // aligned_alloc() wants a multiple of the alignment.
+  size_t total = (sizeof(workload_memory_header) + size +
+                  WORKLOAD_MEMORY_HEADER - 1) /
+                 WORKLOAD_MEMORY_HEADER * WORKLOAD_MEMORY_HEADER;
+  auto header = static_cast<workload_memory_header *>(
+      aligned_alloc(WORKLOAD_MEMORY_HEADER, total));
+  if (header == nullptr) return nullptr;
+
+  header->size = size;
+  header->owner = nullptr;
+  header->key =
+      PSI_MEMORY_CALL(memory_alloc)(memory_keys[kind], size, &header->owner);
+  return header + 1;
+}
+
+void workload_memory_free(void *ptr) {
+  if (ptr == nullptr) return;
+
+  auto header = static_cast<workload_memory_header *>(ptr) - 1;
+  PSI_MEMORY_CALL(memory_free)(header->key, header->size, header->owner);
+  free(header);
+}
@@ -0,0 +1,93 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_MEMORY_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+  Memory of the structures of the component, accounted to the PSI memory key
+  of their kind, e.g. memory/workload_instrumentation/records in
+  performance_schema.memory_summary_global_by_event_name. Structures deriving
+  from workload_memory_accounted and containers using workload_memory_allocator
+  are allocated through it. Only allocations that do not grow with the number
+  of workloads (names, table handles, vectors of settings) are not accounted.
+
+  Each allocation is preceded by a cache line holding the key the server
+  returned for it, so that it is freed under the same key even if the
+  instrument was enabled or disabled meanwhile. Allocations are aligned on a
+  cache line.
+*/
+enum workload_memory_kind {
+  /* Workload records and the segments of record slots. */
+  WORKLOAD_MEMORY_RECORDS,
+  /* Entries of the record index. */
+  WORKLOAD_MEMORY_INDEX,
+  WORKLOAD_MEMORY_THREAD_CACHES,
+  /* Values and combinations of tags. */
+  WORKLOAD_MEMORY_TAGS,
+  WORKLOAD_MEMORY_BUDGETS,
+  /* Rows and text formatted by the export and persist threads. */
+  WORKLOAD_MEMORY_EXPORT,
+  WORKLOAD_MEMORY_KINDS
+};
+
+/* Registers the memory keys, before anything is allocated. */
+void workload_memory_register();
+
+/* Returns size bytes accounted to kind, or nullptr if out of memory. */
+void *workload_memory_alloc(workload_memory_kind kind, size_t size);
+void workload_memory_free(void *ptr);
+
+/* Base of the structures allocated through workload_memory_alloc(). */
+template <workload_memory_kind kind>
+struct workload_memory_accounted {
+  static void *operator new(size_t size) {
+    void *ptr = workload_memory_alloc(kind, size);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+  }
+  static void *operator new[](size_t size) { return operator new(size); }
+  static void operator delete(void *ptr) noexcept { workload_memory_free(ptr); }
+  static void operator delete[](void *ptr) noexcept {
+    workload_memory_free(ptr);
+  }
+};
+
+/* Allocator of the containers accounted to kind. */
+template <typename T, workload_memory_kind kind>
+struct workload_memory_allocator {
+  using value_type = T;
+  template <typename U>
+  struct rebind {
+    using other = workload_memory_allocator<U, kind>;
+  };
+
+  workload_memory_allocator() = default;
+  template <typename U>
+  workload_memory_allocator(const workload_memory_allocator<U, kind> &) {}
+
+  T *allocate(size_t n) {
+    void *ptr = workload_memory_alloc(kind, n * sizeof(T));
+    if (ptr == nullptr) throw std::bad_alloc();
+    return static_cast<T *>(ptr);
+  }
+  void deallocate(T *ptr, size_t) noexcept { workload_memory_free(ptr); }
+
+  template <typename U>
+  bool operator==(const workload_memory_allocator<U, kind> &) const {
+    return true;
+  }
+};
+
+template <workload_memory_kind kind>
+using workload_memory_string =
+    std::basic_string<char, std::char_traits<char>,
+                      workload_memory_allocator<char, kind>>;
+
+template <typename T, workload_memory_kind kind>
+using workload_memory_vector =
+    std::vector<T, workload_memory_allocator<T, kind>>;
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_MEMORY_H
@@ -0,0 +1,233 @@
+#include "workload_instrumentation_parser.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr std::string_view WORKLOAD_KEY = "WORKLOAD_NAME=";
+
+/* Characters allowed in a workload name: [A-Za-z0-9-_:.\/\\] */
+constexpr std::array<bool, 256> make_name_charset() {
+  std::array<bool, 256> charset{};
+  for (int c = 'A'; c <= 'Z'; c++) charset[c] = true;
+  for (int c = 'a'; c <= 'z'; c++) charset[c] = true;
+  for (int c = '0'; c <= '9'; c++) charset[c] = true;
+  for (unsigned char c : std::string_view("-_:./\\")) charset[c] = true;
+  return charset;
+}
+
+constexpr std::array<bool, 256> name_charset = make_name_charset();
+
+inline bool is_name_char(char c) {
+  return name_charset[static_cast<unsigned char>(c)];
+}
+
+/* Tag keys: [A-Za-z0-9_] */
+constexpr std::array<bool, 256> make_key_charset() {
+  std::array<bool, 256> charset{};
+  for (int c = 'A'; c <= 'Z'; c++) charset[c] = true;
+  for (int c = 'a'; c <= 'z'; c++) charset[c] = true;
+  for (int c = '0'; c <= '9'; c++) charset[c] = true;
+  charset['_'] = true;
+  return charset;
+}
+
+constexpr std::array<bool, 256> key_charset = make_key_charset();
+
+inline bool is_key_char(char c) {
+  return key_charset[static_cast<unsigned char>(c)];
+}
+
+/* Tag values: workload name characters, plus `%` of url encoded values. */
+constexpr std::array<bool, 256> make_tag_value_charset() {
+  std::array<bool, 256> charset = make_name_charset();
+  charset['%'] = true;
+  return charset;
+}
+
+constexpr std::array<bool, 256> tag_value_charset = make_tag_value_charset();
+
+inline bool is_tag_value_char(char c) {
+  return tag_value_charset[static_cast<unsigned char>(c)];
+}
+
+enum class comment_end { FOUND, LINE_BREAK, NOT_FOUND };
+
+/*
+  Looks for the `* /` closing the comment whose body starts at `p`. On FOUND,
+  `*out` is set to just past the closing delimiter; on LINE_BREAK, to the line
+  break found before any closing delimiter (`.` in the regex did not match
+  line terminators, so such comments were never matched).
+*/
+comment_end find_comment_end(const char *p, const char *end,
+                             const char **out) {
+  while (p < end) {
+    auto star = static_cast<const char *>(memchr(p, '*', end - p));
+    const char *limit = star != nullptr ? star : end;
+
+    auto lf = static_cast<const char *>(memchr(p, '\n', limit - p));
+    if (lf != nullptr) limit = lf;
+    auto cr = static_cast<const char *>(memchr(p, '\r', limit - p));
+    if (cr != nullptr) limit = cr;
+    if (lf != nullptr || cr != nullptr) {
+      *out = limit;
+      return comment_end::LINE_BREAK;
+    }
+
+    if (star == nullptr) break;
+    if (star + 1 < end && star[1] == '/') {
+      *out = star + 2;
+      return comment_end::FOUND;
+    }
+    p = star + 1;
+  }
+
+  return comment_end::NOT_FOUND;
+}
+
+/* Returns the first valid WORKLOAD_NAME=<name> inside a comment, if any. */
+std::string_view find_name_in_comment(std::string_view comment) {
+  size_t pos = comment.find(WORKLOAD_KEY);
+
+  while (pos != std::string_view::npos) {
+    size_t name_start = pos + WORKLOAD_KEY.size();
+    size_t name_end = name_start;
+    while (name_end < comment.size() && is_name_char(comment[name_end]))
+      name_end++;
+
+    if (name_end > name_start)
+      return comment.substr(name_start, name_end - name_start);
+
+    pos = comment.find(WORKLOAD_KEY, pos + 1);
+  }
+
+  return {};
+}
+
+/*
+  Sets the values of the keys found in a comment, unless they were already
+  found. Each `=` is looked up once and the key before it compared to the
+  keys still missing. Returns the number of keys found.
+*/
+unsigned int find_tags_in_comment(std::string_view comment,
+                                  const std::string_view *keys,
+                                  unsigned int key_count,
+                                  std::string_view *values) {
+  unsigned int found = 0;
+
+  for (size_t eq = comment.find('='); eq != std::string_view::npos;
+       eq = comment.find('=', eq + 1)) {
+    size_t key_start = eq;
+    while (key_start > 0 && is_key_char(comment[key_start - 1])) key_start--;
+    if (key_start == eq) continue;
+    std::string_view key = comment.substr(key_start, eq - key_start);
+
+    for (unsigned int i = 0; i < key_count; i++) {
+      if (!values[i].empty() || key != keys[i]) continue;
+
+      size_t value_start = eq + 1;
+      if (value_start < comment.size() && comment[value_start] == '\'')
+        value_start++;
+      size_t value_end = value_start;
+      while (value_end < comment.size() &&
+             is_tag_value_char(comment[value_end]))
+        value_end++;
+
+      if (value_end > value_start) {
+        values[i] = comment.substr(value_start, value_end - value_start);
+        found++;
+      }
+      break;
+    }
+  }
+
+  return found;
+}
+
+/*
+  Calls on_comment(comment) for every comment of the query, in order, until
+  it returns true. Comments do not span line breaks, see findWorkloadName().
+*/
+template <typename F>
+void for_each_comment(const char *query, size_t length, F &&on_comment) {
+  const char *end = query + length;
+  const char *p = query;
+
+  while (p + 1 < end) {
+    // memchr is vectorized by libc, so this skips plain SQL text quickly.
+    auto slash = static_cast<const char *>(memchr(p, '/', end - p - 1));
+    if (slash == nullptr) break;
+    if (slash[1] != '*') {
+      p = slash + 1;
+      continue;
+    }
+
+    const char *comment_stop = nullptr;
+    switch (find_comment_end(slash + 2, end, &comment_stop)) {
+      case comment_end::NOT_FOUND:
+        // No later comment can be closed either.
+        return;
+      case comment_end::LINE_BREAK:
+        // No comment opened before the line break can be closed either.
+        p = comment_stop + 1;
+        break;
+      case comment_end::FOUND:
+        if (on_comment(std::string_view(slash, comment_stop - slash))) return;
+        p = comment_stop;
+        break;
+    }
+  }
+}
+
+}  // namespace
+
+std::string_view findWorkloadName(const char *query, size_t length,
+                                  size_t max_scan_length,
+                                  size_t *decided_length) {
+  if (query == nullptr) return {};
+  if (max_scan_length != 0 && length > max_scan_length)
+    length = max_scan_length;
+
+  std::string_view name;
+  for_each_comment(query, length, [&](std::string_view comment) {
+    name = find_name_in_comment(comment);
+    if (!name.empty() && decided_length != nullptr)
+      *decided_length = comment.data() + comment.size() - query;
+    return !name.empty();
+  });
+
+  return name;
+}
+
+std::string_view workloadNamePrefix(std::string_view value) {
+  size_t length = 0;
+  while (length < value.size() && is_name_char(value[length])) length++;
+  return value.substr(0, length);
+}
+
+std::string_view findWorkloadNameAndTags(const char *query, size_t length,
+                                         const std::string_view *keys,
+                                         unsigned int key_count,
+                                         std::string_view *values,
+                                         size_t max_scan_length,
+                                         size_t *decided_length) {
+  for (unsigned int i = 0; i < key_count; i++) values[i] = {};
+  if (query == nullptr) return {};
+  if (max_scan_length != 0 && length > max_scan_length)
+    length = max_scan_length;
+
+  std::string_view name;
+  unsigned int found = 0;
+  for_each_comment(query, length, [&](std::string_view comment) {
+    if (name.empty()) name = find_name_in_comment(comment);
+    if (found < key_count)
+      found += find_tags_in_comment(comment, keys, key_count, values);
+    if (name.empty() || found < key_count) return false;
+    if (decided_length != nullptr)
+      *decided_length = comment.data() + comment.size() - query;
+    return true;
+  });
+
+  return name;
+}
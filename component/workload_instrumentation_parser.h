@@ -0,0 +1,70 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_PARSER_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_PARSER_H
+
+#include <cstddef>
+#include <string_view>
+
+/*
+  Maximum number of bytes of query text scanned looking for the workload
+  comment. 0 means the whole query text is scanned, which is required to match
+  comments appended at the end of the statement.
+*/
+#define WORKLOAD_MAX_SCAN_LENGTH 0
+
+/*
+  Finds the workload name in the first query comment of the form
+  `/ * ... WORKLOAD_NAME=<name> ... * /` (without the spaces).
+
+  Semantics match the previous std::regex based implementation exactly:
+  comments are `/\*.*?\*\/` (not spanning line breaks) and the name is the
+  longest run of `[A-Za-z0-9-_:.\/\\]` following `WORKLOAD_NAME=`. Scanning is
+  done in place in a single pass and does not allocate; the returned view
+  points into `query` and is empty when no workload is found.
+
+  If `max_scan_length` is not 0, only the first `max_scan_length` bytes of
+  the query are considered.
+
+  When a workload is found and `decided_length` is not nullptr, it is set to
+  the length of the prefix the result depends on, i.e. up to the end of the
+  comment holding the name: any query starting with the same bytes has the
+  same workload.
+*/
+std::string_view findWorkloadName(const char *query, size_t length,
+                                  size_t max_scan_length = 0,
+                                  size_t *decided_length = nullptr);
+
+/*
+  Returns the longest prefix of `value` made of workload name characters, i.e.
+  the name a comment `WORKLOAD_NAME=<value>` would give, for names set outside
+  the query text.
+*/
+std::string_view workloadNamePrefix(std::string_view value);
+
+/* Maximum number of tag keys findWorkloadNameAndTags() looks for. */
+#define WORKLOAD_MAX_TAGS 3
+
+/*
+  Finds the workload name, as findWorkloadName() does, and the values of up
+  to WORKLOAD_MAX_TAGS tag keys in the query comments, e.g.
+  `/ * TEAM=search,ENDPOINT='api/v1/search' * /`. Keys are matched case
+  sensitively as whole words (`[A-Za-z0-9_]+`) and values are the longest run
+  of `[A-Za-z0-9-_:.\/\\%]` after `KEY=`, optionally single quoted as
+  sqlcommenter writes them. The first value of each key wins.
+
+  The name and all keys are looked for in a single scan of the comments,
+  which stops as soon as the name and every key were found: the cost does not
+  grow with the number of keys. values[i] is set to the value of keys[i],
+  pointing into `query`, or is empty when it is not found.
+
+  When the name and every key are found and `decided_length` is not nullptr,
+  it is set to the length of the prefix the results depend on, as for
+  findWorkloadName(). Otherwise the results depend on the whole query.
+*/
+std::string_view findWorkloadNameAndTags(const char *query, size_t length,
+                                         const std::string_view *keys,
+                                         unsigned int key_count,
+                                         std::string_view *values,
+                                         size_t max_scan_length = 0,
+                                         size_t *decided_length = nullptr);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_PARSER_H
@@ -0,0 +1,302 @@
+#include "workload_instrumentation_persist.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysqld_error.h> /* Errors */
+
+/* Core counters of workload_counters, followed by its resources. */
+#define WORKLOAD_PERSIST_CORE_COUNTERS 7
+#define WORKLOAD_PERSIST_COUNTERS \
+  (WORKLOAD_PERSIST_CORE_COUNTERS + WORKLOAD_RESOURCES)
+
+static const char persist_magic[8] = {'W', 'L', 'I', 'S', 'N', 'A', 'P', '\0'};
+
+/*
+  Snapshot layout: a header followed by one fixed size entry per workload,
+  in slot order. Integers are in the byte order of the host: a snapshot from
+  a host of the other order fails the version check.
+*/
+struct persist_header {
+  char magic[8];
+  uint32_t version;
+  /* sizeof(persist_entry), which changes with the number of counters. */
+  uint32_t entry_size;
+  uint64_t entries;
+  uint64_t boot_id;
+  /* Unix time the snapshot was taken at. */
+  uint64_t written_at;
+  /* 64 bit FNV-1a of the entries. */
+  uint64_t checksum;
+};
+
+struct persist_entry {
+  char workload[WORKLOAD_NAME_MAX_LENGTH];
+  uint8_t workload_length;
+  uint8_t estimated;
+  uint8_t padding[4];
+  uint64_t counters[WORKLOAD_PERSIST_COUNTERS];
+  uint64_t histogram[WORKLOAD_HISTOGRAM_BUCKETS];
+};
+
+static_assert(sizeof(persist_header) == 48);
+static_assert(offsetof(persist_entry, counters) % 8 == 0);
+
+static std::thread persist_thread;
+static std::mutex persist_mutex;
+static std::condition_variable persist_stop_cond;
+static bool persist_stop = false;
+static std::string persist_path;
+
+static uint64_t persist_checksum(const char *data, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static void counters_to_entry(const workload_counters &counters,
+                              persist_entry *entry) {
+  const unsigned long long core[WORKLOAD_PERSIST_CORE_COUNTERS] = {
+      counters.count_queries,         counters.sum_rows_examined,
+      counters.sum_rows_sent,         counters.sum_rows_affected,
+      counters.sum_query_duration_ns, counters.sum_lock_time_ns,
+      counters.sum_cpu_time_ns};
+  for (int i = 0; i < WORKLOAD_PERSIST_CORE_COUNTERS; i++)
+    entry->counters[i] = core[i];
+  for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+    entry->counters[WORKLOAD_PERSIST_CORE_COUNTERS + i] =
+        counters.resources[i];
+}
+
+static void entry_to_counters(const persist_entry &entry,
+                              workload_counters *counters) {
+  counters->count_queries = entry.counters[0];
+  counters->sum_rows_examined = entry.counters[1];
+  counters->sum_rows_sent = entry.counters[2];
+  counters->sum_rows_affected = entry.counters[3];
+  counters->sum_query_duration_ns = entry.counters[4];
+  counters->sum_lock_time_ns = entry.counters[5];
+  counters->sum_cpu_time_ns = entry.counters[6];
+  for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+    counters->resources[i] =
+        entry.counters[WORKLOAD_PERSIST_CORE_COUNTERS + i];
+}
+
+void workload_persist_format(workload_persist_data *data) {
+  data->assign(sizeof(persist_header), '\0');
+
+  persist_entry entry;
+  uint64_t entries = 0;
+  size_t slots = workload_record_slots();
+  for (size_t slot = 0; slot < slots; slot++) {
+    if (workload_records_rdlock() != 0) break;
+    auto record = workload_record_at(slot);
+    if (record != nullptr) {
+      memset(&entry, 0, sizeof(entry));
+      memcpy(entry.workload, record->workload, record->workload_length);
+      entry.workload_length = record->workload_length;
+      entry.estimated = record->estimated.load(std::memory_order_relaxed);
+      workload_counters counters;
+      sum_record_counters(&counters, record);
+      counters_to_entry(counters, &entry);
+      unsigned long long histogram[WORKLOAD_HISTOGRAM_BUCKETS];
+      record->histogram.load(histogram);
+      for (unsigned int i = 0; i < WORKLOAD_HISTOGRAM_BUCKETS; i++)
+        entry.histogram[i] = histogram[i];
+    }
+    workload_records_unlock();
+
+    if (record == nullptr) continue;
+    data->append((const char *)&entry, sizeof(entry));
+    entries++;
+  }
+
+  persist_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, persist_magic, sizeof(header.magic));
+  header.version = WORKLOAD_PERSIST_VERSION;
+  header.entry_size = sizeof(persist_entry);
+  header.entries = entries;
+  header.boot_id = workload_counters_boot_id();
+  header.written_at = time(nullptr);
+  header.checksum = persist_checksum(data->data() + sizeof(header),
+                                     data->size() - sizeof(header));
+  memcpy(data->data(), &header, sizeof(header));
+}
+
+bool workload_persist_restore(const char *data, size_t length) {
+  persist_header header;
+  if (length < sizeof(header)) return false;
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, persist_magic, sizeof(header.magic)) != 0 ||
+      header.version != WORKLOAD_PERSIST_VERSION ||
+      header.entry_size != sizeof(persist_entry) ||
+      header.entries != (length - sizeof(header)) / sizeof(persist_entry) ||
+      (length - sizeof(header)) % sizeof(persist_entry) != 0 ||
+      header.checksum != persist_checksum(data + sizeof(header),
+                                          length - sizeof(header)))
+    return false;
+
+  persist_entry entry;
+  for (uint64_t i = 0; i < header.entries; i++) {
+    // The mapping has no alignment guarantee, entries are copied out.
+    memcpy(&entry, data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+    if (entry.workload_length > WORKLOAD_NAME_MAX_LENGTH) continue;
+
+    workload_counters counters;
+    entry_to_counters(entry, &counters);
+    unsigned long long histogram[WORKLOAD_HISTOGRAM_BUCKETS];
+    for (unsigned int b = 0; b < WORKLOAD_HISTOGRAM_BUCKETS; b++)
+      histogram[b] = entry.histogram[b];
+    restore_record_counters({entry.workload, entry.workload_length},
+                            counters, histogram, entry.estimated != 0);
+  }
+  workload_set_counters_boot_id(header.boot_id);
+
+  return true;
+}
+
+/* Maps the snapshot and restores it, if there is one. */
+static void restore_persist_file() {
+  int fd = open(persist_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG,
+                      "Failed to open workload_instrumentation.persist_file "
+                      "%s: %s",
+                      persist_path.c_str(), strerror(errno));
+    }
+    return;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to read workload_instrumentation.persist_file %s",
+                    persist_path.c_str());
+    return;
+  }
+
+  if (workload_persist_restore((const char *)data, st.st_size)) {
+    LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Restored workload counters from %s",
+                    persist_path.c_str());
+  } else {
+    LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Ignoring invalid workload_instrumentation.persist_file "
+                    "%s, counters start from zero",
+                    persist_path.c_str());
+  }
+  munmap(data, st.st_size);
+}
+
+/* Writes the snapshot next to its final path, then renames it over it. */
+static bool write_persist_file(const workload_persist_data &data) {
+  std::string temp_path = persist_path + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr) return false;
+
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size() &&
+                 fflush(file) == 0 && fsync(fileno(file)) == 0;
+  if (fclose(file) != 0) written = false;
+  if (written && rename(temp_path.c_str(), persist_path.c_str()) == 0)
+    return true;
+
+  int error = errno;
+  remove(temp_path.c_str());
+  errno = error;
+  return false;
+}
+
+static void persist(workload_persist_data *data, bool *failing) {
+  workload_persist_format(data);
+  bool written = write_persist_file(*data);
+  // Only log when writes start or stop failing.
+  if (!written && !*failing) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to write workload_instrumentation.persist_file "
+                    "%s: %s",
+                    persist_path.c_str(), strerror(errno));
+  } else if (written && *failing) {
+    LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Writing workload_instrumentation.persist_file again");
+  }
+  *failing = !written;
+}
+
+static void persist_loop() {
+  workload_persist_data data;
+  bool failing = false;
+
+  std::unique_lock<std::mutex> lock(persist_mutex);
+  while (!persist_stop_cond.wait_for(
+      lock, std::chrono::milliseconds(persist_interval_ms_value),
+      [] { return persist_stop; })) {
+    lock.unlock();
+    persist(&data, &failing);
+    lock.lock();
+  }
+}
+
+int workload_persist_init() {
+  if (persist_file_value == nullptr || persist_file_value[0] == '\0')
+    return 0;
+
+  persist_path = persist_file_value;
+  restore_persist_file();
+
+  persist_stop = false;
+  try {
+    persist_thread = std::thread(persist_loop);
+  } catch (const std::system_error &) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to start the persist thread.");
+    return 1;
+  }
+
+  return 0;
+}
+
+int workload_persist_deinit() {
+  if (!persist_thread.joinable()) return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(persist_mutex);
+    persist_stop = true;
+  }
+  persist_stop_cond.notify_one();
+  persist_thread.join();
+
+  // The last snapshot includes the counters threads still hold.
+  workload_thread_cache_flush_all();
+  workload_persist_data data;
+  bool failing = false;
+  persist(&data, &failing);
+  return failing ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_PERSIST_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_PERSIST_H
+
+#include <cstddef>
+
+#include "workload_instrumentation_memory.h"
+
+/*
+  Persistence of the workload counters across restarts and reloads. When
+  workload_instrumentation.persist_file is set, a background thread writes a
+  snapshot of all workloads to it every persist_interval_ms, and a last one
+  is written when the component is deinitialized, after flushing the thread
+  caches. Snapshots are written next to the file and renamed over it, so a
+  crash never leaves a partial snapshot behind.
+
+  When the component is initialized, the snapshot is mapped in memory and
+  its workloads restored in the order of their slots into new records. They
+  keep their relative order in the tables, but not their slots: empty slots
+  are not saved, so restored workloads take consecutive ones. A snapshot
+  that is missing, truncated, fails its checksum or was written by another
+  version of the format is ignored and the counters start from zero.
+
+  The snapshot carries the boot id of the counters (see
+  workload_counters_boot_id()): restored counters keep it, so consumers can
+  tell a restart that restored them from a reset. Top digests and windows
+  are not persisted.
+*/
+
+/* Version of the snapshot format, to change along with its layout. */
+#define WORKLOAD_PERSIST_VERSION 3
+
+/*
+  Restores the snapshot if any, then starts the persist thread if
+  workload_instrumentation.persist_file is set.
+*/
+int workload_persist_init();
+/* Stops the persist thread and writes a last snapshot. */
+int workload_persist_deinit();
+
+/* A snapshot, whose size grows with the number of workloads. */
+using workload_persist_data = workload_memory_string<WORKLOAD_MEMORY_EXPORT>;
+
+/* Formats a snapshot of all workloads, replacing the contents of data. */
+void workload_persist_format(workload_persist_data *data);
+/* Restores a snapshot. Returns false, restoring nothing, if it is invalid. */
+bool workload_persist_restore(const char *data, size_t length);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_PERSIST_H
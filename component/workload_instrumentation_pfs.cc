@@ -1,23 +1,59 @@
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_memory.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_tags.h"
 #include "workload_instrumentation_thd_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+#include "workload_instrumentation_window.h"
 
 #include <mysql/components/services/log_builtins.h> /* LogComponentErr */
 #include <mysql/components/services/mysql_rwlock.h>
 #include <mysqld_error.h> /* Errors */
 
-#define WORKLOAD_MAX_RECORDS 5000
 #define OVERFLOW_WORKLOAD "__OVERFLOW__"
 #define UNSPECIFIED_WORKLOAD "__UNSPECIFIED__"
+#define EVICTED_WORKLOAD "__EVICTED__"
+// Predefined workloads are created in this order at initialization.
+#define UNSPECIFIED_RECORD_SLOT 0
+#define OVERFLOW_RECORD_SLOT 1
+#define EVICTED_RECORD_SLOT 2
+#define PREDEFINED_RECORDS 3
+
+/*
+  Records are stored in segments allocated as the number of workloads grows,
+  enough for the largest workload_instrumentation.max_workloads.
+*/
+#define WORKLOAD_RECORDS_PER_SEGMENT 1024
+#define WORKLOAD_MAX_SEGMENTS 1024
+
+/* Column of the first resource counter, in workload_resource order. */
+#define WORKLOAD_FIRST_RESOURCE_COLUMN 12
+
+/* ha_rkey_function value of key lookups, as opposed to ranges. */
+#define WORKLOAD_KEY_READ_EXACT 0
 
 extern mysql_service_pfs_plugin_table_v1_t *mysql_service_pfs_plugin_table_v1;
 extern mysql_service_pfs_plugin_column_string_v2_t *pfs_string;
 extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
 
-static size_t next_record = 0;
+/* Slots used so far, records below it may have been evicted since. */
+static std::atomic<size_t> next_record{0};
+/* Published records, predefined workloads excluded. */
+static std::atomic<size_t> live_records{0};
+/* Monotonic time of the last search for idle workloads. */
+static std::atomic<unsigned long long> last_eviction_ns{0};
+/* See workload_counters_boot_id(). */
+static std::atomic<unsigned long long> counters_boot_id{0};
 
 mysql_rwlock_t LOCK_workload_duration;
 PSI_rwlock_key key_workload_instrumentation_LOCK_workload_duration;
@@ -28,14 +64,192 @@ PSI_rwlock_info psi_lock_workload_duration_info = {
 static PSI_rwlock_info all_workload_instrumentation_rwlocks[] = {
     psi_lock_workload_duration_info};
 
-std::map<std::string, int> workload_pfs_record_map;
-std::array<workload_instrumentation_record *, WORKLOAD_MAX_RECORDS + 2>
-    workload_instrumentation_array;
-std::map<int, unsigned long long> pfs_record_duration_us_map;
+struct workload_record_segment
+    : workload_memory_accounted<WORKLOAD_MEMORY_RECORDS> {
+  std::atomic<workload_instrumentation_record *>
+      slots[WORKLOAD_RECORDS_PER_SEGMENT] = {};
+};
+
+/*
+  Slots and segments are published with release semantics, so they can be
+  read without holding LOCK_workload_duration. Query threads look records up
+  with their thread cache locked, and records unpublished by an eviction are
+  only reset once every thread cache was unlocked (see
+  workload_thread_cache_flush_all()). P_S readers hold LOCK_workload_duration
+  in read mode instead.
+*/
+static std::array<std::atomic<workload_record_segment *>, WORKLOAD_MAX_SEGMENTS>
+    record_segments;
+/*
+  Replaced, under LOCK_workload_duration, when it is full or workloads were
+  evicted. Lookups are lock free and follow the same rules as records.
+*/
+static std::atomic<workload_instrumentation_index *> record_index{nullptr};
+/*
+  Incremented whenever record_index is replaced or records are freed, before
+  the records it no longer holds can be reused, see workload_record_hint.
+*/
+static std::atomic<unsigned long> record_index_generation{0};
+/* Reset records of evicted workloads, protected by LOCK_workload_duration. */
+static std::vector<workload_instrumentation_record *> free_records;
 
 PFS_engine_table_share_proxy workload_instrumentation_st_share;
+PFS_engine_table_share_proxy workload_instrumentation_histogram_st_share;
+PFS_engine_table_share_proxy workload_instrumentation_window_st_share;
+PFS_engine_table_share_proxy workload_instrumentation_tags_st_share;
+PFS_engine_table_share_proxy workload_instrumentation_top_digests_st_share;
+PFS_engine_table_share_proxy workload_instrumentation_self_stats_st_share;
+
+static workload_instrumentation_record *get_record(size_t slot) {
+  auto segment = record_segments[slot / WORKLOAD_RECORDS_PER_SEGMENT].load(
+      std::memory_order_acquire);
+  if (segment == nullptr) return nullptr;
+  return segment->slots[slot % WORKLOAD_RECORDS_PER_SEGMENT].load(
+      std::memory_order_acquire);
+}
+
+/* Caller must hold LOCK_workload_duration in write mode. */
+static void set_record(size_t slot, workload_instrumentation_record *record) {
+  auto &segment = record_segments[slot / WORKLOAD_RECORDS_PER_SEGMENT];
+  if (segment.load(std::memory_order_relaxed) == nullptr)
+    segment.store(new workload_record_segment, std::memory_order_release);
+
+  segment.load(std::memory_order_relaxed)
+      ->slots[slot % WORKLOAD_RECORDS_PER_SEGMENT]
+      .store(record, std::memory_order_release);
+}
+
+/*
+  Frees all records. Caller must hold LOCK_workload_duration in write mode,
+  and no thread may use them anymore.
+*/
+static void clear_records() {
+  for (auto &segment : record_segments) {
+    auto records = segment.exchange(nullptr, std::memory_order_relaxed);
+    if (records == nullptr) continue;
+    for (auto &slot : records->slots)
+      delete slot.load(std::memory_order_relaxed);
+    delete records;
+  }
+  for (auto record : free_records) delete record;
+  free_records.clear();
+  delete record_index.exchange(nullptr, std::memory_order_relaxed);
+  record_index_generation.fetch_add(1, std::memory_order_release);
+
+  next_record.store(0, std::memory_order_relaxed);
+  live_records.store(0, std::memory_order_relaxed);
+  last_eviction_ns.store(0, std::memory_order_relaxed);
+}
+
+static void set_record_workload(workload_instrumentation_record *record,
+                                std::string_view workload,
+                                unsigned long long now_ns) {
+  memcpy(record->workload, workload.data(), workload.size());
+  record->workload[workload.size()] = '\0';
+  record->workload_length = workload.size();
+  record->last_used_ns.store(now_ns, std::memory_order_relaxed);
+}
+
+/* Zeroes a record no thread can use anymore, so that it can be reused. */
+static void reset_record(workload_instrumentation_record *record) {
+  for (auto &shard : record->shards) shard.reset();
+  for (auto &resources : record->resource_shards) resources.reset();
+  record->histogram.reset();
+  record->top_digests.reset();
+  record->window.reset();
+  record->estimated.store(false, std::memory_order_relaxed);
+}
+
+/*
+  Publishes a new index of the published records, sized for max_entries, and
+  returns the previous one. Caller must hold LOCK_workload_duration in write
+  mode, and only free the previous index once no thread can use it anymore.
+*/
+static workload_instrumentation_index *rebuild_record_index(
+    size_t max_entries) {
+  auto index = new workload_instrumentation_index;
+  index->init(max_entries);
+
+  size_t slots = next_record.load(std::memory_order_relaxed);
+  for (size_t slot = 0; slot < slots; slot++) {
+    auto record = get_record(slot);
+    if (record == nullptr) continue;
+
+    std::string_view workload(record->workload, record->workload_length);
+    index->insert(workload, workload_name_hash(workload), slot);
+  }
+
+  auto old_index = record_index.exchange(index, std::memory_order_acq_rel);
+  record_index_generation.fetch_add(1, std::memory_order_release);
+  return old_index;
+}
+
+/*
+  Publishes a zeroed record for a new workload, reusing the record of an
+  evicted workload if there is one. Caller must hold LOCK_workload_duration in
+  write mode and make sure there is room left.
+*/
+static workload_instrumentation_record *add_record(
+    std::string_view workload, unsigned long long hash,
+    unsigned long long now_ns) {
+  workload_instrumentation_record *record = nullptr;
+  if (!free_records.empty()) {
+    record = free_records.back();
+    free_records.pop_back();
+  } else {
+    record = new workload_instrumentation_record;
+    record->slot = next_record.load(std::memory_order_relaxed);
+  }
+  set_record_workload(record, workload, now_ns);
+
+  // The record must be visible before its index entry is.
+  set_record(record->slot, record);
+  if (record->slot == next_record.load(std::memory_order_relaxed))
+    next_record.store(record->slot + 1, std::memory_order_release);
+
+  auto index = record_index.load(std::memory_order_relaxed);
+  size_t records = next_record.load(std::memory_order_relaxed);
+  if (index == nullptr || records > index->max_entries()) {
+    // Grow the index, it is rebuilt with the new record in it.
+    size_t max_entries = index == nullptr ? 0 : index->max_entries();
+    max_entries = std::max<size_t>(
+        {2 * max_entries, max_workloads_value + PREDEFINED_RECORDS, records});
+    auto old_index = rebuild_record_index(max_entries);
+    if (old_index != nullptr) {
+      workload_thread_cache_flush_all();
+      delete old_index;
+    }
+  } else {
+    index->insert(workload, hash, record->slot);
+  }
+
+  if (record->slot >= PREDEFINED_RECORDS)
+    live_records.fetch_add(1, std::memory_order_relaxed);
+
+  return record;
+}
+
+/* A new random boot id: splitmix64 of both clocks. */
+static unsigned long long new_boot_id() {
+  unsigned long long x =
+      realtime_clock_us() * 1000003ULL ^ monotonic_clock_ns();
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return (x ^ (x >> 31)) | 1;
+}
+
+unsigned long long workload_counters_boot_id() {
+  return counters_boot_id.load(std::memory_order_relaxed);
+}
+
+void workload_set_counters_boot_id(unsigned long long boot_id) {
+  counters_boot_id.store(boot_id, std::memory_order_relaxed);
+}
 
 int workload_instrumentation_pfs_init() {
+  workload_memory_register();
+
   // Lock initialization
   mysql_rwlock_register("workload_instrumentation",
                         all_workload_instrumentation_rwlocks, 1);
@@ -48,6 +262,11 @@ int workload_instrumentation_pfs_init() {
     return result;
   }
 
+  result = workload_thread_cache_init();
+  if (result != 0) return result;
+  result = workload_tags_init();
+  if (result != 0) return result;
+
   // Grab locks to initialize data structures used by component.
   result = mysql_rwlock_wrlock(&LOCK_workload_duration);
   if (result != 0) {
@@ -56,27 +275,16 @@ int workload_instrumentation_pfs_init() {
 
     return result;
   }
-  next_record = 0;
-  workload_instrumentation_array.fill(nullptr);
-  workload_pfs_record_map.clear();
-  pfs_record_duration_us_map.clear();
-
-  std::string predefined_workloads[] = {UNSPECIFIED_WORKLOAD,
-                                        OVERFLOW_WORKLOAD};
-
-  for (std::string predefined_workload : predefined_workloads) {
-    auto record = new workload_instrumentation_record;
-    record->count_queries = 0;
-    record->sum_query_duration_us = 0;
-    record->sum_rows_examined = 0;
-    record->sum_rows_sent = 0;
-    record->sum_rows_affected = 0;
-    record->workload = predefined_workload;
-
-    workload_pfs_record_map[predefined_workload] = next_record;
-    workload_instrumentation_array[next_record] = record;
-    next_record++;
+  clear_records();
+
+  std::string_view predefined_workloads[] = {
+      UNSPECIFIED_WORKLOAD, OVERFLOW_WORKLOAD, EVICTED_WORKLOAD};
+
+  for (std::string_view predefined_workload : predefined_workloads) {
+    add_record(predefined_workload, workload_name_hash(predefined_workload),
+               monotonic_clock_ns());
   }
+  counters_boot_id.store(new_boot_id(), std::memory_order_relaxed);
 
   // Release lock & exit.
   result = mysql_rwlock_unlock(&LOCK_workload_duration);
@@ -89,6 +297,21 @@ int workload_instrumentation_pfs_init() {
 
   init_workload_instrumentation_share(&workload_instrumentation_st_share);
   share_list[0] = &workload_instrumentation_st_share;
+  init_workload_instrumentation_histogram_share(
+      &workload_instrumentation_histogram_st_share);
+  share_list[1] = &workload_instrumentation_histogram_st_share;
+  init_workload_instrumentation_window_share(
+      &workload_instrumentation_window_st_share);
+  share_list[2] = &workload_instrumentation_window_st_share;
+  init_workload_instrumentation_tags_share(
+      &workload_instrumentation_tags_st_share);
+  share_list[3] = &workload_instrumentation_tags_st_share;
+  init_workload_instrumentation_top_digests_share(
+      &workload_instrumentation_top_digests_st_share);
+  share_list[4] = &workload_instrumentation_top_digests_st_share;
+  init_workload_instrumentation_self_stats_share(
+      &workload_instrumentation_self_stats_st_share);
+  share_list[5] = &workload_instrumentation_self_stats_st_share;
 
   auto res = mysql_service_pfs_plugin_table_v1->add_tables(&share_list[0],
                                                            share_list_count);
@@ -111,10 +334,7 @@ int workload_instrumentation_pfs_deinit() {
 
     return result;
   }
-  next_record = 0;
-  workload_instrumentation_array.fill(nullptr);
-  workload_pfs_record_map.clear();
-  pfs_record_duration_us_map.clear();
+  clear_records();
 
   // Release lock.
   result = mysql_rwlock_unlock(&LOCK_workload_duration);
@@ -136,59 +356,248 @@ int workload_instrumentation_pfs_deinit() {
     result = 1;
   }
 
+  if (workload_tags_deinit() != 0) result = 1;
+  if (workload_thread_cache_deinit() != 0) result = 1;
+
   return result;
 }
 
-void record_stats(std::string workload, thread_stats *ts) {
-  timeval now;
-  gettimeofday(&now, nullptr);
+void add_record_counters(workload_instrumentation_record *record,
+                         unsigned int shard, const workload_counters &delta) {
+  update_shard_counters(&record->shards[shard], delta,
+                        &record->resource_shards[shard]);
+}
 
-  unsigned long long duration_us =
-      now.tv_sec * 1000000 + now.tv_usec -
-      (ts->start_time->tv_sec * 1000000 + ts->start_time->tv_usec);
+void update_shard_counters(workload_counter_shard *shard,
+                           const workload_counters &delta,
+                           workload_resource_shard *resources) {
+  auto &counters = *shard;
+  counters.updates_started.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
 
-  auto lock_result = mysql_rwlock_wrlock(&LOCK_workload_duration);
-  if (lock_result != 0) {
-    LogComponentErr(
-        ERROR_LEVEL, ER_LOG_PRINTF_MSG,
-        "Failed to grab lock for storing query stats, skipping this query.");
+  counters.count_queries.fetch_add(delta.count_queries,
+                                   std::memory_order_relaxed);
+  counters.sum_rows_sent.fetch_add(delta.sum_rows_sent,
+                                   std::memory_order_relaxed);
+  counters.sum_rows_examined.fetch_add(delta.sum_rows_examined,
+                                       std::memory_order_relaxed);
+  counters.sum_rows_affected.fetch_add(delta.sum_rows_affected,
+                                       std::memory_order_relaxed);
+  counters.sum_query_duration_ns.fetch_add(delta.sum_query_duration_ns,
+                                           std::memory_order_relaxed);
+  counters.sum_lock_time_ns.fetch_add(delta.sum_lock_time_ns,
+                                      std::memory_order_relaxed);
+  counters.sum_cpu_time_ns.fetch_add(delta.sum_cpu_time_ns,
+                                     std::memory_order_relaxed);
+  if (resources != nullptr) {
+    for (int i = 0; i < WORKLOAD_RESOURCES; i++) {
+      // Most statements use few resources, skip the atomic increments.
+      if (delta.resources[i] != 0)
+        resources->values[i].fetch_add(delta.resources[i],
+                                       std::memory_order_relaxed);
+    }
+  }
 
-    return;
+  counters.updates_done.fetch_add(1, std::memory_order_release);
+}
+
+/*
+  Adds a consistent copy of a shard to counters: if a flush updated the shard
+  while it was being copied, copy it again. Flushes only take a few atomic
+  increments, so this rarely loops more than once.
+*/
+void add_shard_counters(workload_counters *counters,
+                        const workload_counter_shard &shard,
+                        const workload_resource_shard *resources) {
+  workload_counters copy;
+  for (unsigned int attempt = 1;; attempt++) {
+    unsigned int done = shard.updates_done.load(std::memory_order_acquire);
+
+    copy.count_queries = shard.count_queries.load(std::memory_order_relaxed);
+    copy.sum_query_duration_ns =
+        shard.sum_query_duration_ns.load(std::memory_order_relaxed);
+    copy.sum_lock_time_ns =
+        shard.sum_lock_time_ns.load(std::memory_order_relaxed);
+    copy.sum_cpu_time_ns =
+        shard.sum_cpu_time_ns.load(std::memory_order_relaxed);
+    copy.sum_rows_examined =
+        shard.sum_rows_examined.load(std::memory_order_relaxed);
+    copy.sum_rows_sent = shard.sum_rows_sent.load(std::memory_order_relaxed);
+    copy.sum_rows_affected =
+        shard.sum_rows_affected.load(std::memory_order_relaxed);
+    if (resources != nullptr) {
+      for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+        copy.resources[i] =
+            resources->values[i].load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shard.updates_started.load(std::memory_order_relaxed) == done) break;
+    if (attempt % WORKLOAD_SNAPSHOT_SPINS == 0) std::this_thread::yield();
   }
+  counters->add(copy);
+}
 
-  // Map empty workloads to unspecified workloads
-  if (workload == "") {
-    workload = UNSPECIFIED_WORKLOAD;
+void sum_record_counters(workload_counters *counters,
+                         const workload_instrumentation_record *record) {
+  for (unsigned int i = 0; i < WORKLOAD_COUNTER_SHARDS; i++)
+    add_shard_counters(counters, record->shards[i],
+                       &record->resource_shards[i]);
+}
+
+/*
+  Takes the window snapshot of the current minute, unless the record already
+  has one. Snapshots of older minutes are never taken afterwards, in case
+  threads see slightly different times.
+*/
+static void update_window(workload_instrumentation_record *record,
+                          unsigned long long now_ns) {
+  auto &window = record->window;
+  unsigned long long minute = now_ns / NANOS_PER_MINUTE;
+  unsigned long long last = window.last_minute.load(std::memory_order_relaxed);
+  if (last != WORKLOAD_WINDOW_NO_MINUTE && minute <= last) return;
+  if (!window.last_minute.compare_exchange_strong(last, minute,
+                                                  std::memory_order_relaxed))
+    return;
+
+  workload_counters counters;
+  sum_record_counters(&counters, record);
+
+  // Same protocol as add_record_counters(), with the minute checked by readers
+  // before and after copying the slot.
+  auto &slot_minute = window.minutes[minute % WORKLOAD_WINDOW_MINUTES];
+  auto &snapshot = window.snapshots[minute % WORKLOAD_WINDOW_MINUTES];
+  slot_minute.store(WORKLOAD_WINDOW_NO_MINUTE, std::memory_order_relaxed);
+  snapshot.updates_started.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  snapshot.count_queries.store(counters.count_queries,
+                               std::memory_order_relaxed);
+  snapshot.sum_rows_sent.store(counters.sum_rows_sent,
+                               std::memory_order_relaxed);
+  snapshot.sum_rows_examined.store(counters.sum_rows_examined,
+                                   std::memory_order_relaxed);
+  snapshot.sum_rows_affected.store(counters.sum_rows_affected,
+                                   std::memory_order_relaxed);
+  snapshot.sum_query_duration_ns.store(counters.sum_query_duration_ns,
+                                       std::memory_order_relaxed);
+  snapshot.sum_lock_time_ns.store(counters.sum_lock_time_ns,
+                                  std::memory_order_relaxed);
+  snapshot.sum_cpu_time_ns.store(counters.sum_cpu_time_ns,
+                                 std::memory_order_relaxed);
+
+  snapshot.updates_done.fetch_add(1, std::memory_order_release);
+  slot_minute.store(minute, std::memory_order_release);
+}
+
+/*
+  Evicts the workloads without statements for evict_idle_seconds: their
+  counters and histogram are added to the evicted workload, and their records
+  are reset for reuse. Idle workloads are searched at most once a second.
+  Caller must hold LOCK_workload_duration in write mode. Returns whether
+  workloads were evicted.
+*/
+static bool evict_idle_records(unsigned long long now_ns) {
+  unsigned long long idle_ns = evict_idle_seconds_value * NANOS_PER_SECOND;
+  if (idle_ns == 0) return false;
+  if (now_ns < last_eviction_ns.load(std::memory_order_relaxed) +
+                   NANOS_PER_SECOND)
+    return false;
+  last_eviction_ns.store(now_ns, std::memory_order_relaxed);
+
+  std::vector<workload_instrumentation_record *> evicted;
+  size_t slots = next_record.load(std::memory_order_relaxed);
+  for (size_t slot = PREDEFINED_RECORDS; slot < slots; slot++) {
+    auto record = get_record(slot);
+    if (record == nullptr ||
+        record->last_used_ns.load(std::memory_order_relaxed) + idle_ns >
+            now_ns)
+      continue;
+
+    set_record(slot, nullptr);
+    evicted.push_back(record);
   }
-  // Map new workloads that won't fit in the table to the overflow workload
-  if (!workload_pfs_record_map.contains(workload)) {
-    if (next_record == WORKLOAD_MAX_RECORDS + 2) {
-      workload = OVERFLOW_WORKLOAD;
+  if (evicted.empty()) return false;
+
+  live_records.fetch_sub(evicted.size(), std::memory_order_relaxed);
+  auto old_index = rebuild_record_index(
+      record_index.load(std::memory_order_relaxed)->max_entries());
+
+  /*
+    Once every thread cache was unlocked, no thread uses the evicted records
+    or the old index anymore, and the counters cached for them were flushed.
+  */
+  workload_thread_cache_flush_all();
+  delete old_index;
+
+  auto evicted_record = get_record(EVICTED_RECORD_SLOT);
+  update_window(evicted_record, now_ns);
+  for (auto record : evicted) {
+    workload_counters counters;
+    sum_record_counters(&counters, record);
+    add_record_counters(evicted_record, 0, counters);
+
+    unsigned long long histogram[WORKLOAD_HISTOGRAM_BUCKETS];
+    record->histogram.load(histogram);
+    evicted_record->histogram.add(histogram);
+    workload_digest_counters digest;
+    for (unsigned int i = 0; i < WORKLOAD_TOP_DIGESTS; i++) {
+      if (record->top_digests.load(i, &digest))
+        evicted_record->top_digests.add(digest);
     }
+    if (record->estimated.load(std::memory_order_relaxed))
+      evicted_record->estimated.store(true, std::memory_order_relaxed);
+
+    reset_record(record);
+    free_records.push_back(record);
   }
 
-  // For non-existent workloads, create/initialize row with zero values
-  if (!workload_pfs_record_map.contains(workload)) {
-    workload_pfs_record_map[workload] = next_record;
+  return true;
+}
+
+/*
+  Whether a record may be created for a new workload, checked without locking
+  before trying to: either there is room left, or idle workloads may be
+  evicted to make room.
+*/
+static bool may_create_record(unsigned long long now_ns) {
+  if (live_records.load(std::memory_order_relaxed) < max_workloads_value)
+    return true;
+
+  return evict_idle_seconds_value != 0 &&
+         now_ns >= last_eviction_ns.load(std::memory_order_relaxed) +
+                       NANOS_PER_SECOND;
+}
+
+/* Locks LOCK_workload_duration, counting the wait in self stats. */
+static int lock_records(bool exclusive) {
+  unsigned long long start_ns = workload_self_stats_start();
+  int result = exclusive ? mysql_rwlock_wrlock(&LOCK_workload_duration)
+                         : mysql_rwlock_rdlock(&LOCK_workload_duration);
+  workload_self_stats_add(WORKLOAD_SELF_LOCK_WAIT, start_ns);
+  return result;
+}
 
-    auto record = new workload_instrumentation_record;
-    record->workload = workload;
-    record->count_queries = 0;
-    record->sum_rows_examined = 0;
-    record->sum_rows_sent = 0;
-    record->sum_rows_affected = 0;
-    record->sum_query_duration_us = 0;
+/*
+  Creates the record of a new workload if there is room for it, evicting idle
+  workloads if needed. Another thread may have created it meanwhile.
+*/
+static void create_record(std::string_view workload, unsigned long long hash,
+                          unsigned long long now_ns) {
+  auto lock_result = lock_records(true);
+  if (lock_result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to grab lock for storing query stats, counting "
+                    "this query as overflow.");
 
-    workload_instrumentation_array[next_record] = record;
-    next_record++;
+    return;
   }
 
-  auto record = workload_instrumentation_array[workload_pfs_record_map[workload]];
-  record->count_queries += 1;
-  record->sum_rows_sent += ts->rows_sent;
-  record->sum_rows_examined += ts->rows_examined;
-  record->sum_rows_affected += ts->rows_affected;
-  record->sum_query_duration_us += duration_us;
+  if (record_index.load(std::memory_order_relaxed)->find(workload, hash) < 0 &&
+      (live_records.load(std::memory_order_relaxed) < max_workloads_value ||
+       (evict_idle_records(now_ns) &&
+        live_records.load(std::memory_order_relaxed) < max_workloads_value)))
+    add_record(workload, hash, now_ns);
 
   lock_result = mysql_rwlock_unlock(&LOCK_workload_duration);
   if (lock_result != 0) {
@@ -198,69 +607,435 @@ void record_stats(std::string workload, thread_stats *ts) {
   }
 }
 
+/*
+  Returns the record of a workload, or nullptr if it has none. Takes no lock:
+  one hash and a probe of the index. The caller must hold its thread cache
+  lock for as long as it uses the record.
+*/
+static workload_instrumentation_record *find_record(std::string_view workload,
+                                                    unsigned long long hash) {
+  // Map empty workloads to unspecified workloads
+  if (workload.empty()) return get_record(UNSPECIFIED_RECORD_SLOT);
+
+  long slot =
+      record_index.load(std::memory_order_acquire)->find(workload, hash);
+  if (slot < 0) return nullptr;
+  return get_record(slot);
+}
+
+void statement_counters(workload_counters *delta, const thread_stats *ts,
+                        unsigned int weight) {
+  delta->count_queries = weight;
+  delta->sum_rows_sent = ts->rows_sent * weight;
+  delta->sum_rows_examined = ts->rows_examined * weight;
+  delta->sum_rows_affected = ts->rows_affected * weight;
+  delta->sum_query_duration_ns = ts->duration_ns * weight;
+  delta->sum_lock_time_ns = ts->lock_time_ns * weight;
+  delta->sum_cpu_time_ns = ts->cpu_time_ns * weight;
+  for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+    delta->resources[i] = ts->resources[i] * weight;
+}
+
+/*
+  Returns the record of a workload, creating it if there is room for it, or
+  the overflow record. The thread cache is locked on entry and on return, but
+  is unlocked while a record is created, so *cache may change. A valid hint
+  saves the lookup, and is updated otherwise.
+*/
+static workload_instrumentation_record *lookup_record(
+    workload_thread_cache **cache, std::string_view workload,
+    unsigned long long now_ns, workload_record_hint *hint) {
+  /*
+    Read with the cache locked: a record unpublished after this load is not
+    reused before the cache is unlocked.
+  */
+  unsigned long generation =
+      record_index_generation.load(std::memory_order_acquire);
+  workload_instrumentation_record *record = nullptr;
+  if (hint != nullptr && hint->record != nullptr &&
+      hint->generation == generation) {
+    record = hint->record;
+  } else {
+    workload = workload.substr(0, WORKLOAD_NAME_MAX_LENGTH);
+    unsigned long long hash = workload_name_hash(workload);
+
+    record = find_record(workload, hash);
+    if (record == nullptr && may_create_record(now_ns)) {
+      // Creating a record may wait for every thread cache to be unlocked.
+      workload_thread_cache_unlock(*cache);
+      create_record(workload, hash, now_ns);
+      *cache = workload_thread_cache_lock();
+      generation = record_index_generation.load(std::memory_order_acquire);
+      record = find_record(workload, hash);
+    }
+    if (hint != nullptr) *hint = {record, generation};
+  }
+  // Map new workloads that won't fit in the table to the overflow workload
+  if (record == nullptr) record = get_record(OVERFLOW_RECORD_SLOT);
+  return record;
+}
+
+/*
+  Records a statement standing for weight statements, marking the counters of
+  its workload as estimated when some of them were not measured.
+*/
+static void record_statement(std::string_view workload, const thread_stats *ts,
+                             unsigned int weight,
+                             const workload_statement_digest *digest,
+                             workload_record_hint *hint, bool estimated) {
+  unsigned long long lookup_ns = workload_self_stats_now();
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  workload_instrumentation_record *record =
+      lookup_record(&cache, workload, ts->end_ns, hint);
+  unsigned long long update_ns =
+      workload_self_stats_add(WORKLOAD_SELF_LOOKUP, lookup_ns);
+
+  workload_counters delta;
+  statement_counters(&delta, ts, weight);
+
+  // Before the statement is flushed, it belongs to the new minute.
+  update_window(record, ts->end_ns);
+  if (digest != nullptr) {
+    workload_digest_counters digest_delta;
+    digest_delta.digest = digest->hash;
+    digest_delta.text_length = digest->text_length;
+    memcpy(digest_delta.text, digest->text, digest->text_length);
+    digest_delta.count_queries = delta.count_queries;
+    digest_delta.sum_rows_examined = delta.sum_rows_examined;
+    digest_delta.sum_rows_sent = delta.sum_rows_sent;
+    digest_delta.sum_duration_ns = delta.sum_query_duration_ns;
+    // Before the counters, whose flush takes the digests along.
+    workload_thread_cache_add_digest(cache, record, digest_delta);
+  }
+  // Accumulated locally, shared counters are only updated on flushes.
+  workload_thread_cache_add(
+      cache, record, delta, ts->end_ns,
+      workload_latency_histogram::bucket_index(ts->duration_ns /
+                                               NANOS_PER_MICRO));
+  if (estimated && !record->estimated.load(std::memory_order_relaxed))
+    record->estimated.store(true, std::memory_order_relaxed);
+  if (ts->end_ns > record->last_used_ns.load(std::memory_order_relaxed) +
+                       NANOS_PER_SECOND)
+    record->last_used_ns.store(ts->end_ns, std::memory_order_relaxed);
+  workload_self_stats_add(WORKLOAD_SELF_UPDATE, update_ns);
+
+  workload_thread_cache_unlock(cache);
+}
+
+void record_stats(std::string_view workload, const thread_stats *ts,
+                  unsigned int weight, const workload_statement_digest *digest,
+                  workload_record_hint *hint) {
+  record_statement(workload, ts, weight, digest, hint, weight > 1);
+}
+
+void record_skipped_stats(std::string_view workload, const thread_stats *ts,
+                          unsigned int count,
+                          const workload_statement_digest *digest) {
+  record_statement(workload, ts, count, digest, nullptr, true);
+}
+
+void record_nested_stats(std::string_view workload, const thread_stats *ts,
+                         unsigned int weight, workload_record_hint *hint) {
+  unsigned long long lookup_ns = workload_self_stats_now();
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  workload_instrumentation_record *record =
+      lookup_record(&cache, workload, ts->end_ns, hint);
+  unsigned long long update_ns =
+      workload_self_stats_add(WORKLOAD_SELF_LOOKUP, lookup_ns);
+
+  // Only resource counters, which are not windowed: no snapshot to take.
+  workload_counters delta;
+  delta.resources[WORKLOAD_RESOURCE_NESTED_QUERIES] = weight;
+  delta.resources[WORKLOAD_RESOURCE_NESTED_ROWS_EXAMINED] =
+      ts->rows_examined * weight;
+  delta.resources[WORKLOAD_RESOURCE_NESTED_ROWS_SENT] = ts->rows_sent * weight;
+  delta.resources[WORKLOAD_RESOURCE_NESTED_ROWS_AFFECTED] =
+      ts->rows_affected * weight;
+  delta.resources[WORKLOAD_RESOURCE_NESTED_DURATION] =
+      ts->duration_ns * weight;
+  workload_thread_cache_add(cache, record, delta, ts->end_ns);
+  if (weight > 1 && !record->estimated.load(std::memory_order_relaxed))
+    record->estimated.store(true, std::memory_order_relaxed);
+  workload_self_stats_add(WORKLOAD_SELF_UPDATE, update_ns);
+
+  workload_thread_cache_unlock(cache);
+}
+
+void record_resource(std::string_view workload, workload_resource resource,
+                     unsigned long long now_ns, workload_record_hint *hint) {
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  workload_instrumentation_record *record =
+      lookup_record(&cache, workload, now_ns, hint);
+
+  // Rare enough to go straight to the shared counters.
+  workload_counters delta;
+  delta.resources[resource] = 1;
+  add_record_counters(record, 0, delta);
+
+  workload_thread_cache_unlock(cache);
+}
+
+void restore_record_counters(std::string_view workload,
+                             const workload_counters &counters,
+                             const unsigned long long *histogram,
+                             bool estimated) {
+  // Same lookup as record_stats(), without touching the thread's counters.
+  workload_thread_cache *cache = workload_thread_cache_lock();
+  workload_instrumentation_record *record =
+      lookup_record(&cache, workload, monotonic_clock_ns(), nullptr);
+
+  add_record_counters(record, 0, counters);
+  record->histogram.add(histogram);
+  if (estimated) record->estimated.store(true, std::memory_order_relaxed);
+
+  workload_thread_cache_unlock(cache);
+}
+
+int workload_records_rdlock() {
+  int result = lock_records(false);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to grab lock for reading query stats.");
+  }
+  return result;
+}
+
+void workload_records_unlock() { mysql_rwlock_unlock(&LOCK_workload_duration); }
+
+workload_instrumentation_record *workload_record_at(size_t slot) {
+  if (slot >= WORKLOAD_MAX_SEGMENTS * WORKLOAD_RECORDS_PER_SEGMENT)
+    return nullptr;
+  return get_record(slot);
+}
+
+size_t workload_record_slots() {
+  return next_record.load(std::memory_order_acquire);
+}
+
 /* Access to PS table */
-PFS_engine_table_share_proxy *share_list[1] = {nullptr};
-unsigned int share_list_count = 1;
+PFS_engine_table_share_proxy *share_list[6] = {nullptr, nullptr, nullptr,
+                                               nullptr, nullptr, nullptr};
+unsigned int share_list_count = 6;
+
+/*
+  TRUNCATE TABLE: forgets all workloads and resets the predefined ones, which
+  get new records. Query threads never wait: statements that already found
+  their record before the reset are discarded with it, later ones are counted
+  in the new records.
+*/
+int workload_instrumentation_delete_all_rows() {
+  int result = lock_records(true);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to grab lock for truncating query stats.");
+
+    return result;
+  }
+
+  unsigned long long now_ns = monotonic_clock_ns();
+  std::vector<workload_instrumentation_record *> unpublished;
+  size_t slots = next_record.load(std::memory_order_relaxed);
+  for (size_t slot = 0; slot < slots; slot++) {
+    auto record = get_record(slot);
+    if (record == nullptr) continue;
+
+    workload_instrumentation_record *replacement = nullptr;
+    if (slot < PREDEFINED_RECORDS) {
+      replacement = new workload_instrumentation_record;
+      replacement->slot = slot;
+      set_record_workload(
+          replacement, {record->workload, record->workload_length}, now_ns);
+    }
+    set_record(slot, replacement);
+    unpublished.push_back(record);
+  }
+  live_records.store(0, std::memory_order_relaxed);
+  counters_boot_id.store(new_boot_id(), std::memory_order_relaxed);
+  auto old_index = rebuild_record_index(
+      record_index.load(std::memory_order_relaxed)->max_entries());
+
+  // Counters cached for the old records are flushed to them, then dropped.
+  workload_thread_cache_flush_all();
+  delete old_index;
+
+  for (auto record : unpublished) {
+    if (record->slot < PREDEFINED_RECORDS) {
+      delete record;
+    } else {
+      reset_record(record);
+      free_records.push_back(record);
+    }
+  }
+
+  result = mysql_rwlock_unlock(&LOCK_workload_duration);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to release lock after truncating query stats.");
+  }
 
-int workload_instrumentation_delete_all_rows() { return 0; }
+  return result;
+}
 
 PSI_table_handle *workload_instrumentation_open_table(PSI_pos **pos) {
+  // Make counters accumulated by all threads visible to this read.
+  workload_thread_cache_flush_all();
+
   auto temp = new workload_instrumentation_table_handle();
+  temp->m_open_ns = workload_self_stats_start();
+  temp->m_records = workload_record_slots();
   *pos = (PSI_pos *)(&temp->m_pos);
   return (PSI_table_handle *)temp;
 }
 
 void workload_instrumentation_close_table(PSI_table_handle *handle) {
   auto temp = (workload_instrumentation_table_handle *)handle;
+  workload_self_stats_add(WORKLOAD_SELF_TABLE_SCAN, temp->m_open_ns);
   delete temp;
 }
 
+/*
+  Adds up the shards of a record. Each shard is copied consistently and every
+  flush goes to a single shard, so the row never holds part of a statement.
+  Percentiles come from the histogram, which is updated separately.
+*/
 void workload_instrumentation_copy_record(
-    workload_instrumentation_record *dst,
+    workload_instrumentation_row *dst,
     const workload_instrumentation_record *src) {
-  dst->workload = src->workload;
-  dst->count_queries = src->count_queries;
-  dst->sum_query_duration_us = src->sum_query_duration_us;
-  dst->sum_rows_examined = src->sum_rows_examined;
-  dst->sum_rows_sent = src->sum_rows_sent;
-  dst->sum_rows_affected = src->sum_rows_affected;
+  memcpy(dst->workload, src->workload, src->workload_length + 1);
+  dst->counters = workload_counters();
+  sum_record_counters(&dst->counters, src);
+
+  unsigned long long histogram[WORKLOAD_HISTOGRAM_BUCKETS];
+  src->histogram.load(histogram);
+  dst->p50_us = histogram_percentile_us(histogram, 0.50);
+  dst->p95_us = histogram_percentile_us(histogram, 0.95);
+  dst->p99_us = histogram_percentile_us(histogram, 0.99);
+  dst->estimated = src->estimated.load(std::memory_order_relaxed);
 
   return;
 }
 
+static bool workload_instrumentation_index_match(
+    workload_instrumentation_index_by_workload *i,
+    const workload_instrumentation_record *record) {
+  return pfs_string->match_key_string(false, record->workload,
+                                      record->workload_length, &i->m_workload);
+}
+
+/*
+  Copies the record in a slot to the current row, if the slot is used and
+  (with a key) the record matches the key. Returns whether it was copied.
+*/
+static bool workload_instrumentation_copy_slot(
+    workload_instrumentation_table_handle *th, size_t slot,
+    workload_instrumentation_index_by_workload *key) {
+  if (workload_records_rdlock() != 0) return false;
+
+  auto record = get_record(slot);
+  bool copied = record != nullptr &&
+                (key == nullptr ||
+                 workload_instrumentation_index_match(key, record));
+  if (copied) workload_instrumentation_copy_record(&th->m_current_row, record);
+
+  workload_records_unlock();
+  return copied;
+}
+
+/* Slots of evicted workloads are skipped. */
 int workload_instrumentation_rnd_next(PSI_table_handle *handle) {
   auto th = (workload_instrumentation_table_handle *)handle;
 
-  th->m_pos.set_at(&th->m_next_pos);
+  for (th->m_pos.set_at(&th->m_next_pos);
+       th->m_pos.get_index() < th->m_records;
+       th->m_pos.set_after(&th->m_pos)) {
+    if (workload_instrumentation_copy_slot(th, th->m_pos.get_index(),
+                                           nullptr)) {
+      th->m_next_pos.set_after(&th->m_pos);
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int workload_instrumentation_rnd_init(PSI_table_handle *handle, bool) {
+  auto th = (workload_instrumentation_table_handle *)handle;
+  th->m_records = workload_record_slots();
+  return 0;
+}
+
+int workload_instrumentation_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_table_handle *)handle;
   size_t idx = th->m_pos.get_index();
 
-  if (idx >= workload_instrumentation_array.size())
-    return PFS_HA_ERR_END_OF_FILE;
+  if (idx < th->m_records)
+    workload_instrumentation_copy_slot(th, idx, nullptr);
+  return 0;
+}
 
-  auto record = workload_instrumentation_array[idx];
-  if (record == nullptr)
-    return PFS_HA_ERR_END_OF_FILE;
+int workload_instrumentation_index_init(PSI_table_handle *handle,
+                                        unsigned int idx, bool,
+                                        PSI_index_handle **index) {
+  auto th = (workload_instrumentation_table_handle *)handle;
+  if (idx != 0) return PFS_HA_ERR_WRONG_COMMAND;
 
-  workload_instrumentation_copy_record(&th->m_current_row, record);
-  th->m_next_pos.set_after(&th->m_pos);
+  auto i = &th->m_workload_index;
+  i->m_workload.m_name = "WORKLOAD";
+  i->m_workload.m_find_flags = 0;
+  i->m_workload.m_value_buffer = i->m_workload_buffer;
+  i->m_workload.m_value_buffer_capacity = sizeof(i->m_workload_buffer);
+  th->index_num = idx;
 
+  *index = (PSI_index_handle *)i;
   return 0;
 }
 
-int workload_instrumentation_rnd_init(PSI_table_handle *, bool) { return 0; }
+int workload_instrumentation_index_read(PSI_index_handle *index,
+                                        PSI_key_reader *reader,
+                                        unsigned int idx, int find_flag) {
+  if (idx != 0) return PFS_HA_ERR_WRONG_COMMAND;
 
-int workload_instrumentation_rnd_pos(PSI_table_handle *handle) {
+  auto i = (workload_instrumentation_index_by_workload *)index;
+  pfs_string->read_key_string(reader, &i->m_workload, find_flag);
+  return 0;
+}
+
+/*
+  Key lookups are resolved through the workload hash index and touch a single
+  record, other kinds of reads (e.g. ranges) scan all records.
+*/
+int workload_instrumentation_index_next(PSI_table_handle *handle) {
   auto th = (workload_instrumentation_table_handle *)handle;
-  size_t idx = th->m_pos.get_index();
+  auto i = &th->m_workload_index;
+  auto &key = i->m_workload;
 
-  if (idx < workload_instrumentation_array.size()) {
-    auto record = workload_instrumentation_array[idx];
+  if (key.m_find_flags == WORKLOAD_KEY_READ_EXACT && !key.m_is_null) {
+    std::string_view workload(key.m_value_buffer, key.m_value_buffer_length);
+    if (workload_records_rdlock() != 0) return PFS_HA_ERR_END_OF_FILE;
+    long slot = record_index.load(std::memory_order_acquire)
+                    ->find(workload, workload_name_hash(workload));
+    workload_records_unlock();
+
+    // The workload may be evicted meanwhile, its slot is checked again.
+    if (slot < 0 || (size_t)slot < th->m_next_pos.get_index() ||
+        (size_t)slot >= th->m_records ||
+        !workload_instrumentation_copy_slot(th, slot, i))
+      return PFS_HA_ERR_END_OF_FILE;
+
+    th->m_pos.set_index(slot);
+    th->m_next_pos.set_after(&th->m_pos);
+    return 0;
+  }
 
-    if (record != nullptr) {
-      workload_instrumentation_copy_record(&th->m_current_row, record);
+  for (th->m_pos.set_at(&th->m_next_pos);
+       th->m_pos.get_index() < th->m_records;
+       th->m_pos.set_after(&th->m_pos)) {
+    if (workload_instrumentation_copy_slot(th, th->m_pos.get_index(), i)) {
+      th->m_next_pos.set_after(&th->m_pos);
+      return 0;
     }
   }
-  return 0;
+  return PFS_HA_ERR_END_OF_FILE;
 }
 
 void workload_instrumentation_reset_position(PSI_table_handle *handle) {
@@ -273,51 +1048,68 @@ int workload_instrumentation_read_column_value(PSI_table_handle *handle,
                                                PSI_field *field,
                                                unsigned int index) {
   auto th = (workload_instrumentation_table_handle *)handle;
-
-  PSI_ulonglong *count_queries, *rows_examined, *rows_sent, *rows_affected, *duration_us;
+  auto &row = th->m_current_row;
 
   switch (index) {
     case 0: /* WORKLOAD */
-      pfs_string->set_varchar_utf8mb4(field, (th->m_current_row.workload.c_str()));
+      pfs_string->set_varchar_utf8mb4(field, row.workload);
       break;
     case 1: /* COUNT_QUERIES */
-      count_queries = new PSI_ulonglong;
-      count_queries->is_null = false;
-      count_queries->val = th->m_current_row.count_queries;
-      pfs_bigint->set_unsigned(field, *count_queries);
+      pfs_bigint->set_unsigned(field, {row.counters.count_queries, false});
       break;
     case 2: /* ROWS_EXAMINED */
-      rows_examined = new PSI_ulonglong;
-      rows_examined->is_null = false;
-      rows_examined->val = th->m_current_row.sum_rows_examined;
-      pfs_bigint->set_unsigned(field, *rows_examined);
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_examined, false});
       break;
     case 3: /* ROWS_SENT */
-      rows_sent = new PSI_ulonglong;
-      rows_sent->is_null = false;
-      rows_sent->val = th->m_current_row.sum_rows_sent;
-      pfs_bigint->set_unsigned(field, *rows_sent);
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_sent, false});
       break;
     case 4: /* ROWS_AFFECTED */
-      rows_affected = new PSI_ulonglong;
-      rows_affected->is_null = false;
-      rows_affected->val = th->m_current_row.sum_rows_affected;
-      pfs_bigint->set_unsigned(field, *rows_affected);
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_affected, false});
       break;
     case 5: /* DURATION_US */
-      duration_us = new PSI_ulonglong;
-      duration_us->is_null = false;
-      duration_us->val = th->m_current_row.sum_query_duration_us;
-      pfs_bigint->set_unsigned(field, *duration_us);
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_query_duration_ns / NANOS_PER_MICRO, false});
+      break;
+    case 6: /* P50_DURATION_US */
+      pfs_bigint->set_unsigned(field, {row.p50_us, false});
+      break;
+    case 7: /* P95_DURATION_US */
+      pfs_bigint->set_unsigned(field, {row.p95_us, false});
+      break;
+    case 8: /* P99_DURATION_US */
+      pfs_bigint->set_unsigned(field, {row.p99_us, false});
+      break;
+    case 9: /* SUM_LOCK_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_lock_time_ns / NANOS_PER_MICRO, false});
       break;
-    default: /* We should never reach here */
+    case 10: /* SUM_CPU_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_cpu_time_ns / NANOS_PER_MICRO, false});
+      break;
+    case 11: /* ESTIMATED */
+      pfs_string->set_varchar_utf8mb4(field, row.estimated ? "YES" : "NO");
+      break;
+    default:
+      /* SUM_CREATED_TMP_DISK_TABLES to SUM_NESTED_DURATION_US, see
+         workload_resource */
+      if (index >= WORKLOAD_FIRST_RESOURCE_COLUMN &&
+          index < WORKLOAD_FIRST_RESOURCE_COLUMN + WORKLOAD_RESOURCES) {
+        unsigned int resource = index - WORKLOAD_FIRST_RESOURCE_COLUMN;
+        unsigned long long value = row.counters.resources[resource];
+        if (resource == WORKLOAD_RESOURCE_NESTED_DURATION)
+          value /= NANOS_PER_MICRO;
+        pfs_bigint->set_unsigned(field, {value, false});
+        break;
+      }
+      /* We should never reach here */
       assert(0);
   }
   return 0;
 }
 
 unsigned long long workload_instrumentation_get_row_count(void) {
-  return WORKLOAD_MAX_RECORDS + 2;
+  return workload_record_slots();
 }
 
 void init_workload_instrumentation_share(PFS_engine_table_share_proxy *share) {
@@ -325,18 +1117,30 @@ void init_workload_instrumentation_share(PFS_engine_table_share_proxy *share) {
   share->m_table_name_length = 24;
   share->m_table_definition =
       "`WORKLOAD` varchar(50), `COUNT_QUERIES` BIGINT UNSIGNED, `SUM_ROWS_EXAMINED` BIGINT UNSIGNED, "
-      "`SUM_ROWS_SENT` BIGINT UNSIGNED, `SUM_ROWS_AFFECTED` BIGINT UNSIGNED, `SUM_DURATION_US` BIGINT UNSIGNED";
+      "`SUM_ROWS_SENT` BIGINT UNSIGNED, `SUM_ROWS_AFFECTED` BIGINT UNSIGNED, `SUM_DURATION_US` BIGINT UNSIGNED, "
+      "`P50_DURATION_US` BIGINT UNSIGNED, `P95_DURATION_US` BIGINT UNSIGNED, `P99_DURATION_US` BIGINT UNSIGNED, "
+      "`SUM_LOCK_TIME_US` BIGINT UNSIGNED, `SUM_CPU_TIME_US` BIGINT UNSIGNED, "
+      "`ESTIMATED` varchar(3), `SUM_CREATED_TMP_DISK_TABLES` BIGINT UNSIGNED, "
+      "`SUM_SORT_MERGE_PASSES` BIGINT UNSIGNED, `SUM_SELECT_FULL_JOIN` BIGINT UNSIGNED, "
+      "`SUM_SELECT_SCAN` BIGINT UNSIGNED, `SUM_BYTES_SENT` BIGINT UNSIGNED, "
+      "`SUM_BYTES_RECEIVED` BIGINT UNSIGNED, `SUM_ERRORS` BIGINT UNSIGNED, "
+      "`SUM_WARNINGS` BIGINT UNSIGNED, `SUM_TIMEOUTS` BIGINT UNSIGNED, "
+      "`COUNT_THROTTLED` BIGINT UNSIGNED, `COUNT_REJECTED` BIGINT UNSIGNED, "
+      "`COUNT_NESTED_QUERIES` BIGINT UNSIGNED, `SUM_NESTED_ROWS_EXAMINED` BIGINT UNSIGNED, "
+      "`SUM_NESTED_ROWS_SENT` BIGINT UNSIGNED, `SUM_NESTED_ROWS_AFFECTED` BIGINT UNSIGNED, "
+      "`SUM_NESTED_DURATION_US` BIGINT UNSIGNED, "
+      "PRIMARY KEY (`WORKLOAD`)";
   share->m_ref_length = sizeof(workload_instrumentation_POS);
-  share->m_acl = READONLY;
+  share->m_acl = TRUNCATABLE;
   share->get_row_count = workload_instrumentation_get_row_count;
   share->delete_all_rows = workload_instrumentation_delete_all_rows;
 
   share->m_proxy_engine_table = {workload_instrumentation_rnd_next,
                                  workload_instrumentation_rnd_init,
                                  workload_instrumentation_rnd_pos,
-                                 nullptr,
-                                 nullptr,
-                                 nullptr,
+                                 workload_instrumentation_index_init,
+                                 workload_instrumentation_index_read,
+                                 workload_instrumentation_index_next,
                                  workload_instrumentation_read_column_value,
                                  workload_instrumentation_reset_position,
                                  nullptr,
@@ -1,25 +1,187 @@
 #ifndef MYSQL_WORKLOAD_INSTRUMENTATION_PFS_H
 #define MYSQL_WORKLOAD_INSTRUMENTATION_PFS_H
 
+#include "array"
+#include "atomic"
 #include "chrono"
-#include "map"
+#include "string_view"
 
 #include <mysql/components/component_implementation.h>
 #include <mysql/components/services/bits/mysql_rwlock_bits.h>
 #include <mysql/components/services/bits/psi_rwlock_bits.h>
 #include <mysql/components/services/pfs_plugin_table_service.h>
 
+#include "workload_instrumentation_digest.h"
+#include "workload_instrumentation_histogram.h"
+#include "workload_instrumentation_index.h"
+#include "workload_instrumentation_memory.h"
+#include "workload_instrumentation_thd_stats.h"
+
 #define LOG_COMPONENT_TAG "workload_instrumentation"
 
-struct thread_stats;
+/*
+  Number of counter shards per workload. Each thread updates a single shard,
+  so concurrent statements of the same workload do not bounce one cache line
+  between cores. Readers add up all shards. Memory per workload is
+  WORKLOAD_COUNTER_SHARDS cache lines (1KiB with 16 shards).
+*/
+#define WORKLOAD_COUNTER_SHARDS 16
+
+struct alignas(64) workload_counter_shard {
+  /*
+    Seqlock allowing several writers: an update increments updates_started,
+    then the counters, then updates_done. Readers copy the counters until no
+    update started or finished meanwhile, so a copy never holds part of a
+    flush. Writers never wait.
+  */
+  std::atomic<unsigned int> updates_started{0};
+  std::atomic<unsigned int> updates_done{0};
+  std::atomic<unsigned long long> count_queries{0};
+  std::atomic<unsigned long long> sum_rows_examined{0};
+  std::atomic<unsigned long long> sum_rows_sent{0};
+  std::atomic<unsigned long long> sum_rows_affected{0};
+  std::atomic<unsigned long long> sum_query_duration_ns{0};
+  std::atomic<unsigned long long> sum_lock_time_ns{0};
+  std::atomic<unsigned long long> sum_cpu_time_ns{0};
+
+  /* Only allowed while no thread can update or read the shard. */
+  void reset() {
+    updates_started.store(0, std::memory_order_relaxed);
+    updates_done.store(0, std::memory_order_relaxed);
+    count_queries.store(0, std::memory_order_relaxed);
+    sum_rows_examined.store(0, std::memory_order_relaxed);
+    sum_rows_sent.store(0, std::memory_order_relaxed);
+    sum_rows_affected.store(0, std::memory_order_relaxed);
+    sum_query_duration_ns.store(0, std::memory_order_relaxed);
+    sum_lock_time_ns.store(0, std::memory_order_relaxed);
+    sum_cpu_time_ns.store(0, std::memory_order_relaxed);
+  }
+};
+
+static_assert(sizeof(workload_counter_shard) == 64);
+
+/* Resource counters per shard, two cache lines leaving room for more. */
+#define WORKLOAD_RESOURCE_SLOTS 16
+
+/*
+  Resource counters of a shard, see workload_resource. They are kept apart
+  from the core counters, which stay on a single cache line, and are updated
+  under the seqlock of the workload_counter_shard they go with.
+*/
+struct alignas(64) workload_resource_shard {
+  std::array<std::atomic<unsigned long long>, WORKLOAD_RESOURCE_SLOTS> values;
+
+  workload_resource_shard() { reset(); }
+
+  /* Only allowed while no thread can update or read the shard. */
+  void reset() {
+    for (auto &value : values) value.store(0, std::memory_order_relaxed);
+  }
+};
+
+static_assert(sizeof(workload_resource_shard) == 128);
+static_assert(WORKLOAD_RESOURCES <= WORKLOAD_RESOURCE_SLOTS);
+
+/* Failed copies of a shard before a reader yields the CPU to writers. */
+#define WORKLOAD_SNAPSHOT_SPINS 16
+
+/*
+  Cumulative counters of a workload at the start of each of the last
+  WORKLOAD_WINDOW_MINUTES minutes it had statements in: the first statement of
+  a minute copies the counters into the minute's slot, and the counters of
+  any past minute are those of the next snapshot. Windowed counters are the
+  difference between two snapshots. Counters cached by threads count in the
+  minute they are flushed. Resource counters are not windowed.
+*/
+#define WORKLOAD_WINDOW_MINUTES 16
+#define WORKLOAD_WINDOW_NO_MINUTE (~0ULL)
+
+struct workload_window {
+  /* Minute of the latest snapshot. */
+  std::atomic<unsigned long long> last_minute;
+  /* Minute held by each slot, written last so readers can check it. */
+  std::array<std::atomic<unsigned long long>, WORKLOAD_WINDOW_MINUTES> minutes;
+  std::array<workload_counter_shard, WORKLOAD_WINDOW_MINUTES> snapshots;
+
+  workload_window() { reset(); }
 
-struct workload_instrumentation_record {
-  std::string workload;
-  unsigned long long count_queries;
-  unsigned long long sum_rows_examined;
-  unsigned long long sum_rows_sent;
-  unsigned long long sum_rows_affected;
-  unsigned long long sum_query_duration_us;
+  /* Only allowed while no thread can update or read the window. */
+  void reset() {
+    last_minute.store(WORKLOAD_WINDOW_NO_MINUTE, std::memory_order_relaxed);
+    for (auto &minute : minutes)
+      minute.store(WORKLOAD_WINDOW_NO_MINUTE, std::memory_order_relaxed);
+    for (auto &snapshot : snapshots) snapshot.reset();
+  }
+};
+
+/*
+  Shared per workload record. The workload name is immutable while the record
+  is published, counters are only updated with relaxed atomic increments.
+  Records of evicted workloads are reset and reused for new workloads, in the
+  same slot.
+*/
+struct workload_instrumentation_record
+    : workload_memory_accounted<WORKLOAD_MEMORY_RECORDS> {
+  char workload[WORKLOAD_NAME_MAX_LENGTH + 1];
+  unsigned int workload_length;
+  unsigned int slot;
+  /* Monotonic time of the last statement, updated at most once a second. */
+  std::atomic<unsigned long long> last_used_ns{0};
+  /* Whether counters were extrapolated from sampled statements. */
+  std::atomic<bool> estimated{false};
+  std::array<workload_counter_shard, WORKLOAD_COUNTER_SHARDS> shards;
+  std::array<workload_resource_shard, WORKLOAD_COUNTER_SHARDS> resource_shards;
+  /* Both added to when thread caches are flushed, like the counters. */
+  workload_latency_histogram histogram;
+  workload_top_digests top_digests;
+  workload_window window;
+};
+
+/* Plain (non atomic) set of per workload counters. */
+struct workload_counters {
+  unsigned long long count_queries = 0;
+  unsigned long long sum_rows_examined = 0;
+  unsigned long long sum_rows_sent = 0;
+  unsigned long long sum_rows_affected = 0;
+  unsigned long long sum_query_duration_ns = 0;
+  unsigned long long sum_lock_time_ns = 0;
+  unsigned long long sum_cpu_time_ns = 0;
+  /* Indexed by workload_resource. */
+  std::array<unsigned long long, WORKLOAD_RESOURCES> resources{};
+
+  void add(const workload_counters &other) {
+    count_queries += other.count_queries;
+    sum_rows_examined += other.sum_rows_examined;
+    sum_rows_sent += other.sum_rows_sent;
+    sum_rows_affected += other.sum_rows_affected;
+    sum_query_duration_ns += other.sum_query_duration_ns;
+    sum_lock_time_ns += other.sum_lock_time_ns;
+    sum_cpu_time_ns += other.sum_cpu_time_ns;
+    for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+      resources[i] += other.resources[i];
+  }
+
+  void subtract(const workload_counters &other) {
+    count_queries -= other.count_queries;
+    sum_rows_examined -= other.sum_rows_examined;
+    sum_rows_sent -= other.sum_rows_sent;
+    sum_rows_affected -= other.sum_rows_affected;
+    sum_query_duration_ns -= other.sum_query_duration_ns;
+    sum_lock_time_ns -= other.sum_lock_time_ns;
+    sum_cpu_time_ns -= other.sum_cpu_time_ns;
+    for (int i = 0; i < WORKLOAD_RESOURCES; i++)
+      resources[i] -= other.resources[i];
+  }
+};
+
+/* Point in time copy of a record, as returned to P_S readers. */
+struct workload_instrumentation_row {
+  char workload[WORKLOAD_NAME_MAX_LENGTH + 1];
+  workload_counters counters;
+  unsigned long long p50_us;
+  unsigned long long p95_us;
+  unsigned long long p99_us;
+  bool estimated;
 };
 
 class workload_instrumentation_POS {
@@ -32,17 +194,29 @@ class workload_instrumentation_POS {
 
   void reset() { m_index = 0; }
   unsigned int get_index() { return m_index; }
+  void set_index(unsigned int index) { m_index = index; }
   void set_at(workload_instrumentation_POS *pos) { m_index = pos->m_index; }
   void set_after(workload_instrumentation_POS *pos) {
     m_index = pos->m_index + 1;
   }
 };
 
+/* PRIMARY KEY (WORKLOAD) */
+struct workload_instrumentation_index_by_workload {
+  PSI_plugin_key_string m_workload;
+  char m_workload_buffer[WORKLOAD_NAME_MAX_LENGTH];
+};
+
 struct workload_instrumentation_table_handle {
   workload_instrumentation_POS m_pos;
   workload_instrumentation_POS m_next_pos;
-  workload_instrumentation_record m_current_row;
+  workload_instrumentation_row m_current_row;
+  workload_instrumentation_index_by_workload m_workload_index;
   unsigned int index_num;
+  /* Record slots used when the scan started, later ones are not returned. */
+  size_t m_records;
+  /* Monotonic time the table was opened, for self stats. */
+  unsigned long long m_open_ns;
 };
 
 void init_workload_instrumentation_share(PFS_engine_table_share_proxy *share);
@@ -51,8 +225,101 @@ extern PFS_engine_table_share_proxy workload_instrumentation_st_share;
 extern PFS_engine_table_share_proxy *share_list[];
 extern unsigned int share_list_count;
 
+/*
+  Records can be evicted, and their slot reused, at any time. P_S readers copy
+  a record while holding the read lock, so it does not change meanwhile.
+*/
+int workload_records_rdlock();
+void workload_records_unlock();
+/* Returns the record in a slot, or nullptr for free and unused slots. */
+workload_instrumentation_record *workload_record_at(size_t slot);
+/* Number of slots used so far, including free ones. */
+size_t workload_record_slots();
+/* Copies a record into a row, while holding the read lock. */
+void workload_instrumentation_copy_record(
+    workload_instrumentation_row *dst,
+    const workload_instrumentation_record *src);
+
+/*
+  Record a thread resolved a workload name to. It stays valid for the
+  thread's later statements of the workload until the record index is
+  replaced, which changes its generation, so they can skip hashing and the
+  index lookup.
+*/
+struct workload_record_hint {
+  workload_instrumentation_record *record = nullptr;
+  unsigned long generation = 0;
+};
+
+/*
+  Records a statement standing for weight statements, see sampling, and its
+  digest unless it is nullptr. When hint is not nullptr, its record is used
+  if it is still valid, otherwise it is set to the record found.
+*/
+void record_stats(std::string_view workload, const thread_stats *thd_stats,
+                  unsigned int weight,
+                  const workload_statement_digest *digest = nullptr,
+                  workload_record_hint *hint = nullptr);
+/*
+  Records count statements skipped by sampling as copies of a recorded one,
+  see sample_release(). The counters of the workload are estimated, whatever
+  the count.
+*/
+void record_skipped_stats(std::string_view workload, const thread_stats *ts,
+                          unsigned int count,
+                          const workload_statement_digest *digest);
+/*
+  Records a statement run by a stored program, standing for weight
+  statements, in the nested counters of a workload: those of its top-level
+  statement. hint is used as by record_stats().
+*/
+void record_nested_stats(std::string_view workload, const thread_stats *ts,
+                         unsigned int weight,
+                         workload_record_hint *hint = nullptr);
+/*
+  Counts one occurrence of a resource for a workload, outside of the counters
+  of its statements, e.g. a statement throttled when it starts.
+*/
+void record_resource(std::string_view workload, workload_resource resource,
+                     unsigned long long now_ns,
+                     workload_record_hint *hint = nullptr);
+/* Counters of a statement standing for weight statements. */
+void statement_counters(workload_counters *delta, const thread_stats *ts,
+                        unsigned int weight);
+void add_record_counters(workload_instrumentation_record *record,
+                         unsigned int shard, const workload_counters &delta);
+/*
+  Adds delta to a shard, following its seqlock protocol, and its resource
+  counters to resources unless it is nullptr.
+*/
+void update_shard_counters(workload_counter_shard *shard,
+                           const workload_counters &delta,
+                           workload_resource_shard *resources = nullptr);
+/* Adds a consistent copy of a shard, and of its resources, to counters. */
+void add_shard_counters(workload_counters *counters,
+                        const workload_counter_shard &shard,
+                        const workload_resource_shard *resources = nullptr);
+/* Adds up the counters of all shards of a record. */
+void sum_record_counters(workload_counters *counters,
+                         const workload_instrumentation_record *record);
+/*
+  Random id of the current run of the counters. It changes whenever they
+  restart from zero (component installed without a snapshot to restore,
+  TRUNCATE), so consumers can tell resets apart. Never 0.
+*/
+unsigned long long workload_counters_boot_id();
+/* Continues the run of restored counters. */
+void workload_set_counters_boot_id(unsigned long long boot_id);
+
+/*
+  Adds restored counters and histogram buckets to a workload, creating its
+  record if there is room, or to the overflow workload otherwise.
+*/
+void restore_record_counters(std::string_view workload,
+                             const workload_counters &counters,
+                             const unsigned long long *histogram,
+                             bool estimated);
 
-void record_stats(std::string workload, thread_stats *thd_stats);
 int workload_instrumentation_pfs_init();
 int workload_instrumentation_pfs_deinit();
 
@@ -0,0 +1,109 @@
+#include "workload_instrumentation_sampling.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_tags.h"
+#include "workload_instrumentation_thd_stats.h"
+
+#include <cstdint>
+#include <cstring>
+
+struct sampling_state {
+  /* Statements to skip before the next recorded one. */
+  unsigned int countdown = 0;
+  /* Statements skipped since the last recorded one. */
+  unsigned int skipped = 0;
+  /* Whether the start of the current statement was seen, and skipped. */
+  bool started = false;
+  bool skip = false;
+  /* xorshift64* state, seeded on first use. */
+  unsigned long long random = 0;
+
+  unsigned int last_workload_length = 0;
+  char last_workload[WORKLOAD_NAME_MAX_LENGTH];
+  bool has_last = false;
+  thread_stats last_stats;
+  bool has_last_digest = false;
+  workload_statement_digest last_digest;
+  bool has_last_tags = false;
+  workload_tag_hint last_tags;
+};
+
+static thread_local sampling_state sampling;
+
+static unsigned long long next_random(sampling_state *state) {
+  if (state->random == 0)
+    state->random = (monotonic_clock_ns() ^ (uintptr_t)state) | 1;
+
+  state->random ^= state->random >> 12;
+  state->random ^= state->random << 25;
+  state->random ^= state->random >> 27;
+  return state->random * 2685821657736338717ULL;
+}
+
+bool sample_statement_start() {
+  unsigned int rate = sample_rate_value;
+  sampling.started = true;
+  if (rate <= 1) sampling.countdown = 0;
+
+  sampling.skip = sampling.countdown > 0;
+  if (sampling.skip) {
+    sampling.countdown--;
+    return false;
+  }
+
+  // Uniform between 0 and 2 * (rate - 1), rate - 1 on average.
+  if (rate > 1)
+    sampling.countdown = next_random(&sampling) % (2ULL * (rate - 1) + 1);
+  return true;
+}
+
+unsigned int sample_statement_end() {
+  bool skip = sampling.started && sampling.skip;
+  sampling.started = false;
+  if (skip) {
+    sampling.skipped++;
+    return 0;
+  }
+
+  unsigned int weight = sampling.skipped + 1;
+  sampling.skipped = 0;
+  return weight;
+}
+
+unsigned int sample_statement_weight() { return sampling.skipped + 1; }
+
+void sample_statement_recorded(std::string_view workload,
+                               const thread_stats *ts,
+                               const workload_statement_digest *digest,
+                               const workload_tag_hint *tags) {
+  workload = workload.substr(0, WORKLOAD_NAME_MAX_LENGTH);
+  memcpy(sampling.last_workload, workload.data(), workload.size());
+  sampling.last_workload_length = workload.size();
+  sampling.last_stats = *ts;
+  sampling.has_last = true;
+  sampling.has_last_digest = digest != nullptr;
+  if (digest != nullptr) sampling.last_digest = *digest;
+  sampling.has_last_tags = tags != nullptr;
+  if (tags != nullptr) sampling.last_tags = *tags;
+}
+
+void sample_release() {
+  if (sampling.skipped > 0 && sampling.has_last) {
+    // The skipped statements ended since, the window they count in is now.
+    thread_stats ts = sampling.last_stats;
+    ts.end_ns = monotonic_clock_ns();
+    record_skipped_stats(
+        {sampling.last_workload, sampling.last_workload_length}, &ts,
+        sampling.skipped,
+        sampling.has_last_digest ? &sampling.last_digest : nullptr);
+    if (sampling.has_last_tags)
+      record_tag_stats(&sampling.last_tags, &ts, sampling.skipped);
+  }
+
+  // Threads may be reused for other connections.
+  sampling.countdown = 0;
+  sampling.skipped = 0;
+  sampling.started = false;
+  sampling.has_last = false;
+}
@@ -0,0 +1,55 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_SAMPLING_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_SAMPLING_H
+
+#include <string_view>
+
+struct thread_stats;
+struct workload_statement_digest;
+struct workload_tag_hint;
+
+/*
+  Statement sampling, enabled by workload_instrumentation.sample_rate. Each
+  thread records a statement, then skips a random number of statements
+  (sample_rate - 1 on average, so that periodic patterns of statements do not
+  bias the sample). Skipped statements are neither parsed nor measured.
+
+  A recorded statement stands for itself and the statements skipped before
+  it: its counters are multiplied by that weight. Statements skipped after
+  the last recorded one are accounted for at disconnect, as copies of it in
+  its workload, digest and tags, so the total of COUNT_QUERIES over all
+  workloads stays exact.
+*/
+
+/* At EVENT_TRACKING_QUERY_START, returns whether the statement is recorded. */
+bool sample_statement_start();
+
+/*
+  At EVENT_TRACKING_QUERY_STATUS_END, returns the weight of the statement, or
+  0 if it is skipped. Statements whose start was not seen are recorded.
+*/
+unsigned int sample_statement_end();
+
+/*
+  The weight the statement running on the thread will have when it ends,
+  provided it is recorded. Statements of the stored programs it runs are not
+  sampled on their own: they count with that weight.
+*/
+unsigned int sample_statement_weight();
+
+/*
+  Remembers the last recorded statement of the calling thread, with its
+  digest and tags unless they are nullptr.
+*/
+void sample_statement_recorded(std::string_view workload,
+                               const thread_stats *ts,
+                               const workload_statement_digest *digest,
+                               const workload_tag_hint *tags);
+
+/*
+  At disconnect, records the statements skipped since the last recorded one
+  as more statements like it, ending now. The counters of its workload are
+  marked estimated.
+*/
+void sample_release();
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_SAMPLING_H
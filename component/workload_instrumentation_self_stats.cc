@@ -0,0 +1,262 @@
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_sysvars.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+
+extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
+
+struct alignas(64) workload_self_stats_shard {
+  std::array<std::atomic<unsigned long long>, WORKLOAD_SELF_STATS> counts;
+  std::array<std::atomic<unsigned long long>, WORKLOAD_SELF_STATS> sums_ns;
+  std::atomic<unsigned long long> bytes_scanned{0};
+
+  workload_self_stats_shard() { reset(); }
+
+  void reset() {
+    for (auto &count : counts) count.store(0, std::memory_order_relaxed);
+    for (auto &sum : sums_ns) sum.store(0, std::memory_order_relaxed);
+    bytes_scanned.store(0, std::memory_order_relaxed);
+  }
+};
+
+static workload_self_stats_shard self_stats_shards[WORKLOAD_SELF_STATS_SHARDS];
+
+/* Measures of the callback running on the thread. */
+struct self_stats_state {
+  /* Statements to skip before the next measured one. */
+  unsigned int countdown = 0;
+  /* Whether the current top-level statement is measured. */
+  bool statement_measured = false;
+  /* Whether a measured callback is running. */
+  bool in_callback = false;
+  workload_instrumentation_self_stats_row pending = {};
+};
+
+static thread_local self_stats_state self_stats;
+
+static workload_self_stats_shard &current_shard() {
+  int cpu = sched_getcpu();
+  return self_stats_shards[cpu < 0 ? 0 : cpu % WORKLOAD_SELF_STATS_SHARDS];
+}
+
+static void add_to_shard(const workload_instrumentation_self_stats_row &row) {
+  workload_self_stats_shard &shard = current_shard();
+  for (int i = 0; i < WORKLOAD_SELF_STATS; i++) {
+    if (row.counts[i] == 0) continue;
+    shard.counts[i].fetch_add(row.counts[i], std::memory_order_relaxed);
+    shard.sums_ns[i].fetch_add(row.sums_ns[i], std::memory_order_relaxed);
+  }
+  if (row.bytes_scanned != 0)
+    shard.bytes_scanned.fetch_add(row.bytes_scanned,
+                                  std::memory_order_relaxed);
+}
+
+unsigned long long workload_self_stats_callback_start(bool statement_start) {
+  unsigned int rate = self_stats_sample_rate_value;
+  if (rate == 0) return 0;
+
+  if (statement_start) {
+    self_stats.statement_measured = self_stats.countdown == 0;
+    if (self_stats.statement_measured) {
+      // Uniform between 0 and 2 * (rate - 1), so that periodic patterns of
+      // statements do not bias the measures. The clock is random enough.
+      self_stats.countdown =
+          rate > 1 ? monotonic_clock_ns() % (2ULL * (rate - 1) + 1) : 0;
+    } else {
+      self_stats.countdown = std::min(self_stats.countdown - 1, rate - 1);
+    }
+  }
+  if (!self_stats.statement_measured) return 0;
+
+  self_stats.in_callback = true;
+  return monotonic_clock_ns();
+}
+
+void workload_self_stats_callback_end(unsigned long long start_ns) {
+  if (start_ns == 0) return;
+
+  workload_self_stats_add(WORKLOAD_SELF_CALLBACK, start_ns);
+  self_stats.in_callback = false;
+  add_to_shard(self_stats.pending);
+  self_stats.pending = {};
+}
+
+unsigned long long workload_self_stats_now() {
+  return self_stats.in_callback ? monotonic_clock_ns() : 0;
+}
+
+unsigned long long workload_self_stats_start() {
+  return self_stats_sample_rate_value != 0 ? monotonic_clock_ns() : 0;
+}
+
+unsigned long long workload_self_stats_add(workload_self_stat stat,
+                                           unsigned long long start_ns) {
+  if (start_ns == 0) return 0;
+
+  unsigned long long end_ns = monotonic_clock_ns();
+  workload_instrumentation_self_stats_row measure = {};
+  auto &row = self_stats.in_callback ? self_stats.pending : measure;
+  row.counts[stat]++;
+  row.sums_ns[stat] += end_ns > start_ns ? end_ns - start_ns : 0;
+  // Measures outside of callbacks, e.g. table scans, are added right away.
+  if (!self_stats.in_callback) add_to_shard(measure);
+  return end_ns;
+}
+
+void workload_self_stats_scanned(size_t bytes) {
+  if (self_stats.in_callback) self_stats.pending.bytes_scanned += bytes;
+}
+
+/* Access to PS table */
+int workload_instrumentation_self_stats_delete_all_rows() {
+  for (auto &shard : self_stats_shards) shard.reset();
+  return 0;
+}
+
+PSI_table_handle *workload_instrumentation_self_stats_open_table(
+    PSI_pos **pos) {
+  auto temp = new workload_instrumentation_self_stats_table_handle();
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return (PSI_table_handle *)temp;
+}
+
+void workload_instrumentation_self_stats_close_table(
+    PSI_table_handle *handle) {
+  auto temp = (workload_instrumentation_self_stats_table_handle *)handle;
+  delete temp;
+}
+
+static void workload_instrumentation_self_stats_copy_row(
+    workload_instrumentation_self_stats_row *dst) {
+  *dst = {};
+  for (auto &shard : self_stats_shards) {
+    for (int i = 0; i < WORKLOAD_SELF_STATS; i++) {
+      dst->counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+      dst->sums_ns[i] += shard.sums_ns[i].load(std::memory_order_relaxed);
+    }
+    dst->bytes_scanned += shard.bytes_scanned.load(std::memory_order_relaxed);
+  }
+}
+
+int workload_instrumentation_self_stats_rnd_next(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_self_stats_table_handle *)handle;
+  th->m_pos = th->m_next_pos;
+  if (th->m_pos > 0) return PFS_HA_ERR_END_OF_FILE;
+
+  workload_instrumentation_self_stats_copy_row(&th->m_current_row);
+  th->m_next_pos = th->m_pos + 1;
+  return 0;
+}
+
+int workload_instrumentation_self_stats_rnd_init(PSI_table_handle *, bool) {
+  return 0;
+}
+
+int workload_instrumentation_self_stats_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_self_stats_table_handle *)handle;
+  if (th->m_pos == 0)
+    workload_instrumentation_self_stats_copy_row(&th->m_current_row);
+  return 0;
+}
+
+void workload_instrumentation_self_stats_reset_position(
+    PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_self_stats_table_handle *)handle;
+  th->m_pos = 0;
+  th->m_next_pos = 0;
+}
+
+int workload_instrumentation_self_stats_read_column_value(
+    PSI_table_handle *handle, PSI_field *field, unsigned int index) {
+  auto th = (workload_instrumentation_self_stats_table_handle *)handle;
+  auto &row = th->m_current_row;
+
+  switch (index) {
+    case 0: /* COUNT_CALLBACKS */
+      pfs_bigint->set_unsigned(field,
+                               {row.counts[WORKLOAD_SELF_CALLBACK], false});
+      break;
+    case 1: /* SUM_CALLBACK_NS */
+      pfs_bigint->set_unsigned(field,
+                               {row.sums_ns[WORKLOAD_SELF_CALLBACK], false});
+      break;
+    case 2: /* SUM_PARSE_NS */
+      pfs_bigint->set_unsigned(field, {row.sums_ns[WORKLOAD_SELF_PARSE], false});
+      break;
+    case 3: /* SUM_LOOKUP_NS */
+      pfs_bigint->set_unsigned(field,
+                               {row.sums_ns[WORKLOAD_SELF_LOOKUP], false});
+      break;
+    case 4: /* SUM_UPDATE_NS */
+      pfs_bigint->set_unsigned(field,
+                               {row.sums_ns[WORKLOAD_SELF_UPDATE], false});
+      break;
+    case 5: /* SUM_QUERY_BYTES_SCANNED */
+      pfs_bigint->set_unsigned(field, {row.bytes_scanned, false});
+      break;
+    case 6: /* COUNT_LOCK_WAITS */
+      pfs_bigint->set_unsigned(field,
+                               {row.counts[WORKLOAD_SELF_LOCK_WAIT], false});
+      break;
+    case 7: /* SUM_LOCK_WAIT_NS */
+      pfs_bigint->set_unsigned(field,
+                               {row.sums_ns[WORKLOAD_SELF_LOCK_WAIT], false});
+      break;
+    case 8: /* COUNT_TABLE_SCANS */
+      pfs_bigint->set_unsigned(field,
+                               {row.counts[WORKLOAD_SELF_TABLE_SCAN], false});
+      break;
+    case 9: /* SUM_TABLE_SCAN_NS */
+      pfs_bigint->set_unsigned(field,
+                               {row.sums_ns[WORKLOAD_SELF_TABLE_SCAN], false});
+      break;
+    default: /* We should never reach here */
+      assert(0);
+  }
+  return 0;
+}
+
+unsigned long long workload_instrumentation_self_stats_get_row_count(void) {
+  return 1;
+}
+
+void init_workload_instrumentation_self_stats_share(
+    PFS_engine_table_share_proxy *share) {
+  share->m_table_name = "workload_instrumentation_self_stats";
+  share->m_table_name_length = 35;
+  share->m_table_definition =
+      "`COUNT_CALLBACKS` BIGINT UNSIGNED, `SUM_CALLBACK_NS` BIGINT UNSIGNED, "
+      "`SUM_PARSE_NS` BIGINT UNSIGNED, `SUM_LOOKUP_NS` BIGINT UNSIGNED, "
+      "`SUM_UPDATE_NS` BIGINT UNSIGNED, "
+      "`SUM_QUERY_BYTES_SCANNED` BIGINT UNSIGNED, "
+      "`COUNT_LOCK_WAITS` BIGINT UNSIGNED, `SUM_LOCK_WAIT_NS` BIGINT UNSIGNED, "
+      "`COUNT_TABLE_SCANS` BIGINT UNSIGNED, "
+      "`SUM_TABLE_SCAN_NS` BIGINT UNSIGNED";
+  share->m_ref_length = sizeof(unsigned int);
+  share->m_acl = TRUNCATABLE;
+  share->get_row_count = workload_instrumentation_self_stats_get_row_count;
+  share->delete_all_rows = workload_instrumentation_self_stats_delete_all_rows;
+
+  share->m_proxy_engine_table = {
+      workload_instrumentation_self_stats_rnd_next,
+      workload_instrumentation_self_stats_rnd_init,
+      workload_instrumentation_self_stats_rnd_pos,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_self_stats_read_column_value,
+      workload_instrumentation_self_stats_reset_position,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_self_stats_open_table,
+      workload_instrumentation_self_stats_close_table};
+}
@@ -0,0 +1,93 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_SELF_STATS_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_SELF_STATS_H
+
+#include <cstddef>
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+/*
+  Cost of the component itself, enabled by
+  workload_instrumentation.self_stats_sample_rate and reported in table
+  performance_schema.workload_instrumentation_self_stats:
+  - time spent in the query event callback, for one statement in
+    self_stats_sample_rate on average (all its events, those of its nested
+    statements included), split into finding the workload of the statement
+    (parse), resolving its record (lookup) and updating its counters
+    (update), and bytes of query text scanned for workload comments;
+  - time spent waiting for LOCK_workload_duration and reading the tables of
+    the component, from opening to closing them, measured whenever self
+    stats are enabled.
+
+  A measured callback accumulates its measures in the thread, and adds them
+  once to the counters of the CPU it ends on: counters are sharded per CPU,
+  so measuring does not bounce a cache line between cores. Unmeasured
+  callbacks cost a thread local check. Readers add up the shards without
+  synchronizing with writers, so a row may hold part of a callback.
+*/
+
+enum workload_self_stat {
+  WORKLOAD_SELF_CALLBACK,
+  WORKLOAD_SELF_PARSE,
+  WORKLOAD_SELF_LOOKUP,
+  WORKLOAD_SELF_UPDATE,
+  WORKLOAD_SELF_LOCK_WAIT,
+  WORKLOAD_SELF_TABLE_SCAN,
+  WORKLOAD_SELF_STATS
+};
+
+/* Counter shards, CPUs share them beyond this count. */
+#define WORKLOAD_SELF_STATS_SHARDS 64
+
+/*
+  At the start of the callback, returns the monotonic time if it is
+  measured, 0 otherwise. statement_start is whether the event starts a
+  top-level statement, which decides whether its events are measured.
+*/
+unsigned long long workload_self_stats_callback_start(bool statement_start);
+/* At the end of the callback, adds its measures to the shared counters. */
+void workload_self_stats_callback_end(unsigned long long start_ns);
+
+/* The monotonic time while a measured callback runs, 0 otherwise. */
+unsigned long long workload_self_stats_now();
+/* The monotonic time if self stats are enabled, 0 otherwise. */
+unsigned long long workload_self_stats_start();
+/*
+  Counts a measure of stat that started at start_ns, unless it is 0, and
+  returns the time it ended, so measures can follow each other.
+*/
+unsigned long long workload_self_stats_add(workload_self_stat stat,
+                                           unsigned long long start_ns);
+/* Counts query bytes scanned for workload comments in a measured callback. */
+void workload_self_stats_scanned(size_t bytes);
+
+/* Measures a callback from its construction to its destruction. */
+class workload_self_stats_callback_timer {
+ public:
+  explicit workload_self_stats_callback_timer(bool statement_start)
+      : m_start_ns(workload_self_stats_callback_start(statement_start)) {}
+  ~workload_self_stats_callback_timer() {
+    workload_self_stats_callback_end(m_start_ns);
+  }
+
+ private:
+  unsigned long long m_start_ns;
+};
+
+/* P_S table performance_schema.workload_instrumentation_self_stats */
+struct workload_instrumentation_self_stats_row {
+  unsigned long long counts[WORKLOAD_SELF_STATS];
+  unsigned long long sums_ns[WORKLOAD_SELF_STATS];
+  unsigned long long bytes_scanned;
+};
+
+struct workload_instrumentation_self_stats_table_handle {
+  /* The table has a single row. */
+  unsigned int m_pos;
+  unsigned int m_next_pos;
+  workload_instrumentation_self_stats_row m_current_row;
+};
+
+void init_workload_instrumentation_self_stats_share(
+    PFS_engine_table_share_proxy *share);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_SELF_STATS_H
@@ -0,0 +1,160 @@
+#include "workload_instrumentation_statement_cache.h"
+#include "workload_instrumentation_parser.h"
+#include "workload_instrumentation_self_stats.h"
+
+#include <cstring>
+
+struct workload_statement_cache_entry {
+  /* Query bytes the workload and tags depend on, 0 for an empty entry. */
+  unsigned int prefix_length = 0;
+  /* Whether the prefix is the whole query, which must then match exactly. */
+  bool whole_query = false;
+  /* Workload name, within prefix. */
+  unsigned int workload_offset = 0;
+  unsigned int workload_length = 0;
+  char prefix[WORKLOAD_STATEMENT_CACHE_PREFIX];
+  workload_record_hint hint;
+  workload_tag_hint tags;
+};
+
+struct workload_statement_cache {
+  workload_statement_cache_entry entries[WORKLOAD_STATEMENT_CACHE_ENTRIES];
+  /* Entry replaced by the next miss, round robin. */
+  unsigned int next_entry = 0;
+  /* Tags of the last query that could not be cached. */
+  workload_tag_hint uncached_tags;
+};
+
+static thread_local workload_statement_cache statement_cache;
+
+/* Workload of the user variable seen last by the thread. */
+struct workload_variable_cache {
+  unsigned int workload_length = 0;
+  char workload[WORKLOAD_NAME_MAX_LENGTH];
+  workload_record_hint hint;
+};
+
+static thread_local workload_variable_cache variable_cache;
+
+struct workload_digest_cache_entry {
+  /* Full query text, 0 for an empty entry. */
+  unsigned int text_length = 0;
+  char text[WORKLOAD_STATEMENT_CACHE_PREFIX];
+  workload_statement_digest digest;
+};
+
+struct workload_digest_cache {
+  workload_digest_cache_entry entries[WORKLOAD_DIGEST_CACHE_ENTRIES];
+  /* Entry replaced by the next miss, round robin. */
+  unsigned int next_entry = 0;
+  /* Digest of the last query too long to be cached. */
+  workload_statement_digest uncached;
+};
+
+static thread_local workload_digest_cache digest_cache;
+
+std::string_view workload_statement_cache_find(const char *query,
+                                               size_t length,
+                                               workload_record_hint **hint,
+                                               workload_tag_hint **tags) {
+  *hint = nullptr;
+  *tags = nullptr;
+  if (query == nullptr) return {};
+  if (WORKLOAD_MAX_SCAN_LENGTH != 0 && length > WORKLOAD_MAX_SCAN_LENGTH)
+    length = WORKLOAD_MAX_SCAN_LENGTH;
+
+  for (auto &entry : statement_cache.entries) {
+    if (entry.prefix_length == 0 ||
+        (entry.whole_query ? entry.prefix_length != length
+                           : entry.prefix_length > length) ||
+        memcmp(entry.prefix, query, entry.prefix_length) != 0)
+      continue;
+    // Cached before the component was reinstalled, with other tag keys.
+    if (!workload_tag_hint_valid(entry.tags)) {
+      entry.prefix_length = 0;
+      continue;
+    }
+
+    workload_self_stats_scanned(entry.prefix_length);
+    *tags = &entry.tags;
+    if (entry.workload_length == 0) return {};
+    *hint = &entry.hint;
+    return {entry.prefix + entry.workload_offset, entry.workload_length};
+  }
+
+  const std::string_view *keys;
+  unsigned int key_count = workload_tag_keys(&keys);
+  std::string_view values[WORKLOAD_MAX_TAGS];
+  size_t decided_length = 0;
+  std::string_view workload =
+      findWorkloadNameAndTags(query, length, keys, key_count, values,
+                              WORKLOAD_MAX_SCAN_LENGTH, &decided_length);
+  // Unless the name and all tags were found, the whole query was scanned.
+  workload_self_stats_scanned(decided_length != 0 ? decided_length : length);
+
+  // Without tags, queries without a workload are not worth an entry.
+  bool whole_query = decided_length == 0;
+  size_t prefix_length = whole_query ? length : decided_length;
+  if ((whole_query && key_count == 0) || prefix_length == 0 ||
+      prefix_length > WORKLOAD_STATEMENT_CACHE_PREFIX) {
+    workload_tag_resolve(values, &statement_cache.uncached_tags);
+    *tags = &statement_cache.uncached_tags;
+    return workload;
+  }
+
+  auto &entry = statement_cache.entries[statement_cache.next_entry];
+  statement_cache.next_entry =
+      (statement_cache.next_entry + 1) % WORKLOAD_STATEMENT_CACHE_ENTRIES;
+  memcpy(entry.prefix, query, prefix_length);
+  entry.prefix_length = prefix_length;
+  entry.whole_query = whole_query;
+  entry.workload_offset = workload.data() - query;
+  entry.workload_length = workload.size();
+  entry.hint = workload_record_hint();
+  workload_tag_resolve(values, &entry.tags);
+
+  *tags = &entry.tags;
+  if (workload.empty()) return {};
+  *hint = &entry.hint;
+  return {entry.prefix + entry.workload_offset, entry.workload_length};
+}
+
+std::string_view workload_variable_cache_find(std::string_view value,
+                                              workload_record_hint **hint) {
+  std::string_view workload =
+      workloadNamePrefix(value).substr(0, WORKLOAD_NAME_MAX_LENGTH);
+  *hint = nullptr;
+  if (workload.empty()) return {};
+
+  if (workload != std::string_view(variable_cache.workload,
+                                   variable_cache.workload_length)) {
+    memcpy(variable_cache.workload, workload.data(), workload.size());
+    variable_cache.workload_length = workload.size();
+    variable_cache.hint = workload_record_hint();
+  }
+
+  *hint = &variable_cache.hint;
+  return {variable_cache.workload, variable_cache.workload_length};
+}
+
+const workload_statement_digest *workload_digest_cache_find(const char *query,
+                                                            size_t length) {
+  if (query == nullptr) length = 0;
+  if (length == 0 || length > WORKLOAD_STATEMENT_CACHE_PREFIX) {
+    compute_statement_digest(query, length, &digest_cache.uncached);
+    return &digest_cache.uncached;
+  }
+
+  for (auto &entry : digest_cache.entries) {
+    if (entry.text_length == length && memcmp(entry.text, query, length) == 0)
+      return &entry.digest;
+  }
+
+  auto &entry = digest_cache.entries[digest_cache.next_entry];
+  digest_cache.next_entry =
+      (digest_cache.next_entry + 1) % WORKLOAD_DIGEST_CACHE_ENTRIES;
+  memcpy(entry.text, query, length);
+  entry.text_length = length;
+  compute_statement_digest(query, length, &entry.digest);
+  return &entry.digest;
+}
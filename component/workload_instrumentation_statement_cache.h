@@ -0,0 +1,69 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_STATEMENT_CACHE_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_STATEMENT_CACHE_H
+
+#include <cstddef>
+#include <string_view>
+
+#include "workload_instrumentation_digest.h"
+#include "workload_instrumentation_pfs.h"
+#include "workload_instrumentation_tags.h"
+
+/* Recent statements each thread remembers the workload of. */
+#define WORKLOAD_STATEMENT_CACHE_ENTRIES 4
+/* Longest query prefix remembered, statements needing more are not cached. */
+#define WORKLOAD_STATEMENT_CACHE_PREFIX 256
+/* Recent statement texts each thread remembers the digest of. */
+#define WORKLOAD_DIGEST_CACHE_ENTRIES 4
+
+/*
+  Per thread cache of the workloads and tags of recent statements. Prepared
+  statements and stored procedure calls run the same text, with the same
+  workload comment, over and over: each entry keeps the bytes of a query up to
+  the end of the comment where its workload and tags were all found (see
+  findWorkloadNameAndTags()), the workload found, the record it resolved to
+  and its combination of tags. A query starting with the same bytes has the
+  same workload and tags, so a hit costs a memcmp of the prefix instead of a
+  scan of the whole text, and the hints save hashing the name and tag values
+  and probing the indexes. When tags are enabled and some are missing, the
+  result depends on the whole query, and the entry keeps the whole text,
+  which then has to match exactly.
+
+  Entries are keyed on the text itself, not on the statement or its buffer,
+  so they never go stale: they stay valid when the thread is reused for
+  another connection, and their hints are checked on use.
+*/
+
+/*
+  Returns the workload of a query, empty if it has none. The view points into
+  the query or into the cache, and is valid until the next call. *hint is set
+  to the record hint to pass to record_stats(), or nullptr when the workload
+  is not cached. *tags is set to the tags to pass to record_tag_stats(),
+  valid until the next call.
+*/
+std::string_view workload_statement_cache_find(const char *query,
+                                               size_t length,
+                                               workload_record_hint **hint,
+                                               workload_tag_hint **tags);
+
+/*
+  Returns the workload set by the user variable of the connection (see
+  workload_instrumentation.user_variable) given its value, empty if the value
+  does not start with a workload name. The thread remembers the last one and
+  its record hint, so a connection running statements with the same value
+  resolves its record once. The view points into the cache and *hint is set
+  as by workload_statement_cache_find(); both are valid until the next call.
+*/
+std::string_view workload_variable_cache_find(std::string_view value,
+                                              workload_record_hint **hint);
+
+/*
+  Returns the digest of a query. Digests depend on the whole text, so the
+  thread remembers those of its last WORKLOAD_DIGEST_CACHE_ENTRIES queries of
+  up to WORKLOAD_STATEMENT_CACHE_PREFIX bytes, keyed on their full text: a
+  query run again costs a memcmp instead of being normalized. The digest is
+  valid until the next call.
+*/
+const workload_statement_digest *workload_digest_cache_find(const char *query,
+                                                            size_t length);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_STATEMENT_CACHE_H
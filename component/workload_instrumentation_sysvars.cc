@@ -0,0 +1,250 @@
+#define LOG_COMPONENT_TAG "workload_instrumentation"
+#define SYSVAR_COMPONENT_NAME "workload_instrumentation"
+
+#include "workload_instrumentation_sysvars.h"
+#include "workload_instrumentation_budget.h"
+
+#include <vector>
+
+#include <mysql/components/component_implementation.h>
+#include <mysql/components/services/component_sys_var_service.h>
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysqld_error.h>                           /* Errors */
+
+extern SERVICE_TYPE(component_sys_variable_register) *
+    mysql_service_component_sys_variable_register;
+extern SERVICE_TYPE(component_sys_variable_unregister) *
+    mysql_service_component_sys_variable_unregister;
+
+unsigned int flush_statements_value = 64;
+unsigned int flush_interval_ms_value = 1000;
+unsigned int max_workloads_value = 5000;
+unsigned int evict_idle_seconds_value = 3600;
+unsigned int sample_rate_value = 1;
+char *tags_value = nullptr;
+unsigned int tag_max_values_value = 100;
+unsigned int tag_max_combinations_value = 10000;
+unsigned int track_digests_value = 1;
+char *export_file_value = nullptr;
+unsigned int export_interval_ms_value = 10000;
+unsigned int ignore_own_tables_value = 1;
+unsigned int ignore_system_threads_value = 0;
+char *ignore_commands_value = nullptr;
+char *ignore_users_value = nullptr;
+char *user_variable_value = nullptr;
+unsigned int comment_overrides_variable_value = 1;
+char *budgets_value = nullptr;
+unsigned int budget_max_delay_ms_value = 0;
+char *persist_file_value = nullptr;
+unsigned int persist_interval_ms_value = 60000;
+unsigned int self_stats_sample_rate_value = 0;
+
+static std::vector<const char *> registered_sysvars;
+
+struct uint_sysvar {
+  const char *name;
+  const char *comment;
+  unsigned int *value;
+  unsigned int def_val;
+  unsigned int min_val;
+  unsigned int max_val;
+  /* Extra PLUGIN_VAR_* flags, e.g. PLUGIN_VAR_READONLY. */
+  int flags = 0;
+};
+
+static uint_sysvar uint_sysvars[] = {
+    {"flush_statements",
+     "Number of statements a thread accumulates per workload counters "
+     "locally before adding them to the shared counters. 1 disables "
+     "batching.",
+     &flush_statements_value, 64, 1, 1024 * 1024},
+    {"flush_interval_ms",
+     "Maximum time, in milliseconds, a thread keeps per workload counters "
+     "locally before adding them to the shared counters.",
+     &flush_interval_ms_value, 1000, 0, 3600 * 1000},
+    {"max_workloads",
+     "Maximum number of distinct workloads tracked. Statements of new "
+     "workloads are counted as __OVERFLOW__ once it is reached and no idle "
+     "workload can be evicted.",
+     &max_workloads_value, 5000, 1, 1000 * 1000},
+    {"evict_idle_seconds",
+     "Workloads without statements for this many seconds are evicted when "
+     "room is needed for new ones, their counters are added to "
+     "__EVICTED__. 0 disables eviction.",
+     &evict_idle_seconds_value, 3600, 0, 365 * 24 * 3600},
+    {"sample_rate",
+     "Record one in this many statements on average, counting it for the "
+     "statements skipped before it. 1 records every statement.",
+     &sample_rate_value, 1, 1, 1000 * 1000},
+    {"tag_max_values",
+     "Maximum number of distinct values tracked per tag key. Later values "
+     "are counted as __OVERFLOW__.",
+     &tag_max_values_value, 100, 1, 100 * 1000, PLUGIN_VAR_READONLY},
+    {"tag_max_combinations",
+     "Maximum number of combinations of tag values tracked. Statements of "
+     "later combinations are counted with __OVERFLOW__ for every tag.",
+     &tag_max_combinations_value, 10000, 1, 1000 * 1000, PLUGIN_VAR_READONLY},
+    {"track_digests",
+     "Whether to track the statement digests with most statements of each "
+     "workload, 1 to enable, 0 to disable.",
+     &track_digests_value, 1, 0, 1},
+    {"export_interval_ms",
+     "Interval, in milliseconds, between writes of "
+     "workload_instrumentation.export_file.",
+     &export_interval_ms_value, 10000, 100, 3600 * 1000},
+    {"ignore_own_tables",
+     "Whether SELECTs of the component's own performance_schema tables are "
+     "excluded from the counters, 1 to exclude, 0 to count them.",
+     &ignore_own_tables_value, 1, 0, 1},
+    {"ignore_system_threads",
+     "Whether statements of server threads, such as the replica applier and "
+     "the event scheduler, are excluded from the counters, 1 to exclude, 0 "
+     "to count them.",
+     &ignore_system_threads_value, 0, 0, 1},
+    {"comment_overrides_variable",
+     "Whether the workload comment of a statement overrides the workload "
+     "set by workload_instrumentation.user_variable, 1 to override, 0 to "
+     "not look for comments in statements of connections setting it.",
+     &comment_overrides_variable_value, 1, 0, 1},
+    {"budget_max_delay_ms",
+     "Maximum time, in milliseconds, a statement over the budget of its "
+     "workload waits for it before failing. 0 rejects it right away.",
+     &budget_max_delay_ms_value, 0, 0, 60 * 1000},
+    {"persist_interval_ms",
+     "Interval, in milliseconds, between snapshots of the counters to "
+     "workload_instrumentation.persist_file.",
+     &persist_interval_ms_value, 60000, 1000, 3600 * 1000},
+    {"self_stats_sample_rate",
+     "Measure the cost of the component for one in this many statements, "
+     "reported in performance_schema.workload_instrumentation_self_stats. 1 "
+     "measures every statement, 0 disables the measures.",
+     &self_stats_sample_rate_value, 0, 0, 1000 * 1000},
+};
+
+/*
+  String variables are read only, unless they have an update function: those
+  own their value, which their check function parses.
+*/
+struct str_sysvar {
+  const char *name;
+  const char *comment;
+  char **value;
+  const char *def_val = "";
+  mysql_sys_var_check_func check = nullptr;
+  mysql_sys_var_update_func update = nullptr;
+};
+
+static str_sysvar str_sysvars[] = {
+    {"tags",
+     "Comma separated list of up to 3 query comment tag keys, e.g. "
+     "TEAM,ENDPOINT,SHARD_KEY. Statements are counted per combination of "
+     "their values in table performance_schema.workload_instrumentation_tags. "
+     "Empty disables tags.",
+     &tags_value},
+    {"export_file",
+     "File the workload counters are periodically written to, in Prometheus "
+     "text format. Empty disables the export.",
+     &export_file_value},
+    {"ignore_commands",
+     "Comma separated list of statement types excluded from the counters, "
+     "as in the Com_xxx status variables, e.g. "
+     "install_component,show_variables.",
+     &ignore_commands_value, "install_component"},
+    {"ignore_users",
+     "Comma separated list of accounts whose statements are excluded from "
+     "the counters, either user, for any host, or user@host.",
+     &ignore_users_value},
+    {"user_variable",
+     "Name, without the @, of the user variable setting the workload of the "
+     "statements of a connection without a workload comment, e.g. "
+     "workload_name for SET @workload_name='batch_job'. Empty disables it.",
+     &user_variable_value},
+    {"budgets",
+     "Per workload budgets, as <workload>:<limit>=<value>[,...][;...] with "
+     "limits concurrency, rows_examined_per_second and "
+     "duration_ms_per_second. Statements over budget are delayed or "
+     "rejected when they start. Empty disables budgets.",
+     &budgets_value, "", workload_budgets_check, workload_budgets_update},
+    {"persist_file",
+     "File the workload counters are periodically saved to and restored "
+     "from when the component is initialized, so they survive restarts. "
+     "Empty disables persistence.",
+     &persist_file_value},
+};
+
+static int register_uint_sysvar(const uint_sysvar &var) {
+  INTEGRAL_CHECK_ARG(uint) arg;
+  arg.def_val = var.def_val;
+  arg.min_val = var.min_val;
+  arg.max_val = var.max_val;
+  arg.blk_sz = 0;
+
+  if (mysql_service_component_sys_variable_register->register_variable(
+          SYSVAR_COMPONENT_NAME, var.name,
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG |
+              var.flags,
+          var.comment, nullptr, nullptr, (void *)&arg, (void *)var.value)) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to register system variable.");
+    return 1;
+  }
+
+  registered_sysvars.push_back(var.name);
+  return 0;
+}
+
+static int register_str_sysvar(const str_sysvar &var) {
+  STR_CHECK_ARG(str) arg;
+  arg.def_val = const_cast<char *>(var.def_val);
+
+  if (mysql_service_component_sys_variable_register->register_variable(
+          SYSVAR_COMPONENT_NAME, var.name,
+          PLUGIN_VAR_STR | PLUGIN_VAR_RQCMDARG |
+              (var.update == nullptr
+                   ? PLUGIN_VAR_MEMALLOC | PLUGIN_VAR_READONLY
+                   : 0),
+          var.comment, var.check, var.update, (void *)&arg,
+          (void *)var.value)) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to register system variable.");
+    return 1;
+  }
+
+  registered_sysvars.push_back(var.name);
+  return 0;
+}
+
+int register_sysvars() {
+  for (auto &var : uint_sysvars) {
+    if (register_uint_sysvar(var)) {
+      unregister_sysvars();
+      return 1;
+    }
+  }
+
+  for (auto &var : str_sysvars) {
+    if (register_str_sysvar(var)) {
+      unregister_sysvars();
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int unregister_sysvars() {
+  int result = 0;
+
+  while (!registered_sysvars.empty()) {
+    const char *name = registered_sysvars.back();
+    registered_sysvars.pop_back();
+    if (mysql_service_component_sys_variable_unregister->unregister_variable(
+            SYSVAR_COMPONENT_NAME, name)) {
+      LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                      "Failed to unregister system variable.");
+      result = 1;
+    }
+  }
+
+  return result;
+}
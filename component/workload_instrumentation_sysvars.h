@@ -0,0 +1,60 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_SYSVARS_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_SYSVARS_H
+
+/*
+  Component system variables, exposed as workload_instrumentation.<name>.
+  Values are written by the server when the variables are SET and read
+  without locking by the component.
+*/
+
+/* Statements a thread accumulates locally before flushing its counters. */
+extern unsigned int flush_statements_value;
+/* Maximum time in ms a thread keeps counters locally before flushing them. */
+extern unsigned int flush_interval_ms_value;
+/* Maximum number of workloads tracked, predefined workloads excluded. */
+extern unsigned int max_workloads_value;
+/* Seconds without statements after which a workload may be evicted. */
+extern unsigned int evict_idle_seconds_value;
+/* Average number of statements per recorded statement, 1 records them all. */
+extern unsigned int sample_rate_value;
+/* Comma separated tag keys, read only: tags are set up at initialization. */
+extern char *tags_value;
+/* Maximum distinct values per tag key, read only. */
+extern unsigned int tag_max_values_value;
+/* Maximum combinations of tag values, read only. */
+extern unsigned int tag_max_combinations_value;
+/* Whether top digests are tracked per workload, 0 or 1. */
+extern unsigned int track_digests_value;
+/* Path of the Prometheus export file, read only, empty when disabled. */
+extern char *export_file_value;
+/* Milliseconds between writes of the export file. */
+extern unsigned int export_interval_ms_value;
+/* Whether SELECTs of the component's tables are excluded, 0 or 1. */
+extern unsigned int ignore_own_tables_value;
+/* Whether statements of server threads are excluded, 0 or 1. */
+extern unsigned int ignore_system_threads_value;
+/* Comma separated statement types excluded, read only. */
+extern char *ignore_commands_value;
+/* Comma separated accounts excluded, read only. */
+extern char *ignore_users_value;
+/* User variable, without @, setting the workload of a connection, read only,
+   empty when disabled. */
+extern char *user_variable_value;
+/* Whether workload comments override the user variable, 0 or 1. */
+extern unsigned int comment_overrides_variable_value;
+/* Per workload budgets, see budget. The value is owned by the budgets. */
+extern char *budgets_value;
+/* Milliseconds a statement over budget waits for it before being rejected. */
+extern unsigned int budget_max_delay_ms_value;
+/* Path of the counters snapshot, read only, empty when disabled. */
+extern char *persist_file_value;
+/* Milliseconds between snapshots of the counters. */
+extern unsigned int persist_interval_ms_value;
+/* One in this many statements is measured by the self stats, 0 disables
+   them. */
+extern unsigned int self_stats_sample_rate_value;
+
+int register_sysvars();
+int unregister_sysvars();
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_SYSVARS_H
@@ -0,0 +1,475 @@
+#include "workload_instrumentation_tags.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_memory.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_sysvars.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysql/components/services/mysql_mutex.h>
+#include <mysqld_error.h> /* Errors */
+
+extern mysql_service_pfs_plugin_column_string_v2_t *pfs_string;
+extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
+
+/* Value ids every key has: tag not in the query, and values past the cap. */
+#define TAG_VALUE_MISSING 0
+#define TAG_VALUE_OVERFLOW 1
+#define PREDEFINED_TAG_VALUES 2
+
+/* Combination counting statements of combinations past the cap. */
+#define OVERFLOW_COMBINATION 0
+
+static const std::string_view TAG_OVERFLOW = "__OVERFLOW__";
+
+struct workload_tag_value : workload_memory_accounted<WORKLOAD_MEMORY_TAGS> {
+  char value[WORKLOAD_NAME_MAX_LENGTH + 1];
+  unsigned int length;
+};
+
+/* Distinct values of a tag key, never removed. */
+struct workload_tag_key {
+  char key[WORKLOAD_NAME_MAX_LENGTH + 1];
+  unsigned int length;
+  /* Value to id, ids index values. */
+  workload_instrumentation_index index;
+  std::unique_ptr<workload_tag_value[]> values;
+  /* Ids used, written last when a value is added. */
+  std::atomic<unsigned int> count{0};
+};
+
+struct workload_tag_combination
+    : workload_memory_accounted<WORKLOAD_MEMORY_TAGS> {
+  unsigned int ids[WORKLOAD_MAX_TAGS];
+  std::array<workload_counter_shard, WORKLOAD_TAG_SHARDS> shards;
+};
+
+static workload_tag_key tag_keys[WORKLOAD_MAX_TAGS];
+static std::string_view tag_key_names[WORKLOAD_MAX_TAGS];
+/* Number of keys configured, 0 when tags are disabled. */
+static unsigned int tag_key_count = 0;
+/* Generation of workload_tag_hint, changed by each init and deinit. */
+static std::atomic<unsigned long> tag_generation{0};
+
+static std::unique_ptr<workload_tag_combination[]> combinations;
+static unsigned int max_combinations = 0;
+/* Combinations used, written last when one is added. */
+static std::atomic<unsigned int> combination_count{0};
+/*
+  Open addressing hash table of combinations, holding the combination index
+  plus 1, 0 for empty buckets. Buckets are only set, under LOCK_workload_tags.
+*/
+static std::unique_ptr<std::atomic<unsigned int>[]> combination_buckets;
+static size_t combination_mask = 0;
+
+/* Serializes new values and combinations, lookups take no lock. */
+static mysql_mutex_t LOCK_workload_tags;
+static PSI_mutex_key key_workload_instrumentation_LOCK_tags;
+static PSI_mutex_info all_workload_instrumentation_tags_mutexes[] = {
+    {&key_workload_instrumentation_LOCK_tags, "workload_instrumentation_tags",
+     0, 0, "Serializes new tag values and combinations"}};
+
+/* Shard of the combinations each thread updates. */
+static std::atomic<unsigned int> next_tag_shard{0};
+static thread_local unsigned int tag_shard = WORKLOAD_TAG_SHARDS;
+
+static unsigned int current_tag_shard() {
+  if (tag_shard == WORKLOAD_TAG_SHARDS)
+    tag_shard = next_tag_shard.fetch_add(1, std::memory_order_relaxed) %
+                WORKLOAD_TAG_SHARDS;
+  return tag_shard;
+}
+
+static void set_tag_value(workload_tag_key *key, unsigned int id,
+                          std::string_view value) {
+  memcpy(key->values[id].value, value.data(), value.size());
+  key->values[id].value[value.size()] = '\0';
+  key->values[id].length = value.size();
+}
+
+/*
+  Parses the comma separated keys of workload_instrumentation.tags. Returns
+  the number of keys, or -1 if the list is not valid.
+*/
+static int parse_tag_keys(const char *list) {
+  std::string_view keys(list == nullptr ? "" : list);
+  unsigned int count = 0;
+
+  while (!keys.empty()) {
+    size_t comma = keys.find(',');
+    std::string_view key = keys.substr(0, comma);
+    keys = comma == std::string_view::npos ? std::string_view()
+                                           : keys.substr(comma + 1);
+
+    while (!key.empty() && key.front() == ' ') key.remove_prefix(1);
+    while (!key.empty() && key.back() == ' ') key.remove_suffix(1);
+    if (key.empty() && keys.empty() && count == 0) break;
+    if (key.empty() || key.size() > WORKLOAD_NAME_MAX_LENGTH ||
+        count == WORKLOAD_MAX_TAGS)
+      return -1;
+    for (char c : key) {
+      if (!(c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+            (c >= '0' && c <= '9')))
+        return -1;
+    }
+
+    auto &tag_key = tag_keys[count];
+    memcpy(tag_key.key, key.data(), key.size());
+    tag_key.key[key.size()] = '\0';
+    tag_key.length = key.size();
+    tag_key_names[count] = std::string_view(tag_key.key, tag_key.length);
+    count++;
+  }
+
+  return count;
+}
+
+int workload_tags_init() {
+  tag_key_count = 0;
+  tag_generation.fetch_add(1, std::memory_order_release);
+  int keys = parse_tag_keys(tags_value);
+  if (keys < 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Invalid workload_instrumentation.tags, expected up to 3 "
+                    "comma separated keys of [A-Za-z0-9_]. Tags are disabled.");
+    return 0;
+  }
+  if (keys == 0) return 0;
+
+  mysql_mutex_register("workload_instrumentation",
+                       all_workload_instrumentation_tags_mutexes, 1);
+  int result = mysql_mutex_init(key_workload_instrumentation_LOCK_tags,
+                                &LOCK_workload_tags, nullptr);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, "Failed to init lock.");
+
+    return result;
+  }
+
+  unsigned int max_values = tag_max_values_value + PREDEFINED_TAG_VALUES;
+  for (int i = 0; i < keys; i++) {
+    auto &key = tag_keys[i];
+    key.index.init(max_values);
+    key.values.reset(new workload_tag_value[max_values]);
+    set_tag_value(&key, TAG_VALUE_MISSING, "");
+    set_tag_value(&key, TAG_VALUE_OVERFLOW, TAG_OVERFLOW);
+    key.count.store(PREDEFINED_TAG_VALUES, std::memory_order_relaxed);
+  }
+
+  // The overflow combination comes on top of the tracked ones.
+  max_combinations = tag_max_combinations_value + 1;
+  combinations.reset(new workload_tag_combination[max_combinations]);
+  size_t capacity = 1;
+  while (capacity < 2 * max_combinations) capacity <<= 1;
+  combination_buckets.reset(new std::atomic<unsigned int>[capacity]);
+  for (size_t i = 0; i < capacity; i++)
+    combination_buckets[i].store(0, std::memory_order_relaxed);
+  combination_mask = capacity - 1;
+
+  // Same ids as a statement with every configured tag past the cap.
+  auto &overflow = combinations[OVERFLOW_COMBINATION];
+  for (int i = 0; i < WORKLOAD_MAX_TAGS; i++)
+    overflow.ids[i] = i < keys ? TAG_VALUE_OVERFLOW : TAG_VALUE_MISSING;
+  combination_buckets[workload_name_hash(std::string_view(
+                          (const char *)overflow.ids, sizeof(overflow.ids))) &
+                      combination_mask]
+      .store(OVERFLOW_COMBINATION + 1, std::memory_order_relaxed);
+  combination_count.store(1, std::memory_order_release);
+
+  tag_key_count = keys;
+  return 0;
+}
+
+int workload_tags_deinit() {
+  if (tag_key_count == 0) return 0;
+  tag_key_count = 0;
+  tag_generation.fetch_add(1, std::memory_order_release);
+
+  for (auto &key : tag_keys) {
+    key.index = workload_instrumentation_index();
+    key.values.reset();
+    key.count.store(0, std::memory_order_relaxed);
+  }
+  combinations.reset();
+  combination_buckets.reset();
+  combination_count.store(0, std::memory_order_relaxed);
+
+  int result = mysql_mutex_destroy(&LOCK_workload_tags);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, "Failed to destroy lock.");
+  }
+  return result;
+}
+
+/*
+  Returns the id of a value, adding it if there is room. Values past the cap
+  are counted as overflow.
+*/
+static unsigned int tag_value_id(workload_tag_key *key,
+                                 std::string_view value) {
+  if (value.empty()) return TAG_VALUE_MISSING;
+  value = value.substr(0, WORKLOAD_NAME_MAX_LENGTH);
+  unsigned long long hash = workload_name_hash(value);
+
+  long id = key->index.find(value, hash);
+  if (id >= 0) return id;
+  if (key->count.load(std::memory_order_relaxed) >= key->index.max_entries())
+    return TAG_VALUE_OVERFLOW;
+
+  mysql_mutex_lock(&LOCK_workload_tags);
+  id = key->index.find(value, hash);
+  if (id < 0) {
+    unsigned int count = key->count.load(std::memory_order_relaxed);
+    if (count < key->index.max_entries()) {
+      set_tag_value(key, count, value);
+      key->index.insert(value, hash, count);
+      key->count.store(count + 1, std::memory_order_release);
+      id = count;
+    } else {
+      id = TAG_VALUE_OVERFLOW;
+    }
+  }
+  mysql_mutex_unlock(&LOCK_workload_tags);
+
+  return id;
+}
+
+/* Returns the index of a combination of value ids, or -1. Takes no lock. */
+static long find_combination(const unsigned int *ids,
+                             unsigned long long hash) {
+  for (size_t i = hash & combination_mask, probes = 0;
+       probes <= combination_mask; i = (i + 1) & combination_mask, probes++) {
+    unsigned int bucket =
+        combination_buckets[i].load(std::memory_order_acquire);
+    if (bucket == 0) return -1;
+    if (memcmp(combinations[bucket - 1].ids, ids,
+               sizeof(combinations[0].ids)) == 0)
+      return bucket - 1;
+  }
+
+  return -1;
+}
+
+/*
+  Returns the index of the combination of value ids, adding it if there is
+  room, or the overflow combination.
+*/
+static unsigned int get_combination(const unsigned int *ids) {
+  unsigned long long hash = workload_name_hash(
+      std::string_view((const char *)ids, sizeof(combinations[0].ids)));
+
+  long index = find_combination(ids, hash);
+  if (index >= 0) return index;
+  if (combination_count.load(std::memory_order_relaxed) >= max_combinations)
+    return OVERFLOW_COMBINATION;
+
+  mysql_mutex_lock(&LOCK_workload_tags);
+  index = find_combination(ids, hash);
+  if (index < 0) {
+    unsigned int count = combination_count.load(std::memory_order_relaxed);
+    if (count < max_combinations) {
+      memcpy(combinations[count].ids, ids, sizeof(combinations[0].ids));
+      size_t i = hash & combination_mask;
+      while (combination_buckets[i].load(std::memory_order_relaxed) != 0)
+        i = (i + 1) & combination_mask;
+      combination_buckets[i].store(count + 1, std::memory_order_release);
+      combination_count.store(count + 1, std::memory_order_release);
+      index = count;
+    } else {
+      index = OVERFLOW_COMBINATION;
+    }
+  }
+  mysql_mutex_unlock(&LOCK_workload_tags);
+
+  return index;
+}
+
+unsigned int workload_tag_keys(const std::string_view **keys) {
+  *keys = tag_key_names;
+  return tag_key_count;
+}
+
+void workload_tag_resolve(const std::string_view *values,
+                          workload_tag_hint *hint) {
+  hint->generation = tag_generation.load(std::memory_order_acquire);
+  hint->combination = OVERFLOW_COMBINATION;
+  if (tag_key_count == 0) return;
+
+  unsigned int ids[WORKLOAD_MAX_TAGS] = {};
+  // The bound lets the compiler see accesses stay within tag_keys.
+  unsigned int keys = std::min<unsigned int>(tag_key_count, WORKLOAD_MAX_TAGS);
+  for (unsigned int i = 0; i < keys; i++)
+    ids[i] = tag_value_id(&tag_keys[i], values[i]);
+  hint->combination = get_combination(ids);
+}
+
+bool workload_tag_hint_valid(const workload_tag_hint &hint) {
+  return hint.generation == tag_generation.load(std::memory_order_acquire);
+}
+
+void record_tag_stats(const workload_tag_hint *hint, const thread_stats *ts,
+                      unsigned int weight) {
+  if (tag_key_count == 0 || hint == nullptr ||
+      !workload_tag_hint_valid(*hint))
+    return;
+
+  workload_counters delta;
+  statement_counters(&delta, ts, weight);
+  auto &combination = combinations[hint->combination];
+  update_shard_counters(&combination.shards[current_tag_shard()], delta);
+}
+
+static void workload_instrumentation_tags_copy_row(
+    workload_instrumentation_tags_table_handle *th) {
+  auto &row = th->m_current_row;
+  auto &combination = combinations[th->m_pos.get_index()];
+
+  for (unsigned int i = 0; i < WORKLOAD_MAX_TAGS; i++) {
+    if (i < tag_key_count) {
+      auto &value = tag_keys[i].values[combination.ids[i]];
+      memcpy(row.tags[i], value.value, value.length + 1);
+    } else {
+      row.tags[i][0] = '\0';
+    }
+  }
+
+  row.counters = workload_counters();
+  for (auto &shard : combination.shards)
+    add_shard_counters(&row.counters, shard);
+}
+
+/* Access to PS table */
+int workload_instrumentation_tags_delete_all_rows() { return 0; }
+
+PSI_table_handle *workload_instrumentation_tags_open_table(PSI_pos **pos) {
+  auto temp = new workload_instrumentation_tags_table_handle();
+  temp->m_open_ns = workload_self_stats_start();
+  temp->m_combinations = combination_count.load(std::memory_order_acquire);
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return (PSI_table_handle *)temp;
+}
+
+void workload_instrumentation_tags_close_table(PSI_table_handle *handle) {
+  auto temp = (workload_instrumentation_tags_table_handle *)handle;
+  workload_self_stats_add(WORKLOAD_SELF_TABLE_SCAN, temp->m_open_ns);
+  delete temp;
+}
+
+int workload_instrumentation_tags_rnd_next(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_tags_table_handle *)handle;
+
+  th->m_pos.set_at(&th->m_next_pos);
+  if (th->m_pos.get_index() < th->m_combinations) {
+    workload_instrumentation_tags_copy_row(th);
+    th->m_next_pos.set_after(&th->m_pos);
+    return 0;
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int workload_instrumentation_tags_rnd_init(PSI_table_handle *handle, bool) {
+  auto th = (workload_instrumentation_tags_table_handle *)handle;
+  th->m_combinations = combination_count.load(std::memory_order_acquire);
+  return 0;
+}
+
+int workload_instrumentation_tags_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_tags_table_handle *)handle;
+
+  if (th->m_pos.get_index() < th->m_combinations)
+    workload_instrumentation_tags_copy_row(th);
+  return 0;
+}
+
+void workload_instrumentation_tags_reset_position(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_tags_table_handle *)handle;
+  th->m_pos.reset();
+  th->m_next_pos.reset();
+}
+
+int workload_instrumentation_tags_read_column_value(PSI_table_handle *handle,
+                                                    PSI_field *field,
+                                                    unsigned int index) {
+  auto th = (workload_instrumentation_tags_table_handle *)handle;
+  auto &row = th->m_current_row;
+
+  switch (index) {
+    case 0: /* TAG_1 */
+    case 1: /* TAG_2 */
+    case 2: /* TAG_3 */
+      pfs_string->set_varchar_utf8mb4(field, row.tags[index]);
+      break;
+    case 3: /* COUNT_QUERIES */
+      pfs_bigint->set_unsigned(field, {row.counters.count_queries, false});
+      break;
+    case 4: /* SUM_ROWS_EXAMINED */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_examined, false});
+      break;
+    case 5: /* SUM_ROWS_SENT */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_sent, false});
+      break;
+    case 6: /* SUM_ROWS_AFFECTED */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_affected, false});
+      break;
+    case 7: /* SUM_DURATION_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_query_duration_ns / NANOS_PER_MICRO, false});
+      break;
+    case 8: /* SUM_LOCK_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_lock_time_ns / NANOS_PER_MICRO, false});
+      break;
+    case 9: /* SUM_CPU_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_cpu_time_ns / NANOS_PER_MICRO, false});
+      break;
+    default: /* We should never reach here */
+      assert(0);
+  }
+  return 0;
+}
+
+unsigned long long workload_instrumentation_tags_get_row_count(void) {
+  return combination_count.load(std::memory_order_relaxed);
+}
+
+void init_workload_instrumentation_tags_share(
+    PFS_engine_table_share_proxy *share) {
+  share->m_table_name = "workload_instrumentation_tags";
+  share->m_table_name_length = 29;
+  share->m_table_definition =
+      "`TAG_1` varchar(50), `TAG_2` varchar(50), `TAG_3` varchar(50), "
+      "`COUNT_QUERIES` BIGINT UNSIGNED, `SUM_ROWS_EXAMINED` BIGINT UNSIGNED, "
+      "`SUM_ROWS_SENT` BIGINT UNSIGNED, `SUM_ROWS_AFFECTED` BIGINT UNSIGNED, "
+      "`SUM_DURATION_US` BIGINT UNSIGNED, `SUM_LOCK_TIME_US` BIGINT UNSIGNED, "
+      "`SUM_CPU_TIME_US` BIGINT UNSIGNED";
+  share->m_ref_length = sizeof(workload_instrumentation_tags_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = workload_instrumentation_tags_get_row_count;
+  share->delete_all_rows = workload_instrumentation_tags_delete_all_rows;
+
+  share->m_proxy_engine_table = {
+      workload_instrumentation_tags_rnd_next,
+      workload_instrumentation_tags_rnd_init,
+      workload_instrumentation_tags_rnd_pos,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_tags_read_column_value,
+      workload_instrumentation_tags_reset_position,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_tags_open_table,
+      workload_instrumentation_tags_close_table};
+}
@@ -0,0 +1,110 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_TAGS_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_TAGS_H
+
+#include <cstddef>
+#include <string_view>
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+#include "workload_instrumentation_parser.h"
+#include "workload_instrumentation_pfs.h"
+
+/*
+  Per tag counters. workload_instrumentation.tags lists up to
+  WORKLOAD_MAX_TAGS keys of query comment tags, e.g. TEAM,ENDPOINT,SHARD_KEY.
+  Their values are extracted in the same scan of the query comments as the
+  workload name, and statements are counted per combination of values, in P_S
+  table
+  performance_schema.workload_instrumentation_tags: columns TAG_1 to TAG_3
+  hold the values of the keys, in the order they are listed.
+
+  Cardinality is bounded per key and overall: each key tracks at most
+  tag_max_values distinct values, later ones are counted as __OVERFLOW__, and
+  at most tag_max_combinations combinations are tracked, statements of later
+  ones are counted in a row with __OVERFLOW__ for every tag. Missing tags are
+  empty. Memory is allocated when the component is initialized, about 330
+  bytes per combination and 250 per value (3.5MB with the defaults).
+
+  Combinations are never removed, so statements update them without locking
+  and readers copy them without blocking anyone. Each thread updates one of
+  WORKLOAD_TAG_SHARDS shards of a combination; tags counters are not batched
+  by the thread caches.
+*/
+#define WORKLOAD_TAG_SHARDS 4
+
+class workload_instrumentation_tags_POS {
+ private:
+  unsigned int m_index = 0;
+
+ public:
+  ~workload_instrumentation_tags_POS() = default;
+  workload_instrumentation_tags_POS() = default;
+
+  void reset() { m_index = 0; }
+  unsigned int get_index() { return m_index; }
+  void set_at(workload_instrumentation_tags_POS *pos) {
+    m_index = pos->m_index;
+  }
+  void set_after(workload_instrumentation_tags_POS *pos) {
+    m_index = pos->m_index + 1;
+  }
+};
+
+struct workload_instrumentation_tags_row {
+  char tags[WORKLOAD_MAX_TAGS][WORKLOAD_NAME_MAX_LENGTH + 1];
+  workload_counters counters;
+};
+
+struct workload_instrumentation_tags_table_handle {
+  workload_instrumentation_tags_POS m_pos;
+  workload_instrumentation_tags_POS m_next_pos;
+  workload_instrumentation_tags_row m_current_row;
+  /* Combinations when the scan started, later ones are not returned. */
+  size_t m_combinations;
+  /* Monotonic time the table was opened, for self stats. */
+  unsigned long long m_open_ns;
+};
+
+/* Parses workload_instrumentation.tags and allocates the combinations. */
+int workload_tags_init();
+int workload_tags_deinit();
+
+/*
+  Combination of tags a thread resolved a query to, kept in its statement
+  cache so statements of a cached text are counted without scanning their
+  comments again (see workload_statement_cache_find()). Each init of the
+  component starts a new generation, hints of previous ones are not valid.
+*/
+struct workload_tag_hint {
+  unsigned long generation = 0;
+  unsigned int combination = 0;
+};
+
+/*
+  Sets *keys to the keys of workload_instrumentation.tags and returns their
+  number, 0 when tags are disabled.
+*/
+unsigned int workload_tag_keys(const std::string_view **keys);
+
+/*
+  Sets *hint to the combination of tag values, values[i] being the value of
+  the i-th key, empty when the query has none. The combination is added if
+  there is room.
+*/
+void workload_tag_resolve(const std::string_view *values,
+                          workload_tag_hint *hint);
+
+/* Whether a hint was resolved by the current init of the component. */
+bool workload_tag_hint_valid(const workload_tag_hint &hint);
+
+/*
+  Counts a statement, standing for weight statements, for the combination of
+  tags of its query. Does nothing when hint is nullptr or tags are disabled.
+*/
+void record_tag_stats(const workload_tag_hint *hint, const thread_stats *ts,
+                      unsigned int weight);
+
+void init_workload_instrumentation_tags_share(
+    PFS_engine_table_share_proxy *share);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_TAGS_H
@@ -1,9 +1,105 @@
 #include "workload_instrumentation_thd_stats.h"
+#include <sql/item_func.h>
 #include <sql/sql_class.h>
 #include <sql/sql_error.h>
 
-thread_stats* get_thd_row_stats(THD *thread) {
-  auto ts = new thread_stats;
+#include "workload_instrumentation_clock.h"
+
+/*
+  Session status variables of each resource measured as the difference
+  between the start and the end of the statement, 0 for the others.
+*/
+static const unsigned long long System_status_var::*const
+    status_resources[WORKLOAD_RESOURCES] = {
+        &System_status_var::created_tmp_disk_tables,
+        &System_status_var::filesort_merge_passes,
+        &System_status_var::select_full_join_count,
+        &System_status_var::select_scan_count,
+        &System_status_var::bytes_sent,
+        &System_status_var::bytes_received,
+        nullptr, /* WORKLOAD_RESOURCE_ERRORS */
+        nullptr, /* WORKLOAD_RESOURCE_WARNINGS */
+        &System_status_var::max_execution_time_exceeded,
+        nullptr, /* WORKLOAD_RESOURCE_THROTTLED, see record_resource() */
+        nullptr, /* WORKLOAD_RESOURCE_REJECTED, see record_resource() */
+        nullptr, /* WORKLOAD_RESOURCE_NESTED_QUERIES */
+        nullptr, /* WORKLOAD_RESOURCE_NESTED_ROWS_EXAMINED */
+        nullptr, /* WORKLOAD_RESOURCE_NESTED_ROWS_SENT */
+        nullptr, /* WORKLOAD_RESOURCE_NESTED_ROWS_AFFECTED */
+        nullptr, /* WORKLOAD_RESOURCE_NESTED_DURATION */
+};
+
+/* Packet header and command byte preceding the text of COM_QUERY. */
+#define WORKLOAD_COMMAND_HEADER_LENGTH 5
+
+/*
+  Session and bytes received when the last COM_QUERY statement of this
+  thread started: the statements of a multi statement packet start without
+  reading anything in between.
+*/
+static thread_local const THD *packet_thread = nullptr;
+static thread_local unsigned long long packet_received = 0;
+
+/* Clocks and counters captured when a statement of this thread started. */
+struct statement_start {
+  /* THD::start_utime of the statement the clocks belong to. */
+  unsigned long long start_utime;
+  unsigned long long monotonic_ns;
+  unsigned long long cpu_ns;
+  /* Row counters of the THD, only captured for nested statements. */
+  unsigned long long rows_examined;
+  unsigned long long rows_sent;
+  /* Measured by the statements nested in this one, to leave out of it. */
+  unsigned long long nested_duration_ns;
+  unsigned long long nested_rows_examined;
+  unsigned long long nested_rows_sent;
+  /* Whether statements of stored programs ran, see get_thd_row_stats(). */
+  bool has_nested;
+  /* Session status variables, see status_resources. */
+  std::array<unsigned long long, WORKLOAD_RESOURCES> status;
+};
+
+/*
+  Statements running on this thread: the top-level one, then those of the
+  stored programs it runs, innermost last. statement_depth counts statements
+  nested deeper than the stack too, so that their ends are matched, but they
+  are not measured.
+*/
+static thread_local statement_start statement_stack[WORKLOAD_MAX_NESTING];
+static thread_local unsigned int statement_depth = 0;
+
+void capture_statement_start(THD *thread, size_t query_length) {
+  statement_start &start = statement_stack[0];
+  start.start_utime = thread->start_utime;
+  start.monotonic_ns = monotonic_clock_ns();
+  start.cpu_ns = thread_cpu_clock_ns();
+  start.has_nested = false;
+  for (int i = 0; i < WORKLOAD_RESOURCES; i++) {
+    if (status_resources[i] != nullptr)
+      start.status[i] = thread->status_var.*status_resources[i];
+  }
+  /*
+    A COM_QUERY packet is read, and counted, before its statements start:
+    charge each statement its text, and the first one the packet header
+    too. Other commands are only charged what they read while running, e.g.
+    the text of COM_STMT_EXECUTE is expanded from a binary packet of another
+    length.
+  */
+  if (thread->get_command() == COM_QUERY) {
+    unsigned long long &received =
+        start.status[WORKLOAD_RESOURCE_BYTES_RECEIVED];
+    bool same_packet = packet_thread == thread && packet_received == received;
+    packet_thread = thread;
+    packet_received = received;
+    unsigned long long command =
+        query_length + (same_packet ? 0 : WORKLOAD_COMMAND_HEADER_LENGTH);
+    received = received > command ? received - command : 0;
+  }
+  // A statement whose end was not seen is forgotten, with its nested ones.
+  statement_depth = 1;
+}
+
+void get_thd_row_stats(THD *thread, thread_stats *ts) {
   ts->rows_examined = thread->get_examined_row_count();
   ts->rows_sent = thread->get_sent_row_count();
   if (thread->get_stmt_da()->status() ==  Diagnostics_area::DA_OK) {
@@ -11,9 +107,127 @@ thread_stats* get_thd_row_stats(THD *thread) {
   } else {
     ts->rows_affected = 0;
   }
+  ts->resources[WORKLOAD_RESOURCE_ERRORS] =
+      thread->get_stmt_da()->is_error() ? 1 : 0;
+  ts->resources[WORKLOAD_RESOURCE_WARNINGS] =
+      thread->get_stmt_da()->current_statement_cond_count();
+
+  ts->end_ns = monotonic_clock_ns();
+  ts->lock_time_ns = thread->utime_after_lock > thread->start_utime
+                         ? (thread->utime_after_lock - thread->start_utime) *
+                               NANOS_PER_MICRO
+                         : 0;
+
+  // Statements of stored programs may set the start time of the THD again.
+  const statement_start &start = statement_stack[0];
+  if (statement_depth > 0 &&
+      (start.start_utime == thread->start_utime || start.has_nested)) {
+    ts->duration_ns = ts->end_ns - start.monotonic_ns;
+    ts->cpu_time_ns = thread_cpu_clock_ns() - start.cpu_ns;
+    for (int i = 0; i < WORKLOAD_RESOURCES; i++) {
+      if (status_resources[i] == nullptr) continue;
+      unsigned long long end = thread->status_var.*status_resources[i];
+      ts->resources[i] = end > start.status[i] ? end - start.status[i] : 0;
+    }
+  } else {
+    /* The start of the statement was not seen, e.g. it is the one that
+       installed the component. Fall back to the wall clock start time. */
+    unsigned long long now_us = realtime_clock_us();
+    ts->duration_ns = now_us > thread->start_utime
+                          ? (now_us - thread->start_utime) * NANOS_PER_MICRO
+                          : 0;
+    ts->cpu_time_ns = 0;
+    for (int i = 0; i < WORKLOAD_RESOURCES; i++) {
+      if (status_resources[i] != nullptr) ts->resources[i] = 0;
+    }
+  }
+  statement_depth = 0;
+}
+
+void capture_nested_statement_start(THD *thread) {
+  // Nested statements are only measured along with their top-level one.
+  if (statement_depth == 0) return;
+
+  if (statement_depth < WORKLOAD_MAX_NESTING) {
+    statement_start &start = statement_stack[statement_depth];
+    start.monotonic_ns = monotonic_clock_ns();
+    start.rows_examined = thread->get_examined_row_count();
+    start.rows_sent = thread->get_sent_row_count();
+    start.nested_duration_ns = 0;
+    start.nested_rows_examined = 0;
+    start.nested_rows_sent = 0;
+  }
+  statement_stack[0].has_nested = true;
+  statement_depth++;
+}
+
+/* Change of a row counter, which restarts from zero in sub-statements. */
+static unsigned long long counter_delta(unsigned long long start,
+                                        unsigned long long end) {
+  return end >= start ? end - start : end;
+}
+
+/* a - b, or 0 if b is larger, e.g. counters restarted by a sub-statement. */
+static unsigned long long exclusive(unsigned long long a,
+                                    unsigned long long b) {
+  return a > b ? a - b : 0;
+}
+
+bool get_nested_statement_stats(THD *thread, thread_stats *ts) {
+  if (statement_depth <= 1) return false;
+  statement_depth--;
+  if (statement_depth >= WORKLOAD_MAX_NESTING) return false;
+
+  const statement_start &start = statement_stack[statement_depth];
+  statement_start &parent = statement_stack[statement_depth - 1];
+  unsigned long long end_ns = monotonic_clock_ns();
+  unsigned long long duration_ns = end_ns - start.monotonic_ns;
+  unsigned long long rows_examined =
+      counter_delta(start.rows_examined, thread->get_examined_row_count());
+  unsigned long long rows_sent =
+      counter_delta(start.rows_sent, thread->get_sent_row_count());
+  parent.nested_duration_ns += duration_ns;
+  parent.nested_rows_examined += rows_examined;
+  parent.nested_rows_sent += rows_sent;
+
+  *ts = thread_stats();
+  ts->end_ns = end_ns;
+  ts->duration_ns = exclusive(duration_ns, start.nested_duration_ns);
+  ts->rows_examined = exclusive(rows_examined, start.nested_rows_examined);
+  ts->rows_sent = exclusive(rows_sent, start.nested_rows_sent);
+  if (thread->get_stmt_da()->status() == Diagnostics_area::DA_OK)
+    ts->rows_affected = thread->get_stmt_da()->affected_rows();
+  return true;
+}
+
+unsigned long long get_thd_rows_examined(THD *thread) {
+  return thread->get_examined_row_count();
+}
+
+unsigned long long get_thd_query_id(THD *thread) { return thread->query_id; }
+
+bool is_system_thread(THD *thread) {
+  return thread->system_thread != NON_SYSTEM_THREAD || thread->slave_thread;
+}
+
+void get_thd_account(THD *thread, std::string_view *user,
+                     std::string_view *host) {
+  LEX_CSTRING thd_user = thread->security_context()->user();
+  LEX_CSTRING thd_host = thread->security_context()->host_or_ip();
+  *user = std::string_view(thd_user.str == nullptr ? "" : thd_user.str,
+                           thd_user.length);
+  *host = std::string_view(thd_host.str == nullptr ? "" : thd_host.str,
+                           thd_host.length);
+}
 
-  ts->start_time = &thread->start_time;
-  ts->ustart_time = thread->start_utime;
+bool get_thd_user_variable(THD *thread, const std::string &name,
+                           std::string_view *value) {
+  // Only the session's own thread changes its variables, which is this one.
+  auto it = thread->user_vars.find(name);
+  if (it == thread->user_vars.end()) return false;
 
-  return ts;
+  const user_var_entry *entry = it->second.get();
+  if (entry->type() != STRING_RESULT || entry->ptr() == nullptr) return false;
+  *value = std::string_view(entry->ptr(), entry->length());
+  return true;
 }
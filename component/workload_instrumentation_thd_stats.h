@@ -5,18 +5,117 @@
 #ifndef MYSQL_WORKLOAD_INSTRUMENTATION_THD_STATS_H
 #define MYSQL_WORKLOAD_INSTRUMENTATION_THD_STATS_H
 
-#include <sys/time.h>
+#include <array>
+#include <string>
+#include <string_view>
 
 class THD;
 
+/*
+  Resources used by statements, beyond rows and time. They are kept in arrays
+  indexed by this enum, from thread_stats to the shared counters, so adding
+  one does not add code to the statement path.
+*/
+enum workload_resource {
+  /* Internal temporary tables created on disk. */
+  WORKLOAD_RESOURCE_TMP_DISK_TABLES,
+  /* Merge passes of sorts, as Sort_merge_passes. */
+  WORKLOAD_RESOURCE_SORT_MERGE_PASSES,
+  /* Joins without index, as Select_full_join. */
+  WORKLOAD_RESOURCE_FULL_JOINS,
+  /* Full scans of the first table of joins, as Select_scan. */
+  WORKLOAD_RESOURCE_FULL_SCANS,
+  WORKLOAD_RESOURCE_BYTES_SENT,
+  WORKLOAD_RESOURCE_BYTES_RECEIVED,
+  /* Statements that failed. */
+  WORKLOAD_RESOURCE_ERRORS,
+  /* Errors, warnings and notes raised. */
+  WORKLOAD_RESOURCE_WARNINGS,
+  /* Statements interrupted by max_execution_time. */
+  WORKLOAD_RESOURCE_TIMEOUTS,
+  /* Statements delayed by the budget of their workload. */
+  WORKLOAD_RESOURCE_THROTTLED,
+  /* Statements rejected by the budget of their workload. */
+  WORKLOAD_RESOURCE_REJECTED,
+  /*
+    Statements run by stored programs, and their rows and time, see
+    get_nested_statement_stats(). They are counted in the workload of their
+    top-level statement, whose own counters include them.
+  */
+  WORKLOAD_RESOURCE_NESTED_QUERIES,
+  WORKLOAD_RESOURCE_NESTED_ROWS_EXAMINED,
+  WORKLOAD_RESOURCE_NESTED_ROWS_SENT,
+  WORKLOAD_RESOURCE_NESTED_ROWS_AFFECTED,
+  /* In nanoseconds. */
+  WORKLOAD_RESOURCE_NESTED_DURATION,
+  WORKLOAD_RESOURCES
+};
+
 struct thread_stats {
   unsigned long long int rows_examined;
   unsigned long long int rows_sent;
   unsigned long long int rows_affected;
-  timeval * start_time;
-  unsigned long long int ustart_time;
+  /* Monotonic clock when the statement ended. */
+  unsigned long long int end_ns;
+  unsigned long long int duration_ns;
+  /* Time until table locks were acquired, as in the slow query log. */
+  unsigned long long int lock_time_ns;
+  unsigned long long int cpu_time_ns;
+  std::array<unsigned long long int, WORKLOAD_RESOURCES> resources{};
 };
 
-thread_stats * get_thd_row_stats(THD *thread);
+/* Levels of statements measured, the top-level one included. */
+#define WORKLOAD_MAX_NESTING 16
+
+/* Captures the clocks at EVENT_TRACKING_QUERY_START, on the thread running
+   the statement. For COM_QUERY, query_length is the length of its text,
+   which stands for the command packet in WORKLOAD_RESOURCE_BYTES_RECEIVED. */
+void capture_statement_start(THD *thread, size_t query_length);
+
+/* Fills ts, usually a stack variable, with the current statement's stats. */
+void get_thd_row_stats(THD *thread, thread_stats *ts);
+
+/*
+  Captures the clocks and row counters at EVENT_TRACKING_QUERY_NESTED_START,
+  when a stored program run by the current statement starts a statement.
+  Nested statements are kept on a per thread stack, so that each end event
+  is matched with its start whatever the depth.
+*/
+void capture_nested_statement_start(THD *thread);
+
+/*
+  At EVENT_TRACKING_QUERY_NESTED_STATUS_END, fills the rows, end time and
+  duration of ts with those of the nested statement ending. Returns false if
+  its start was not captured, e.g. it is nested deeper than
+  WORKLOAD_MAX_NESTING.
+
+  The server keeps adding to the row counters of the THD across the
+  statements of a procedure, and restarts them from zero in functions and
+  triggers, so nested statements are measured as the difference between
+  their start and their end. Rows and time of the statements nested in a
+  nested statement are left out of its own: nested counters add up to the
+  work done in stored programs, without counting any of it twice.
+*/
+bool get_nested_statement_stats(THD *thread, thread_stats *ts);
+
+/* Rows examined so far by the current statement. */
+unsigned long long get_thd_rows_examined(THD *thread);
+
+/* Id of the statement the thread is running. */
+unsigned long long get_thd_query_id(THD *thread);
+
+/* Whether the thread is a server thread, e.g. a replica applier. */
+bool is_system_thread(THD *thread);
+
+/* The user and the host, or IP, the thread's statements run as. */
+void get_thd_account(THD *thread, std::string_view *user,
+                     std::string_view *host);
+
+/*
+  The value of a user variable of the thread's session, e.g. workload_name for
+  @workload_name. Returns false if it is not set, NULL or not a string.
+*/
+bool get_thd_user_variable(THD *thread, const std::string &name,
+                           std::string_view *value);
 
 #endif  // MYSQL_WORKLOAD_INSTRUMENTATION_THD_STATS_H
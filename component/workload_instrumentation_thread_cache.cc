@@ -0,0 +1,259 @@
+#include "workload_instrumentation_thread_cache.h"
+#include "workload_instrumentation_memory.h"
+#include "workload_instrumentation_sysvars.h"
+
+#include <atomic>
+#include <thread>
+
+#include <mysql/components/services/log_builtins.h> /* LogComponentErr */
+#include <mysql/components/services/mysql_mutex.h>
+#include <mysqld_error.h> /* Errors */
+
+struct workload_thread_cache_entry {
+  workload_instrumentation_record *record;
+  workload_counters delta;
+  unsigned int used_buckets;
+  unsigned int buckets[WORKLOAD_THREAD_CACHE_BUCKETS];
+  unsigned long long bucket_counts[WORKLOAD_THREAD_CACHE_BUCKETS];
+
+  void add_to_bucket(unsigned int bucket, unsigned long long count) {
+    for (unsigned int i = 0; i < used_buckets; i++) {
+      if (buckets[i] == bucket) {
+        bucket_counts[i] += count;
+        return;
+      }
+    }
+    if (used_buckets == WORKLOAD_THREAD_CACHE_BUCKETS) {
+      record->histogram.add_to_bucket(bucket, count);
+      return;
+    }
+    buckets[used_buckets] = bucket;
+    bucket_counts[used_buckets++] = count;
+  }
+};
+
+struct workload_thread_cache_digest {
+  workload_instrumentation_record *record;
+  workload_digest_counters delta;
+};
+
+struct alignas(64) workload_thread_cache
+    : workload_memory_accounted<WORKLOAD_MEMORY_THREAD_CACHES> {
+  /*
+    Taken by the owner thread to add counters and by any thread flushing the
+    cache. Only contended while the P_S table is being read.
+  */
+  std::atomic<bool> locked{false};
+  /* Counter shard of the shared records this cache flushes into. */
+  unsigned int shard = 0;
+  unsigned int used_entries = 0;
+  unsigned int statements = 0;
+  unsigned long long last_flush_ns = 0;
+  workload_thread_cache_entry entries[WORKLOAD_THREAD_CACHE_ENTRIES];
+  unsigned int used_digests = 0;
+  workload_thread_cache_digest digests[WORKLOAD_THREAD_CACHE_DIGESTS];
+
+  /* Registry links, protected by LOCK_workload_thread_caches. */
+  workload_thread_cache *next = nullptr;
+  bool in_use = false;
+
+  void lock() {
+    while (locked.exchange(true, std::memory_order_acquire)) {
+      while (locked.load(std::memory_order_relaxed)) std::this_thread::yield();
+    }
+  }
+
+  void unlock() { locked.store(false, std::memory_order_release); }
+
+  /* Caller must hold the cache lock. */
+  void flush() {
+    for (unsigned int i = 0; i < used_entries; i++) {
+      auto &entry = entries[i];
+      add_record_counters(entry.record, shard, entry.delta);
+      for (unsigned int b = 0; b < entry.used_buckets; b++)
+        entry.record->histogram.add_to_bucket(entry.buckets[b],
+                                              entry.bucket_counts[b]);
+    }
+    used_entries = 0;
+    statements = 0;
+    flush_digests();
+  }
+
+  /* Caller must hold the cache lock. */
+  void flush_digests() {
+    for (unsigned int i = 0; i < used_digests; i++)
+      digests[i].record->top_digests.add(digests[i].delta);
+    used_digests = 0;
+  }
+};
+
+/*
+  Reference from a thread to the cache it owns. The generation detects caches
+  belonging to a previous load of the component, in case the library was not
+  unmapped between UNINSTALL and INSTALL COMPONENT.
+*/
+struct workload_thread_cache_ref {
+  workload_thread_cache *cache;
+  unsigned long generation;
+};
+
+static thread_local workload_thread_cache_ref current_cache = {nullptr, 0};
+static std::atomic<unsigned long> cache_generation{0};
+
+static mysql_mutex_t LOCK_workload_thread_caches;
+static workload_thread_cache *all_caches = nullptr;
+static unsigned int created_caches = 0;
+
+static PSI_mutex_key key_workload_instrumentation_LOCK_thread_caches;
+static PSI_mutex_info all_workload_instrumentation_mutexes[] = {
+    {&key_workload_instrumentation_LOCK_thread_caches,
+     "workload_instrumentation_thread_caches", 0, 0,
+     "Registry of per thread workload counter caches"}};
+
+int workload_thread_cache_init() {
+  mysql_mutex_register("workload_instrumentation",
+                       all_workload_instrumentation_mutexes, 1);
+  int result = mysql_mutex_init(key_workload_instrumentation_LOCK_thread_caches,
+                                &LOCK_workload_thread_caches, nullptr);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to init thread caches lock.");
+    return result;
+  }
+
+  all_caches = nullptr;
+  created_caches = 0;
+  cache_generation.fetch_add(1, std::memory_order_release);
+
+  return 0;
+}
+
+int workload_thread_cache_deinit() {
+  mysql_mutex_lock(&LOCK_workload_thread_caches);
+  while (all_caches != nullptr) {
+    workload_thread_cache *cache = all_caches;
+    all_caches = cache->next;
+    delete cache;
+  }
+  created_caches = 0;
+  mysql_mutex_unlock(&LOCK_workload_thread_caches);
+
+  // Invalidate the references threads still hold.
+  cache_generation.fetch_add(1, std::memory_order_release);
+
+  int result = mysql_mutex_destroy(&LOCK_workload_thread_caches);
+  if (result != 0) {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Failed to destroy thread caches lock.");
+  }
+
+  return result;
+}
+
+/* Returns the calling thread's cache, assigning one if needed. */
+static workload_thread_cache *get_thread_cache() {
+  unsigned long generation = cache_generation.load(std::memory_order_acquire);
+  if (current_cache.cache != nullptr && current_cache.generation == generation)
+    return current_cache.cache;
+
+  mysql_mutex_lock(&LOCK_workload_thread_caches);
+  workload_thread_cache *cache = all_caches;
+  while (cache != nullptr && cache->in_use) cache = cache->next;
+  if (cache == nullptr) {
+    cache = new workload_thread_cache;
+    cache->shard = created_caches++ % WORKLOAD_COUNTER_SHARDS;
+    cache->next = all_caches;
+    all_caches = cache;
+  }
+  cache->in_use = true;
+  mysql_mutex_unlock(&LOCK_workload_thread_caches);
+
+  current_cache = {cache, generation};
+  return cache;
+}
+
+workload_thread_cache *workload_thread_cache_lock() {
+  workload_thread_cache *cache = get_thread_cache();
+  cache->lock();
+  return cache;
+}
+
+void workload_thread_cache_unlock(workload_thread_cache *cache) {
+  cache->unlock();
+}
+
+void workload_thread_cache_add(workload_thread_cache *cache,
+                               workload_instrumentation_record *record,
+                               const workload_counters &delta,
+                               unsigned long long now_ns, unsigned int bucket) {
+  workload_thread_cache_entry *entry = nullptr;
+  for (unsigned int i = 0; i < cache->used_entries; i++) {
+    if (cache->entries[i].record == record) {
+      entry = &cache->entries[i];
+      break;
+    }
+  }
+  if (entry == nullptr) {
+    if (cache->used_entries == WORKLOAD_THREAD_CACHE_ENTRIES) cache->flush();
+    entry = &cache->entries[cache->used_entries++];
+    entry->record = record;
+    entry->delta = workload_counters();
+    entry->used_buckets = 0;
+  }
+  entry->delta.add(delta);
+  if (bucket != WORKLOAD_HISTOGRAM_BUCKETS)
+    entry->add_to_bucket(bucket, delta.count_queries);
+  cache->statements++;
+
+  if (cache->statements >= flush_statements_value ||
+      now_ns - cache->last_flush_ns >=
+          flush_interval_ms_value * 1000000ULL) {
+    cache->flush();
+    cache->last_flush_ns = now_ns;
+  }
+}
+
+void workload_thread_cache_add_digest(workload_thread_cache *cache,
+                                      workload_instrumentation_record *record,
+                                      const workload_digest_counters &delta) {
+  for (unsigned int i = 0; i < cache->used_digests; i++) {
+    workload_thread_cache_digest &entry = cache->digests[i];
+    if (entry.record != record || entry.delta.digest != delta.digest)
+      continue;
+    entry.delta.count_queries += delta.count_queries;
+    entry.delta.sum_rows_examined += delta.sum_rows_examined;
+    entry.delta.sum_rows_sent += delta.sum_rows_sent;
+    entry.delta.sum_duration_ns += delta.sum_duration_ns;
+    return;
+  }
+
+  if (cache->used_digests == WORKLOAD_THREAD_CACHE_DIGESTS)
+    cache->flush_digests();
+  cache->digests[cache->used_digests++] = {record, delta};
+}
+
+void workload_thread_cache_release() {
+  unsigned long generation = cache_generation.load(std::memory_order_acquire);
+  workload_thread_cache_ref ref = current_cache;
+  current_cache = {nullptr, 0};
+  if (ref.cache == nullptr || ref.generation != generation) return;
+
+  workload_thread_cache *cache = ref.cache;
+
+  mysql_mutex_lock(&LOCK_workload_thread_caches);
+  cache->lock();
+  cache->flush();
+  cache->unlock();
+  cache->in_use = false;
+  mysql_mutex_unlock(&LOCK_workload_thread_caches);
+}
+
+void workload_thread_cache_flush_all() {
+  mysql_mutex_lock(&LOCK_workload_thread_caches);
+  for (auto cache = all_caches; cache != nullptr; cache = cache->next) {
+    cache->lock();
+    cache->flush();
+    cache->unlock();
+  }
+  mysql_mutex_unlock(&LOCK_workload_thread_caches);
+}
@@ -0,0 +1,74 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_THREAD_CACHE_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_THREAD_CACHE_H
+
+#include "workload_instrumentation_pfs.h"
+
+/* Distinct workloads a thread accumulates counters for between flushes. */
+#define WORKLOAD_THREAD_CACHE_ENTRIES 8
+/* Distinct digests, of any workload, accumulated between flushes. */
+#define WORKLOAD_THREAD_CACHE_DIGESTS 8
+/*
+  Distinct latency histogram buckets accumulated per workload between
+  flushes. Statements of a workload mostly fall in a few buckets, others are
+  added to the shared histogram directly.
+*/
+#define WORKLOAD_THREAD_CACHE_BUCKETS 4
+
+/*
+  Per thread accumulation of workload counters.
+
+  Statements add their counters to a small cache owned by the thread running
+  them, which only touches the thread's own cache lines. The accumulated
+  deltas are added to the shared records (flushed):
+  - every workload_instrumentation.flush_statements statements,
+  - when workload_instrumentation.flush_interval_ms have passed since the
+    previous flush, checked when the thread finishes a statement,
+  - when the cache is full and a statement runs for a new workload,
+  - when the connection disconnects,
+  - before the P_S table is read, for all threads, so readers never miss
+    counts of idle connections.
+
+  Statements of top digests are accumulated the same way, and added to the
+  top digests of their workload when the cache is flushed, or when a thread
+  runs more distinct digests than it can hold. So are the latency histogram
+  buckets of statements, along with the other counters of their workload.
+
+  Caches are owned by a global registry and only freed when the component is
+  deinitialized, so flushing them from any thread is always safe.
+
+  Threads look records up with their cache locked, and keep it locked while
+  they use them. Once workload_thread_cache_flush_all() returns, every cache
+  has been unlocked at least once: records and index tables unpublished before
+  the call are no longer used by any thread and can be recycled.
+*/
+struct workload_thread_cache;
+
+int workload_thread_cache_init();
+int workload_thread_cache_deinit();
+
+/* Locks the calling thread's cache, assigning one if needed. */
+workload_thread_cache *workload_thread_cache_lock();
+void workload_thread_cache_unlock(workload_thread_cache *cache);
+
+/*
+  Caller must hold the cache lock. Unless bucket is WORKLOAD_HISTOGRAM_BUCKETS,
+  the delta.count_queries statements are also counted in that bucket of the
+  latency histogram of the record.
+*/
+void workload_thread_cache_add(
+    workload_thread_cache *cache, workload_instrumentation_record *record,
+    const workload_counters &delta, unsigned long long now_ns,
+    unsigned int bucket = WORKLOAD_HISTOGRAM_BUCKETS);
+
+/* Caller must hold the cache lock. */
+void workload_thread_cache_add_digest(workload_thread_cache *cache,
+                                      workload_instrumentation_record *record,
+                                      const workload_digest_counters &delta);
+
+/* Flushes the calling thread's cache and makes it available for reuse. */
+void workload_thread_cache_release();
+
+/* Flushes the caches of all threads. */
+void workload_thread_cache_flush_all();
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_THREAD_CACHE_H
@@ -0,0 +1,214 @@
+#include "workload_instrumentation_window.h"
+#include "workload_instrumentation_clock.h"
+#include "workload_instrumentation_self_stats.h"
+#include "workload_instrumentation_thread_cache.h"
+
+#include <cassert>
+#include <cstring>
+
+extern mysql_service_pfs_plugin_column_string_v2_t *pfs_string;
+extern mysql_service_pfs_plugin_column_bigint_v1_t *pfs_bigint;
+
+static const unsigned int window_minutes[WORKLOAD_WINDOWS] = {1, 5, 15};
+
+static_assert(WORKLOAD_WINDOW_MINUTES > 15,
+              "Snapshots must cover the longest window and the current minute");
+
+/* Copies the snapshot of a minute, returns false if there is none. */
+static bool read_window_snapshot(const workload_window &window,
+                                 unsigned long long minute,
+                                 workload_counters *counters) {
+  auto &slot_minute = window.minutes[minute % WORKLOAD_WINDOW_MINUTES];
+  if (slot_minute.load(std::memory_order_acquire) != minute) return false;
+
+  workload_counters copy;
+  add_shard_counters(&copy, window.snapshots[minute % WORKLOAD_WINDOW_MINUTES]);
+  if (slot_minute.load(std::memory_order_relaxed) != minute) return false;
+
+  *counters = copy;
+  return true;
+}
+
+/*
+  Counters of a record at the start of a minute: those of the first snapshot
+  taken since, or the current ones if there was no statement since.
+*/
+static void window_counters_at(const workload_instrumentation_record *record,
+                               unsigned long long minute,
+                               unsigned long long current_minute,
+                               workload_counters *counters) {
+  for (; minute <= current_minute; minute++) {
+    if (read_window_snapshot(record->window, minute, counters)) return;
+  }
+
+  *counters = workload_counters();
+  sum_record_counters(counters, record);
+}
+
+static void workload_instrumentation_window_copy_row(
+    workload_instrumentation_window_table_handle *th,
+    const workload_instrumentation_record *record) {
+  auto &row = th->m_current_row;
+  unsigned int minutes = window_minutes[th->m_pos.get_window()];
+
+  memcpy(row.workload, record->workload, record->workload_length + 1);
+  row.window_seconds = minutes * 60;
+
+  // Right after boot, windows start with the monotonic clock.
+  unsigned long long start_minute =
+      th->m_minute > minutes ? th->m_minute - minutes : 0;
+  workload_counters start;
+  window_counters_at(record, start_minute, th->m_minute, &start);
+  window_counters_at(record, th->m_minute, th->m_minute, &row.counters);
+  row.counters.subtract(start);
+}
+
+/* Copies the current row, returns false if its slot is not used. */
+static bool workload_instrumentation_window_copy_slot(
+    workload_instrumentation_window_table_handle *th) {
+  if (workload_records_rdlock() != 0) return false;
+
+  auto record = workload_record_at(th->m_pos.get_index());
+  if (record != nullptr) workload_instrumentation_window_copy_row(th, record);
+
+  workload_records_unlock();
+  return record != nullptr;
+}
+
+/* Access to PS table */
+int workload_instrumentation_window_delete_all_rows() { return 0; }
+
+PSI_table_handle *workload_instrumentation_window_open_table(PSI_pos **pos) {
+  // Make counters accumulated by all threads visible to this read.
+  workload_thread_cache_flush_all();
+
+  auto temp = new workload_instrumentation_window_table_handle();
+  temp->m_open_ns = workload_self_stats_start();
+  temp->m_records = workload_record_slots();
+  temp->m_minute = monotonic_clock_ns() / NANOS_PER_MINUTE;
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return (PSI_table_handle *)temp;
+}
+
+void workload_instrumentation_window_close_table(PSI_table_handle *handle) {
+  auto temp = (workload_instrumentation_window_table_handle *)handle;
+  workload_self_stats_add(WORKLOAD_SELF_TABLE_SCAN, temp->m_open_ns);
+  delete temp;
+}
+
+int workload_instrumentation_window_rnd_next(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_window_table_handle *)handle;
+
+  th->m_pos.set_at(&th->m_next_pos);
+  if (th->m_pos.get_window() == WORKLOAD_WINDOWS) th->m_pos.next_workload();
+
+  for (; th->m_pos.get_index() < th->m_records; th->m_pos.next_workload()) {
+    if (workload_instrumentation_window_copy_slot(th)) {
+      th->m_next_pos.set_after(&th->m_pos);
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int workload_instrumentation_window_rnd_init(PSI_table_handle *handle, bool) {
+  auto th = (workload_instrumentation_window_table_handle *)handle;
+  th->m_records = workload_record_slots();
+  th->m_minute = monotonic_clock_ns() / NANOS_PER_MINUTE;
+  return 0;
+}
+
+int workload_instrumentation_window_rnd_pos(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_window_table_handle *)handle;
+
+  if (th->m_pos.get_window() < WORKLOAD_WINDOWS)
+    workload_instrumentation_window_copy_slot(th);
+  return 0;
+}
+
+void workload_instrumentation_window_reset_position(PSI_table_handle *handle) {
+  auto th = (workload_instrumentation_window_table_handle *)handle;
+  th->m_pos.reset();
+  th->m_next_pos.reset();
+}
+
+int workload_instrumentation_window_read_column_value(PSI_table_handle *handle,
+                                                      PSI_field *field,
+                                                      unsigned int index) {
+  auto th = (workload_instrumentation_window_table_handle *)handle;
+  auto &row = th->m_current_row;
+
+  switch (index) {
+    case 0: /* WORKLOAD */
+      pfs_string->set_varchar_utf8mb4(field, row.workload);
+      break;
+    case 1: /* WINDOW_SECONDS */
+      pfs_bigint->set_unsigned(field, {row.window_seconds, false});
+      break;
+    case 2: /* COUNT_QUERIES */
+      pfs_bigint->set_unsigned(field, {row.counters.count_queries, false});
+      break;
+    case 3: /* SUM_ROWS_EXAMINED */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_examined, false});
+      break;
+    case 4: /* SUM_ROWS_SENT */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_sent, false});
+      break;
+    case 5: /* SUM_ROWS_AFFECTED */
+      pfs_bigint->set_unsigned(field, {row.counters.sum_rows_affected, false});
+      break;
+    case 6: /* SUM_DURATION_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_query_duration_ns / NANOS_PER_MICRO, false});
+      break;
+    case 7: /* SUM_LOCK_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_lock_time_ns / NANOS_PER_MICRO, false});
+      break;
+    case 8: /* SUM_CPU_TIME_US */
+      pfs_bigint->set_unsigned(
+          field, {row.counters.sum_cpu_time_ns / NANOS_PER_MICRO, false});
+      break;
+    default: /* We should never reach here */
+      assert(0);
+  }
+  return 0;
+}
+
+unsigned long long workload_instrumentation_window_get_row_count(void) {
+  return workload_record_slots() * WORKLOAD_WINDOWS;
+}
+
+void init_workload_instrumentation_window_share(
+    PFS_engine_table_share_proxy *share) {
+  share->m_table_name = "workload_instrumentation_window";
+  share->m_table_name_length = 31;
+  share->m_table_definition =
+      "`WORKLOAD` varchar(50), `WINDOW_SECONDS` BIGINT UNSIGNED, "
+      "`COUNT_QUERIES` BIGINT UNSIGNED, `SUM_ROWS_EXAMINED` BIGINT UNSIGNED, "
+      "`SUM_ROWS_SENT` BIGINT UNSIGNED, `SUM_ROWS_AFFECTED` BIGINT UNSIGNED, "
+      "`SUM_DURATION_US` BIGINT UNSIGNED, `SUM_LOCK_TIME_US` BIGINT UNSIGNED, "
+      "`SUM_CPU_TIME_US` BIGINT UNSIGNED";
+  share->m_ref_length = sizeof(workload_instrumentation_window_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = workload_instrumentation_window_get_row_count;
+  share->delete_all_rows = workload_instrumentation_window_delete_all_rows;
+
+  share->m_proxy_engine_table = {
+      workload_instrumentation_window_rnd_next,
+      workload_instrumentation_window_rnd_init,
+      workload_instrumentation_window_rnd_pos,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_window_read_column_value,
+      workload_instrumentation_window_reset_position,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      workload_instrumentation_window_open_table,
+      workload_instrumentation_window_close_table};
+}
@@ -0,0 +1,66 @@
+#ifndef MYSQL_WORKLOAD_INSTRUMENTATION_WINDOW_H
+#define MYSQL_WORKLOAD_INSTRUMENTATION_WINDOW_H
+
+#include <mysql/components/services/pfs_plugin_table_service.h>
+
+#include "workload_instrumentation_pfs.h"
+
+/*
+  P_S table performance_schema.workload_instrumentation_window: counters of
+  each workload over the last 1, 5 and 15 complete minutes, one row per
+  window. Windows are aligned on minutes of the monotonic clock, so they move
+  once a minute.
+*/
+#define WORKLOAD_WINDOWS 3
+
+class workload_instrumentation_window_POS {
+ private:
+  unsigned int m_index = 0;
+  unsigned int m_window = 0;
+
+ public:
+  ~workload_instrumentation_window_POS() = default;
+  workload_instrumentation_window_POS() = default;
+
+  void reset() {
+    m_index = 0;
+    m_window = 0;
+  }
+  unsigned int get_index() { return m_index; }
+  unsigned int get_window() { return m_window; }
+  void set_at(workload_instrumentation_window_POS *pos) {
+    m_index = pos->m_index;
+    m_window = pos->m_window;
+  }
+  void set_after(workload_instrumentation_window_POS *pos) {
+    m_index = pos->m_index;
+    m_window = pos->m_window + 1;
+  }
+  void next_workload() {
+    m_index++;
+    m_window = 0;
+  }
+};
+
+struct workload_instrumentation_window_row {
+  char workload[WORKLOAD_NAME_MAX_LENGTH + 1];
+  unsigned long long window_seconds;
+  workload_counters counters;
+};
+
+struct workload_instrumentation_window_table_handle {
+  workload_instrumentation_window_POS m_pos;
+  workload_instrumentation_window_POS m_next_pos;
+  workload_instrumentation_window_row m_current_row;
+  /* Record slots used when the scan started, later ones are not returned. */
+  size_t m_records;
+  /* Current minute when the scan started, all rows end with the one before. */
+  unsigned long long m_minute;
+  /* Monotonic time the table was opened, for self stats. */
+  unsigned long long m_open_ns;
+};
+
+void init_workload_instrumentation_window_share(
+    PFS_engine_table_share_proxy *share);
+
+#endif  // MYSQL_WORKLOAD_INSTRUMENTATION_WINDOW_H